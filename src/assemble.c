@@ -1,6 +1,8 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
 
 #include "bytecode.h"
 #include "assemble.h"
@@ -144,14 +146,26 @@ OPCODE_ASM_HANDLER(default)
 
 OPCODE_ASM_HANDLER(push)
 {
-    bytecode_push(bytecode, opcode);
-
     args_expect_count(inst, argc, 1);
     args_expect_number(args, 0);
 
-    int operand = atoi(args[0]);
+    errno = 0;
+    unsigned long long operand = strtoull(args[0], NULL, 10);
 
-    bytecode_push(bytecode, operand & 0xFF);
+    if (errno == ERANGE || operand > INT64_MAX)
+        utils_error(true, "operand #1 of `push' instruction is out of range");
+
+    if (operand <= UINT8_MAX)
+    {
+        bytecode_push(bytecode, opcode);
+        bytecode_push(bytecode, operand);
+        return;
+    }
+
+    bytecode_push(bytecode, OP_PUSH_INT64);
+
+    for (int i = 0; i < 8; i++)
+        bytecode_push(bytecode, (operand >> (i * 8)) & 0xFF);
 }
 
 static void bytecode_push_dword(bytecode_t *bytecode, int operand)
@@ -219,13 +233,11 @@ static void opcode_asm_handlers_init()
     opcode_asm_handlers[OP_REGXOR] = OPCODE_ASM_HANDLER_REF(binop);
 }
 
-void assemble(char *code, bytecode_t *bytecode)
+void assemble(const char *code, size_t len, bytecode_t *bytecode)
 {
     opcode_asm_handlers_init();
-
-    size_t len = strlen(code);
     
-    if (code[len - 1] != '\n' && code[len - 1] != '\r')
+    if (len == 0 || (code[len - 1] != '\n' && code[len - 1] != '\r'))
         utils_error(true, "Assembly file must end with a final newline");
 
     for (size_t i = 0; i < len; i++) 
@@ -3,6 +3,6 @@
 
 #include "bytecode.h"
 
-void assemble(char *code, bytecode_t *bytecode);
+void assemble(const char *code, size_t len, bytecode_t *bytecode);
 
 #endif
\ No newline at end of file
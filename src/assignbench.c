@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libgen.h>
+
+#include "utils.h"
+#include "xmalloc.h"
+#include "atom.h"
+#include "parser.h"
+#include "resolver.h"
+#include "scope.h"
+#include "eval.h"
+#include "gc.h"
+
+/* Assignment microbenchmark: evaluates loops whose bodies only assign
+   to, increment and decrement variables that already exist, and checks
+   that they allocate nothing per iteration. The script runs for two
+   iteration counts; any allocation (malloc or GC heap) that scales with
+   the count makes the benchmark fail.
+
+   Build with `make assignbench'; an optional argument sets the larger
+   iteration count. */
+
+config_t config = {
+    .currentfile = "<assignbench>",
+    .entryfile = "<assignbench>",
+    .outfile = NULL,
+    .progname = NULL
+};
+
+static const char *script =
+    "var i = 0; var sum = 0; var k = 0; var f = 0.5;\n"
+    "while (i < %zu) { sum = sum + i; k++; ++k; k--; --k; f = f * 1; i++; }\n"
+    "for (var j = 0; j < %zu; j++) { sum = sum - j; }\n"
+    "loop %zu { k = k + iteration; }\n";
+
+typedef struct {
+    size_t mallocs;
+    size_t cells;
+    double seconds;
+} run_t;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Only evaluation is measured, not parsing or setting up the scope. */
+static run_t run(size_t iterations)
+{
+    char source[512];
+    size_t length = snprintf(source, sizeof source, script, iterations, iterations, iterations);
+    ast_t ast;
+    scope_t global;
+
+    parser_create_ast(&ast, source, length);
+    scope_init(&global, NULL, 0);
+    resolve_ast(&ast, &global);
+
+    size_t mallocs = xmalloc_count;
+    size_t cells = gc_stats.allocations;
+    double start = now();
+
+    eval_ast(&ast, &global);
+
+    run_t result = {
+        .mallocs = xmalloc_count - mallocs,
+        .cells = gc_stats.allocations - cells,
+        .seconds = now() - start
+    };
+
+    scope_free(&global);
+    ast_free(&ast);
+
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    config.progname = basename(argv[0]);
+
+    size_t large = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t small = large / 10;
+
+    if (small == 0)
+        small = 1;
+
+    /* A first run warms up the scope pools and the GC heap. */
+    run(small);
+
+    run_t runs[2] = { run(small), run(large) };
+    size_t counts[2] = { small, large };
+
+    for (int i = 0; i < 2; i++)
+    {
+        printf("%9zu iterations: %8.2f ns/iteration, %zu mallocs, %zu GC cells\n",
+            counts[i], runs[i].seconds / (counts[i] * 3) * 1e9, runs[i].mallocs, runs[i].cells);
+    }
+
+    bool flat = runs[0].mallocs == runs[1].mallocs && runs[0].cells == runs[1].cells;
+
+    printf("allocations per iteration: %s\n", flat ? "0" : "NONZERO");
+    atom_table_free();
+
+    return flat ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ast.h"
+#include "utils.h"
+#include "xmalloc.h"
+
+#define AST_INITIAL_NODES 256
+#define AST_INITIAL_REFS 256
+#define AST_INITIAL_CHARS 1024
+
+/* Grows one of the arena arrays so that it can hold `needed` elements. */
+static void *ast_grow(void *array, uint32_t *capacity, size_t needed, size_t initial, size_t element_size)
+{
+    if (needed <= *capacity)
+        return array;
+
+    if (needed > UINT32_MAX)
+        utils_error(true, "program is too large");
+
+    size_t new_capacity = *capacity == 0 ? initial : *capacity;
+
+    while (new_capacity < needed)
+        new_capacity *= 2;
+
+    if (new_capacity > UINT32_MAX)
+        new_capacity = UINT32_MAX;
+
+    *capacity = new_capacity;
+    return xrealloc(array, new_capacity * element_size);
+}
+
+void ast_init(ast_t *ast)
+{
+    memset(ast, 0, sizeof (ast_t));
+
+    /* Reserve ref 0 for AST_NONE. */
+    ast_node_new(ast, NODE_UNKNOWN, 0);
+}
+
+ast_ref_t ast_node_new(ast_t *ast, ast_nodetype_t type, size_t line)
+{
+    ast->nodes = ast_grow(ast->nodes, &ast->node_capacity, (size_t) ast->node_count + 1, AST_INITIAL_NODES, sizeof (ast_node_t));
+
+    ast_ref_t ref = ast->node_count++;
+    ast_node_t *node = &ast->nodes[ref];
+
+    memset(node, 0, sizeof (ast_node_t));
+    node->type = type;
+    node->line = line;
+
+    return ref;
+}
+
+ast_list_t ast_list_new(ast_t *ast, const ast_ref_t *refs, size_t count)
+{
+    ast->refs = ast_grow(ast->refs, &ast->ref_capacity, (size_t) ast->ref_count + count, AST_INITIAL_REFS, sizeof (ast_ref_t));
+
+    ast_list_t list = { .start = ast->ref_count, .count = count };
+
+    if (count != 0)
+        memcpy(&ast->refs[list.start], refs, sizeof (ast_ref_t) * count);
+
+    ast->ref_count += count;
+    return list;
+}
+
+uint32_t ast_string_new(ast_t *ast, const char *str, size_t length)
+{
+    ast->chars = ast_grow(ast->chars, &ast->char_capacity, (size_t) ast->char_count + length + 1, AST_INITIAL_CHARS, sizeof (char));
+
+    uint32_t offset = ast->char_count;
+
+    memcpy(&ast->chars[offset], str, length);
+    ast->chars[offset + length] = '\0';
+    ast->char_count += length + 1;
+
+    return offset;
+}
+
+void ast_free(ast_t *ast)
+{
+    free(ast->nodes);
+    free(ast->refs);
+    free(ast->chars);
+
+    memset(ast, 0, sizeof (ast_t));
+}
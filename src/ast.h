@@ -3,7 +3,8 @@
 
 #include <sys/types.h>
 #include <stdbool.h>
-#include "vector.h"
+#include <stdint.h>
+#include "atom.h"
 
 typedef enum {
     NODE_PROGRAM,
@@ -59,109 +60,169 @@ typedef enum {
     DT_NULL
 } data_type_t;
 
-typedef struct ast_stmt {
-    ast_nodetype_t type;                            /* Type of this statement. */
-    size_t line;
+/* AST nodes live in one array owned by an ast_t and refer to each other
+   by 32-bit index instead of by pointer. Ref 0 is reserved and means
+   "no node". Lists of children (statements, arguments, parameters,
+   properties) are contiguous ranges of refs in ast_t.refs, and string
+   literals are ranges of ast_t.chars. Everything is freed at once by
+   ast_free(). */
+typedef uint32_t ast_ref_t;
+
+#define AST_NONE ((ast_ref_t) 0)
+
+/* Depth of an identifier the resolver could not find in any scope. */
+#define AST_UNRESOLVED UINT32_MAX
+
+typedef struct {
+    uint32_t start;                                 /* First index in ast_t.refs. */
+    uint32_t count;
+} ast_list_t;
+
+typedef struct ast_node {
+    ast_nodetype_t type;                            /* Type of this node. */
+    uint32_t line;
 
     union {
         /* if (type == NODE_PROGRAM || NODE_DECL_FUNCTION || NODE_BLOCK) */  
         struct {
-            struct ast_stmt *body;                  /* Array of statements. */
-            size_t size;                            /* Size of the array. */
-            char *fn_name;                          /* Function name. */
-            vector_t argnames;
+            ast_list_t body;                        /* Statements. */
+            ast_list_t argnames;                    /* NODE_IDENTIFIER parameters. */
+            atom_t *fn_name;                        /* Function name. */
+            uint32_t frame_size;                    /* Slots in the scope the body runs in. */
+            uint32_t fn_slot;                       /* Slot the function is declared in. */
+            struct exec_node *exec;                 /* Lowered body, for the closure engine. */
         };
         /* endif */     
 
         /* if (type == NODE_CTRL_IF || type == NODE_CTRL_WHILE || type == NODE_CTRL_LOOP) */
         struct {
-            struct ast_stmt *else_body;             /* Single statement. */
-            struct ast_stmt *ctrl_body;             /* Single statement. */
-            struct ast_stmt *ctrl_cond;
-            char *ctrl_loop_identifier;
+            ast_ref_t else_body;                    /* Single statement. */
+            ast_ref_t ctrl_body;                    /* Single statement. */
+            ast_ref_t ctrl_cond;
+            atom_t *ctrl_loop_identifier;
         };
         /* endif */ 
 
         /* if (type == NODE_CTRL_FOR) */                
         struct {
-            struct ast_stmt *for_body;              /* Single statement. */
-            struct ast_stmt *for_init;
-            struct ast_stmt *for_cond;              
-            struct ast_stmt *for_incdec;
+            ast_ref_t for_body;                     /* Single statement. */
+            ast_ref_t for_init;
+            ast_ref_t for_cond;              
+            ast_ref_t for_incdec;
+            uint32_t for_frame_size;                /* Slots in the scope of the loop header. */
         };
         /* endif */     
 
         /* if (type == NODE_EXPR_BINARY) || (type == NODE_EXPR_UNARY) */
         struct {
-            struct ast_stmt *left;                  /* Pointer to the statement at left. */
-            struct ast_stmt *right;                 /* Pointer to the statement at right. */
+            ast_ref_t left;                         /* The operand at left. */
+            ast_ref_t right;                        /* The operand at right. */
             ast_operator_t operator;                /* The operator type. */
         };
         /* endif */                
         
         /* if (type == NODE_IDENTIFIER) */
-        char *symbol;                               /* The identifier symbol. */
+        struct {
+            atom_t *symbol;                         /* The identifier symbol. */
+            uint32_t depth;                         /* Scopes to walk up, or AST_UNRESOLVED. */
+            uint32_t slot;
+        };
         /* endif */                
         
         /* if (type == NODE_STRING) */
-        char *strval;                               /* The string value. */
+        struct {
+            uint32_t str_offset;                    /* NUL-terminated, in ast_t.chars. */
+            uint32_t str_length;
+            struct rtstring *string;                /* Pinned copy, cached by the evaluator. */
+        };
         /* endif */                
         
         /* if (type == NODE_NUMERIC_LITERAL) */
         struct {
-            long double value;                          /* The actual value of the numeric literal. */
+            union {
+                int64_t intval;
+                double floatval;
+            };
             bool is_float;
         };
         /* endif */                
         
         /* if (type == NODE_DECL_VAR) */
         struct {
-            char *identifier;
+            atom_t *identifier;
+            ast_ref_t varval;                       /* AST_NONE if there is no initializer. */
             bool is_const;
-            struct ast_stmt *varval;
-            bool has_val;
+            uint32_t var_slot;
         };                          
         /* endif */                
         
         /* if (type == NODE_EXPR_ASSIGNMENT) */
         struct {
-            struct ast_stmt *assignee;
-            struct ast_stmt *assignment_value;
+            ast_ref_t assignee;
+            ast_ref_t assignment_value;
         };                          
         /* endif */                
         
         /* if (type == NODE_EXPR_CALL) */
         struct {
-            struct ast_stmt *callee;
-            vector_t args; /* Vector of struct ast_stmt */
+            ast_ref_t callee;
+            ast_list_t args;
         };                          
         /* endif */                
         
         /* if (type == NODE_PROPERTY_LITERAL) */
         struct {
-            char *key;
-            struct ast_stmt *propval;       
+            atom_t *key;
+            ast_ref_t propval;                      /* AST_NONE for shorthand properties. */
+            uint32_t key_depth;                     /* Where a shorthand property's value lives. */
+            uint32_t key_slot;
         };                          
         /* endif */                
         
         /* if (type == NODE_OBJECT_LITERAL) */
         struct {
-            vector_t properties; /* Vector of struct ast_stmt */
-        };                          
+            ast_list_t properties;                  /* NODE_PROPERTY_LITERAL nodes. */
+            struct shape *shape;                    /* Cached by the evaluator. */
+        };
         /* endif */         
 
         /* if (type == NODE_EXPR_MEMBER_ACCESS) */
         struct {
-            struct ast_stmt *object;
-            struct ast_stmt *prop;
+            ast_ref_t object;
+            ast_ref_t prop;
             bool computed;
+            struct shape *ic_shape;                 /* Inline cache: last shape seen, or NULL. */
+            uint32_t ic_slot;                       /* Slot of the property in ic_shape. */
         };                          
         /* endif */     
 
         /* if (type == NODE_RETURN) */      
-        struct ast_stmt *return_expr;
+        ast_ref_t return_expr;
         /* endif */     
     };
-} ast_stmt;
+} ast_node_t;
+
+typedef struct ast {
+    ast_node_t *nodes;
+    uint32_t node_count;
+    uint32_t node_capacity;
+    ast_ref_t *refs;
+    uint32_t ref_count;
+    uint32_t ref_capacity;
+    char *chars;
+    uint32_t char_count;
+    uint32_t char_capacity;
+    ast_ref_t root;                                 /* The NODE_PROGRAM node. */
+} ast_t;
+
+#define AST_NODE(ast, ref) (&(ast)->nodes[(ref)])
+#define AST_LIST_NODE(ast, list, index) (&(ast)->nodes[(ast)->refs[(list).start + (index)]])
+#define AST_STRING(ast, node) (&(ast)->chars[(node)->str_offset])
+
+void ast_init(ast_t *ast);
+ast_ref_t ast_node_new(ast_t *ast, ast_nodetype_t type, size_t line);
+ast_list_t ast_list_new(ast_t *ast, const ast_ref_t *refs, size_t count);
+uint32_t ast_string_new(ast_t *ast, const char *str, size_t length);
+void ast_free(ast_t *ast);
 
 #endif
@@ -0,0 +1,515 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "astcache.h"
+#include "ast.h"
+#include "atom.h"
+#include "blaze.h"
+#include "xmalloc.h"
+
+/* Bump whenever the layout of ast_node_t or of the file changes. */
+#define ASTCACHE_FORMAT 3
+#define ASTCACHE_MAGIC "BLZAST\r\n"
+#define ASTCACHE_BYTE_ORDER 0x01020304u
+#define ASTCACHE_CHUNK 256
+
+/* A cache file is this header followed by the node array, the ref pool,
+   the character pool, one uint32_t length per symbol and finally the
+   symbol names back to back. Atom pointers inside the stored nodes are
+   replaced by 1-based symbol indices (0 for NULL). */
+typedef struct {
+    char magic[8];
+    uint32_t format;
+    uint32_t byte_order;
+    uint32_t node_size;
+    char version[20];
+    uint64_t source_hash;
+    uint64_t source_length;
+    uint32_t node_count;
+    uint32_t ref_count;
+    uint32_t char_count;
+    uint32_t symbol_count;
+    uint32_t symbol_bytes;
+    uint32_t root;
+} astcache_header_t;
+
+/* 64-bit FNV-1a over the interpreter version and the source. */
+static uint64_t astcache_hash(const char *code, size_t length)
+{
+    uint64_t hash = 14695981039346656037ull;
+    const char *version = VERSION;
+
+    for (size_t i = 0; version[i] != '\0'; i++)
+    {
+        hash ^= (unsigned char) version[i];
+        hash *= 1099511628211ull;
+    }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char) code[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static char *astcache_format(const char *fmt, const char *a, const char *b)
+{
+    int length = snprintf(NULL, 0, fmt, a, b);
+    char *str = xmalloc(length + 1);
+
+    snprintf(str, length + 1, fmt, a, b);
+    return str;
+}
+
+/* Returns the cache directory (heap-allocated), or NULL if caching is
+   disabled or there is nowhere to put it. */
+static char *astcache_dir()
+{
+    const char *dir = getenv("BLAZE_CACHE_DIR");
+
+    if (dir != NULL)
+        return dir[0] == '\0' ? NULL : strdup(dir);
+
+    dir = getenv("XDG_CACHE_HOME");
+
+    if (dir != NULL && dir[0] != '\0')
+        return astcache_format("%s/%s", dir, "blaze");
+
+    dir = getenv("HOME");
+
+    if (dir != NULL && dir[0] != '\0')
+        return astcache_format("%s/%s", dir, ".cache/blaze");
+
+    return NULL;
+}
+
+static char *astcache_path(const char *code, size_t length)
+{
+    char *dir = astcache_dir();
+
+    if (dir == NULL)
+        return NULL;
+
+    char key[32];
+    snprintf(key, sizeof key, "%016llx", (unsigned long long) astcache_hash(code, length));
+
+    char *path = astcache_format("%s/%s.ast", dir, key);
+    free(dir);
+    return path;
+}
+
+/* Creates every missing directory leading up to `path`'s last component. */
+static void astcache_mkdirs(char *path)
+{
+    for (char *p = strchr(path + 1, '/'); p != NULL; p = strchr(p + 1, '/'))
+    {
+        *p = '\0';
+#if defined(__WIN32__)
+        mkdir(path);
+#else
+        mkdir(path, 0755);
+#endif
+        *p = '/';
+    }
+}
+
+/* Returns the atom field of a node, if its type has one. */
+static atom_t **astcache_node_atom(ast_node_t *node)
+{
+    switch (node->type)
+    {
+        case NODE_PROGRAM:
+        case NODE_BLOCK:
+        case NODE_DECL_FUNCTION:
+            return &node->fn_name;
+
+        case NODE_CTRL_IF:
+        case NODE_CTRL_WHILE:
+        case NODE_CTRL_LOOP:
+            return &node->ctrl_loop_identifier;
+
+        case NODE_IDENTIFIER:
+            return &node->symbol;
+
+        case NODE_DECL_VAR:
+            return &node->identifier;
+
+        case NODE_PROPERTY_LITERAL:
+            return &node->key;
+
+        default:
+            return NULL;
+    }
+}
+
+/* Clears the pointers the evaluator caches in a node. They are only
+   meaningful in the process that stored them. */
+static void astcache_node_reset(ast_node_t *node)
+{
+    switch (node->type)
+    {
+        case NODE_PROGRAM:
+        case NODE_BLOCK:
+        case NODE_DECL_FUNCTION:
+            node->exec = NULL;
+            break;
+
+        case NODE_STRING:
+            node->string = NULL;
+            break;
+
+        case NODE_OBJECT_LITERAL:
+            node->shape = NULL;
+            break;
+
+        case NODE_EXPR_MEMBER_ACCESS:
+            node->ic_shape = NULL;
+            node->ic_slot = 0;
+            break;
+
+        default:
+            break;
+    }
+}
+
+static bool astcache_write(FILE *file, const void *data, size_t size)
+{
+    return size == 0 || fwrite(data, size, 1, file) == 1;
+}
+
+void astcache_store(const ast_t *ast, const char *code, size_t length)
+{
+    char *path = astcache_path(code, length);
+
+    if (path == NULL)
+        return;
+
+    astcache_mkdirs(path);
+
+    char pid[32];
+    snprintf(pid, sizeof pid, "%ld", (long) getpid());
+    char *tmp_path = astcache_format("%s.%s.tmp", path, pid);
+
+    /* Number the distinct atoms in order of first use. */
+    size_t atoms = atom_count();
+    uint32_t *symbol_index = xcalloc(sizeof (uint32_t), atoms == 0 ? 1 : atoms);
+    atom_t **symbols = xmalloc(sizeof (atom_t *) * (atoms == 0 ? 1 : atoms));
+    uint32_t symbol_count = 0, symbol_bytes = 0;
+
+    for (uint32_t i = 0; i < ast->node_count; i++)
+    {
+        atom_t **field = astcache_node_atom(&ast->nodes[i]);
+
+        if (field == NULL || *field == NULL || symbol_index[(*field)->id] != 0)
+            continue;
+
+        atom_t *atom = *field;
+
+        symbols[symbol_count] = atom;
+        symbol_index[atom->id] = ++symbol_count;
+        symbol_bytes += atom->length;
+    }
+
+    astcache_header_t header = {
+        .magic = ASTCACHE_MAGIC,
+        .format = ASTCACHE_FORMAT,
+        .byte_order = ASTCACHE_BYTE_ORDER,
+        .node_size = sizeof (ast_node_t),
+        .version = VERSION,
+        .source_hash = astcache_hash(code, length),
+        .source_length = length,
+        .node_count = ast->node_count,
+        .ref_count = ast->ref_count,
+        .char_count = ast->char_count,
+        .symbol_count = symbol_count,
+        .symbol_bytes = symbol_bytes,
+        .root = ast->root
+    };
+
+    FILE *file = fopen(tmp_path, "wb");
+    bool ok = file != NULL;
+
+    ok = ok && astcache_write(file, &header, sizeof header);
+
+    /* Write the nodes through a small buffer, swapping atoms for indices
+       and dropping evaluator caches. */
+    ast_node_t chunk[ASTCACHE_CHUNK];
+
+    for (uint32_t i = 0; ok && i < ast->node_count; i += ASTCACHE_CHUNK)
+    {
+        uint32_t count = ast->node_count - i < ASTCACHE_CHUNK ? ast->node_count - i : ASTCACHE_CHUNK;
+
+        memcpy(chunk, &ast->nodes[i], sizeof (ast_node_t) * count);
+
+        for (uint32_t j = 0; j < count; j++)
+        {
+            astcache_node_reset(&chunk[j]);
+
+            atom_t **field = astcache_node_atom(&chunk[j]);
+
+            if (field != NULL && *field != NULL)
+                *field = (atom_t *) (uintptr_t) symbol_index[(*field)->id];
+        }
+
+        ok = astcache_write(file, chunk, sizeof (ast_node_t) * count);
+    }
+
+    ok = ok && astcache_write(file, ast->refs, sizeof (ast_ref_t) * ast->ref_count);
+    ok = ok && astcache_write(file, ast->chars, ast->char_count);
+
+    for (uint32_t i = 0; ok && i < symbol_count; i++)
+    {
+        uint32_t symbol_length = symbols[i]->length;
+        ok = astcache_write(file, &symbol_length, sizeof symbol_length);
+    }
+
+    for (uint32_t i = 0; ok && i < symbol_count; i++)
+        ok = astcache_write(file, symbols[i]->name, symbols[i]->length);
+
+    if (file != NULL && fclose(file) != 0)
+        ok = false;
+
+    /* Readers only ever see complete files. */
+    if (!ok || rename(tmp_path, path) != 0)
+        unlink(tmp_path);
+
+    free(symbols);
+    free(symbol_index);
+    free(tmp_path);
+    free(path);
+}
+
+static inline bool astcache_ref_ok(const ast_t *ast, ast_ref_t ref)
+{
+    return ref < ast->node_count;
+}
+
+static inline bool astcache_list_ok(const ast_t *ast, ast_list_t list)
+{
+    return list.start <= ast->ref_count && list.count <= ast->ref_count - list.start;
+}
+
+/* Makes sure a loaded tree cannot send the evaluator out of bounds. */
+static bool astcache_validate(const ast_t *ast)
+{
+    if (ast->node_count < 2 || !astcache_ref_ok(ast, ast->root) || ast->nodes[ast->root].type != NODE_PROGRAM)
+        return false;
+
+    for (uint32_t i = 0; i < ast->ref_count; i++)
+    {
+        if (ast->refs[i] == AST_NONE || !astcache_ref_ok(ast, ast->refs[i]))
+            return false;
+    }
+
+    for (uint32_t i = 1; i < ast->node_count; i++)
+    {
+        const ast_node_t *node = &ast->nodes[i];
+        bool ok;
+
+        switch (node->type)
+        {
+            case NODE_PROGRAM:
+            case NODE_BLOCK:
+            case NODE_DECL_FUNCTION:
+                ok = astcache_list_ok(ast, node->body) && astcache_list_ok(ast, node->argnames) &&
+                    (node->type != NODE_DECL_FUNCTION || node->fn_name != NULL);
+                break;
+
+            case NODE_CTRL_IF:
+            case NODE_CTRL_WHILE:
+            case NODE_CTRL_LOOP:
+                ok = astcache_ref_ok(ast, node->ctrl_cond) && astcache_ref_ok(ast, node->ctrl_body) && astcache_ref_ok(ast, node->else_body);
+                break;
+
+            case NODE_CTRL_FOR:
+                ok = astcache_ref_ok(ast, node->for_init) && astcache_ref_ok(ast, node->for_cond) &&
+                    astcache_ref_ok(ast, node->for_incdec) && astcache_ref_ok(ast, node->for_body);
+                break;
+
+            case NODE_EXPR_BINARY:
+            case NODE_EXPR_UNARY:
+                ok = astcache_ref_ok(ast, node->left) && astcache_ref_ok(ast, node->right);
+                break;
+
+            case NODE_STRING:
+                ok = node->str_offset < ast->char_count && node->str_length < ast->char_count - node->str_offset &&
+                    ast->chars[node->str_offset + node->str_length] == '\0';
+                break;
+
+            case NODE_IDENTIFIER:
+                ok = node->symbol != NULL;
+                break;
+
+            case NODE_DECL_VAR:
+                ok = node->identifier != NULL && astcache_ref_ok(ast, node->varval);
+                break;
+
+            case NODE_EXPR_ASSIGNMENT:
+                ok = astcache_ref_ok(ast, node->assignee) && astcache_ref_ok(ast, node->assignment_value);
+                break;
+
+            case NODE_EXPR_CALL:
+                ok = astcache_ref_ok(ast, node->callee) && astcache_list_ok(ast, node->args);
+                break;
+
+            case NODE_PROPERTY_LITERAL:
+                ok = node->key != NULL && astcache_ref_ok(ast, node->propval);
+                break;
+
+            case NODE_OBJECT_LITERAL:
+                ok = astcache_list_ok(ast, node->properties);
+                break;
+
+            case NODE_EXPR_MEMBER_ACCESS:
+                ok = astcache_ref_ok(ast, node->object) && astcache_ref_ok(ast, node->prop);
+                break;
+
+            case NODE_RETURN:
+                ok = astcache_ref_ok(ast, node->return_expr);
+                break;
+
+            case NODE_NUMERIC_LITERAL:
+            case NODE_CTRL_BREAK:
+            case NODE_CTRL_CONTINUE:
+                ok = true;
+                break;
+
+            default:
+                ok = false;
+                break;
+        }
+
+        if (!ok)
+            return false;
+    }
+
+    return true;
+}
+
+/* Reads `count` elements of `size` bytes into a fresh buffer. */
+static void *astcache_read(FILE *file, size_t count, size_t size, bool *ok)
+{
+    if (!*ok || count == 0)
+        return NULL;
+
+    void *buffer = xmalloc(count * size);
+
+    if (fread(buffer, size, count, file) != count)
+        *ok = false;
+
+    return buffer;
+}
+
+bool astcache_load(ast_t *ast, const char *code, size_t length)
+{
+    char *path = astcache_path(code, length);
+
+    if (path == NULL)
+        return false;
+
+    FILE *file = fopen(path, "rb");
+    free(path);
+
+    if (file == NULL)
+        return false;
+
+    astcache_header_t header;
+    struct stat st;
+    bool ok = fstat(fileno(file), &st) == 0 &&
+        fread(&header, sizeof header, 1, file) == 1;
+
+    if (ok)
+    {
+        ok = memcmp(header.magic, ASTCACHE_MAGIC, sizeof header.magic) == 0 &&
+            header.format == ASTCACHE_FORMAT &&
+            header.byte_order == ASTCACHE_BYTE_ORDER &&
+            header.node_size == sizeof (ast_node_t) &&
+            strncmp(header.version, VERSION, sizeof header.version) == 0 &&
+            header.source_hash == astcache_hash(code, length) &&
+            header.source_length == length &&
+            (uint64_t) st.st_size == sizeof header +
+                (uint64_t) header.node_count * sizeof (ast_node_t) +
+                (uint64_t) header.ref_count * sizeof (ast_ref_t) +
+                (uint64_t) header.char_count +
+                (uint64_t) header.symbol_count * sizeof (uint32_t) +
+                (uint64_t) header.symbol_bytes;
+    }
+
+    if (!ok)
+    {
+        fclose(file);
+        return false;
+    }
+
+    /* The arrays are read straight into the arena, so a cache hit costs
+       no more memory than a fresh parse. */
+    memset(ast, 0, sizeof (ast_t));
+    ast->nodes = astcache_read(file, header.node_count, sizeof (ast_node_t), &ok);
+    ast->node_count = ast->node_capacity = header.node_count;
+    ast->refs = astcache_read(file, header.ref_count, sizeof (ast_ref_t), &ok);
+    ast->ref_count = ast->ref_capacity = header.ref_count;
+    ast->chars = astcache_read(file, header.char_count, sizeof (char), &ok);
+    ast->char_count = ast->char_capacity = header.char_count;
+    ast->root = header.root;
+
+    uint32_t *lengths = astcache_read(file, header.symbol_count, sizeof (uint32_t), &ok);
+    char *names = astcache_read(file, header.symbol_bytes, sizeof (char), &ok);
+
+    fclose(file);
+
+    /* Intern the symbols, then swap the stored indices for atoms. */
+    atom_t **symbols = xmalloc(sizeof (atom_t *) * ((size_t) header.symbol_count + 1));
+    size_t names_offset = 0;
+
+    symbols[0] = NULL;
+
+    for (uint32_t i = 0; ok && i < header.symbol_count; i++)
+    {
+        if (lengths[i] > header.symbol_bytes - names_offset)
+        {
+            ok = false;
+            break;
+        }
+
+        symbols[i + 1] = atom_intern(names + names_offset, lengths[i]);
+        names_offset += lengths[i];
+    }
+
+    for (uint32_t i = 0; ok && i < ast->node_count; i++)
+    {
+        astcache_node_reset(&ast->nodes[i]);
+
+        atom_t **field = astcache_node_atom(&ast->nodes[i]);
+
+        if (field == NULL)
+            continue;
+
+        uintptr_t index = (uintptr_t) *field;
+
+        if (index > header.symbol_count)
+            ok = false;
+        else
+            *field = symbols[index];
+    }
+
+    free(symbols);
+    free(lengths);
+    free(names);
+
+    if (!ok || !astcache_validate(ast))
+    {
+        ast_free(ast);
+        return false;
+    }
+
+    return true;
+}
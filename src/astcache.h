@@ -0,0 +1,19 @@
+#ifndef __ASTCACHE_H__
+#define __ASTCACHE_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "ast.h"
+
+/* On-disk cache of parsed programs. Entries are keyed by a hash of the
+   source text and the interpreter version, and live in $BLAZE_CACHE_DIR,
+   $XDG_CACHE_HOME/blaze or ~/.cache/blaze, in that order of preference.
+   Setting BLAZE_CACHE_DIR to an empty string disables the cache.
+
+   Both functions fail silently: a missing, stale or corrupt entry just
+   means the source is parsed again. */
+bool astcache_load(ast_t *ast, const char *code, size_t length);
+void astcache_store(const ast_t *ast, const char *code, size_t length);
+
+#endif
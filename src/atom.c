@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "atom.h"
+#include "xmalloc.h"
+
+#define ATOM_TABLE_INITIAL_SIZE 256
+
+/* Open-addressed table of atom pointers; the size is a power of two and
+   the table is kept at most half full. */
+static atom_t **table = NULL;
+static size_t table_size = 0;
+static size_t table_count = 0;
+
+/* 32-bit FNV-1a. */
+static uint32_t atom_hash(const char *name, size_t length)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static atom_t **atom_slot(atom_t **slots, size_t size, const char *name, size_t length, uint32_t hash)
+{
+    size_t mask = size - 1;
+    size_t index = hash & mask;
+
+    while (slots[index] != NULL)
+    {
+        atom_t *atom = slots[index];
+
+        if (atom->hash == hash && atom->length == length && memcmp(atom->name, name, length) == 0)
+            break;
+
+        index = (index + 1) & mask;
+    }
+
+    return &slots[index];
+}
+
+static void atom_table_grow()
+{
+    size_t new_size = table_size == 0 ? ATOM_TABLE_INITIAL_SIZE : table_size * 2;
+    atom_t **new_table = xcalloc(sizeof (atom_t *), new_size);
+
+    for (size_t i = 0; i < table_size; i++)
+    {
+        atom_t *atom = table[i];
+
+        if (atom != NULL)
+            *atom_slot(new_table, new_size, atom->name, atom->length, atom->hash) = atom;
+    }
+
+    free(table);
+    table = new_table;
+    table_size = new_size;
+}
+
+atom_t *atom_find(const char *name, size_t length)
+{
+    if (table == NULL)
+        return NULL;
+
+    return *atom_slot(table, table_size, name, length, atom_hash(name, length));
+}
+
+atom_t *atom_intern(const char *name, size_t length)
+{
+    if ((table_count + 1) * 2 > table_size)
+        atom_table_grow();
+
+    uint32_t hash = atom_hash(name, length);
+    atom_t **slot = atom_slot(table, table_size, name, length, hash);
+
+    if (*slot != NULL)
+        return *slot;
+
+    atom_t *atom = xmalloc(sizeof (atom_t) + length + 1);
+
+    atom->hash = hash;
+    atom->id = table_count++;
+    atom->length = length;
+    memcpy(atom->name, name, length);
+    atom->name[length] = '\0';
+
+    *slot = atom;
+    return atom;
+}
+
+atom_t *atom_get(const char *name)
+{
+    return atom_intern(name, strlen(name));
+}
+
+size_t atom_count()
+{
+    return table_count;
+}
+
+void atom_table_free()
+{
+    for (size_t i = 0; i < table_size; i++)
+        free(table[i]);
+
+    free(table);
+
+    table = NULL;
+    table_size = 0;
+    table_count = 0;
+}
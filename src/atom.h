@@ -0,0 +1,24 @@
+#ifndef __ATOM_H__
+#define __ATOM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* An interned identifier. Every distinct name is stored exactly once in
+   a global table, so two atoms are equal if and only if their pointers
+   are. The hash is computed once, at interning time. Atoms live until
+   atom_table_free() is called. */
+typedef struct atom {
+    uint32_t hash;
+    uint32_t id;            /* Sequential, starting at 0. */
+    size_t length;
+    char name[];            /* NUL-terminated. */
+} atom_t;
+
+atom_t *atom_intern(const char *name, size_t length);
+atom_t *atom_get(const char *name);
+atom_t *atom_find(const char *name, size_t length);
+size_t atom_count();
+void atom_table_free();
+
+#endif
@@ -7,6 +7,9 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <assert.h>
+#if !defined(__WIN32__)
+#include <sys/resource.h>
+#endif
 
 #define _DEBUG 1
 
@@ -19,6 +22,15 @@
 #include "xmalloc.h"
 #include "map.h"
 #include "functions.h"
+#include "source.h"
+#include "atom.h"
+#include "astcache.h"
+#include "resolver.h"
+#include "fold.h"
+#include "shape.h"
+#include "gc.h"
+#include "lower.h"
+#include "callstack.h"
 
 #define _GNU_SOURCE
 
@@ -51,133 +63,134 @@ void blaze_error(bool shouldexit, char *format, ...)
         exit(EXIT_FAILURE);
 }
 
-char *content = NULL;
+static source_t source = { 0 };
 
-void cleanup()
+/* With BLAZE_STATS set, runtime counters are reported on exit. */
+static void print_stats()
 {
-    if (content != NULL) 
-        free(content);
+    if (getenv("BLAZE_STATS") == NULL)
+        return;
+
+    size_t lookups = eval_ic_hits + eval_ic_misses;
+
+    fprintf(stderr, "member access cache: %zu hits, %zu misses (%.1f%% hit rate)\n",
+        eval_ic_hits, eval_ic_misses, lookups == 0 ? 0.0 : 100.0 * eval_ic_hits / lookups);
+    fprintf(stderr, "gc: %zu collections, %zu KiB freed, %zu KiB live, %zu KiB heap\n",
+        gc_stats.collections, gc_stats.freed_bytes / 1024, gc_stats.live_bytes / 1024, gc_stats.heap_bytes / 1024);
+    fprintf(stderr, "strings: %zu KiB\n", rtstring_bytes / 1024);
+
+#if !defined(__WIN32__)
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        fprintf(stderr, "memory: %ld KiB peak RSS\n", usage.ru_maxrss);
+#endif
 }
 
-scope_t create_global_scope()
+void cleanup()
 {
-    scope_t global = scope_init(NULL);  
-
-    runtime_val_t _null_val = {
-        .type = VAL_NULL,
-    };
+    print_stats();
+    source_free(&source);
+    gc_heap_free();
+    shape_tree_free();
+    atom_table_free();
+}
 
-    runtime_val_t _true_val = {
-        .type = VAL_BOOLEAN,
-        .boolval = true
-    };
+typedef struct {
+    ast_t *ast;
+    scope_t *global;
+    bool closures;
+} script_t;
 
-    runtime_val_t _false_val = {
-        .type = VAL_BOOLEAN,
-        .boolval = false
-    };
+/* Runs on the script stack (see callstack.h), like everything that
+   recurses over the tree, so deep nesting fails as cleanly as deep
+   recursion. */
+static void run_script(void *data)
+{
+    script_t *script = data;
 
-    runtime_val_t _system_val = {
-        .type = VAL_OBJECT,
-    };
+    if (!astcache_load(script->ast, source.data, source.length))
+    {
+        parser_create_ast(script->ast, source.data, source.length);
+        fold_ast(script->ast);
+        astcache_store(script->ast, source.data, source.length);
+    }
 
-    runtime_val_t *null_val = xmalloc(sizeof (runtime_val_t)),
-                  *true_val = xmalloc(sizeof (runtime_val_t)),
-                  *false_val = xmalloc(sizeof (runtime_val_t)),
-                  *system_val = xmalloc(sizeof (runtime_val_t));
+    source_free(&source);
 
-    memcpy(null_val, &_null_val, sizeof _null_val);
-    memcpy(true_val, &_true_val, sizeof _true_val);
-    memcpy(false_val, &_false_val, sizeof _false_val);
-    memcpy(system_val, &_system_val, sizeof _system_val);
+#ifndef _NODEBUG
+#ifdef _DEBUG
+    __debug_parser_print_ast_stmt(script->ast);
+#endif 
+#endif 
 
-    system_val->properties = (map_t) MAP_INIT(identifier_t *, 2);
+    resolve_ast(script->ast, script->global);
 
-    runtime_val_t _version_val = { .type = VAL_STRING, .strval = strdup(VERSION) };
-    runtime_val_t *version_val = xmalloc(sizeof _version_val);
-    memcpy(version_val, &_version_val, sizeof _version_val);
+    if (script->closures)
+    {
+        exec_node_t *program = lower_ast(script->ast);
 
-    identifier_t _version = { .is_const = true, .name = "version", .value = version_val };
-    identifier_t *version = xmalloc(sizeof _version);
-    memcpy(version, &_version, sizeof _version);
+        exec_run(program, script->global);
+        lower_free();
+    }
+    else
+        eval_ast(script->ast, script->global);
+}
 
-    map_set(&system_val->properties, "version", version);
+/* Builtins take the first slots of the global scope, in this order. */
+static void declare_builtin(scope_t *global, const char *name, runtime_val_t value)
+{
+    size_t slot = global->slot_count;
 
-    scope_declare_identifier(&global, "null", null_val, true);
-    scope_declare_identifier(&global, "true", true_val, true);
-    scope_declare_identifier(&global, "false", false_val, true);
-    scope_declare_identifier(&global, "system", system_val, true);
+    scope_reserve_slots(global, slot + 1);
+    scope_declare_slot(global, slot, atom_get(name), value, true);
+}
 
-    for (size_t i = 0; i < (sizeof (__native_functions) / sizeof (__native_functions[0])); i++)
-    {
-        runtime_val_t _fnval = {
-            .type = VAL_NATIVE_FN,
-            .fn = __native_functions[i].callback
-        };
+void create_global_scope(scope_t *global)
+{
+    scope_init(global, NULL, 0);
 
-        runtime_val_t *fnval = xmalloc(sizeof _fnval);
-        memcpy(fnval, &_fnval, sizeof _fnval);
+    object_t *system = object_new(shape_add(shape_root(), atom_get("version")));
+    system->slots[0] = BLAZE_STRING(rtstring_pin(VERSION, strlen(VERSION)));
 
-        scope_declare_identifier(&global, __native_functions[i].name, fnval, true);
-    }
+    declare_builtin(global, "null", BLAZE_NULL);
+    declare_builtin(global, "true", BLAZE_TRUE);
+    declare_builtin(global, "false", BLAZE_FALSE);
+    declare_builtin(global, "system", BLAZE_OBJECT(system));
 
-    return global;
+    for (size_t i = 0; i < (sizeof (__native_functions) / sizeof (__native_functions[0])); i++)
+        declare_builtin(global, __native_functions[i].name, BLAZE_NATIVE_FN(__native_functions[i].callback));
 }
 
 int main(int argc, char **argv) 
 {
     atexit(cleanup);
     config.progname = argv[0];
-    FILE *fp = NULL;
-
-    if (argc >= 2) {
-#if defined(__WIN32__)
-        fp = fopen(argv[1], "rb");
-#else
-        fp = fopen(argv[1], "r");
-#endif
-        if (fp == NULL) {
-            blaze_error(true, "%s", argv[1]);
-        }
-
-        config.entryfile = argv[1];
-        config.currentfile = argv[1];
-    }
 
-    assert(fp != NULL);
+    /* --closures runs the script with the closure engine (see lower.h)
+       instead of walking the AST. */
+    bool closures = argc >= 2 && strcmp(argv[1], "--closures") == 0;
 
-    char tmpbuf[1024];
-    size_t len = 1;
-    bool is_initial_iteration = true;
-
-    while (fgets(tmpbuf, sizeof tmpbuf, fp) != NULL)
+    if (closures)
     {
-        size_t newlen = strlen(tmpbuf);
-
-        len += newlen;
-
-        content = realloc(content, len);
+        argc--;
+        argv++;
+    }
 
-        if (content == NULL) 
-            blaze_error(true, "failed to reallocate memory");
+    /* Without a file argument (or with "-") the script is read from stdin. */
+    char *path = argc >= 2 ? argv[1] : NULL;
 
-        if (is_initial_iteration) 
-        {
-            strcpy(content, "");
-            is_initial_iteration = false;
-        }
+    config.entryfile = path != NULL ? path : "<stdin>";
+    config.currentfile = config.entryfile;
 
-        strncat(content, tmpbuf, sizeof tmpbuf);
-    }
+    if (!source_load(&source, path))
+        blaze_error(true, "%s", config.currentfile);
 
     bool empty = true;
 
-    for (size_t i = 0; i < len; i++)
+    for (size_t i = 0; i < source.length; i++)
     {
-        if (content == NULL)
-            break;
-        
-        if (content[i] != '\n' && content[i] != ' ' && content[i] != '\r' && content[i] != '\t')
+        if (source.data[i] != '\n' && source.data[i] != ' ' && source.data[i] != '\r' && source.data[i] != '\t')
         {
             empty = false;
             break;
@@ -187,17 +200,16 @@ int main(int argc, char **argv)
     if (empty)
         return 0;
 
-    ast_stmt prog = parser_create_ast(content);
-    znfree(content, "Program content");
+    ast_t ast;
+    scope_t global;
 
-#ifndef _NODEBUG
-#ifdef _DEBUG
-    __debug_parser_print_ast_stmt(&prog);
-#endif 
-#endif 
+    create_global_scope(&global);
+
+    script_t script = { .ast = &ast, .global = &global, .closures = closures };
+
+    callstack_run(run_script, &script);
 
-    scope_t global = create_global_scope();
-    runtime_val_t result = eval(prog, &global);
     scope_free(&global);    
+    ast_free(&ast);
     return 0;
 }
@@ -9,7 +9,7 @@
 
 typedef struct {
     char *name;
-    runtime_val_t (*callback)(vector_t, struct scope *);
+    runtime_val_t (*callback)(runtime_val_t *, size_t, struct scope *);
 } function_t;
 
 void blaze_error(bool shouldexit, char *format, ...);
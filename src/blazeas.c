@@ -11,6 +11,7 @@
 #include "opcode.h"
 #include "bytecode.h"
 #include "assemble.h"
+#include "source.h"
 
 config_t config = {
     .currentfile = NULL,
@@ -19,12 +20,11 @@ config_t config = {
     .progname = NULL
 };
 
-static char *file_content = NULL;
-static size_t file_size = 0;
+static source_t source = { 0 };
 
 static void cleanup()
 {
-    free(file_content);
+    source_free(&source);
 }
 
 static void initialize(int argc, char **argv)
@@ -38,25 +38,8 @@ static void initialize(int argc, char **argv)
 
 static void read_file() 
 {
-    FILE *file = fopen(config.currentfile, "rb");
-
-    if (file == NULL)
-        utils_error(true, "Cannot open '%s': %s", config.currentfile, strerror(errno));
-
-    struct stat st;
-
-    if (fstat(fileno(file), &st) == -1)
-        utils_error(true, "Cannot stat '%s': %s", config.currentfile, strerror(errno));
-
-    file_content = xmalloc(st.st_size);
-    file_size = st.st_size;
-
-    fread(file_content, sizeof (char), st.st_size, file);
-
-    if (file_content == NULL)
-        utils_error(true, "Failed to read '%s': %s", config.currentfile, strerror(errno));
-
-    fclose(file);
+    if (!source_load(&source, config.currentfile))
+        utils_error(true, "Cannot read '%s': %s", config.currentfile, strerror(errno));
 }
 
 static char *make_output_file_name()
@@ -109,7 +92,7 @@ static void write_output(bytecode_t *bytecode)
 static void start_assembling()
 {
     bytecode_t bytecode = BYTECODE_INIT;
-    assemble(file_content, &bytecode);
+    assemble(source.data, source.length, &bytecode);
     write_output(&bytecode);
     bytecode_free(&bytecode);
 }
@@ -32,6 +32,10 @@
 #include "opcode.h"
 #include "bytecode.h"
 #include "compile.h"
+#include "fold.h"
+#include "source.h"
+#include "atom.h"
+#include "callstack.h"
 
 config_t config = {
     .currentfile = NULL,
@@ -40,49 +44,18 @@ config_t config = {
     .progname = NULL
 };
 
-char *content = NULL;
-size_t content_length = 0;
-FILE *input_file = NULL;
+static source_t source = { 0 };
 
 static void cleanup()
 {
-    if (content != NULL)
-    {
-        free(content);
-        content = NULL;
-    }
-
-    if (input_file != NULL)
-    {
-        fclose(input_file);
-        input_file = NULL;
-    }
-}
-
-static ssize_t get_file_size(FILE *file)
-{
-    struct stat st;
-
-    if (fstat(fileno(file), &st) == -1)
-        return -1;
-
-    return st.st_size;
+    source_free(&source);
+    atom_table_free();
 }
 
-static void read_input_file()
+static void read_input_file(const char *path)
 {
-    ssize_t file_size = get_file_size(input_file);
-
-    if (file_size == -1)
-        utils_error(true, "Cannot stat '%s': %s", config.currentfile, strerror(errno));
-
-    content = xmalloc(file_size);
-
-    fread(content, sizeof (char), file_size, input_file);
-    content_length = file_size;
-
-    if (content == NULL)
-        utils_error(true, "Failed to read file '%s': %s", config.currentfile, strerror(errno));
+    if (!source_load(&source, path))
+        utils_error(true, "Cannot read file '%s': %s", path, strerror(errno));
 }
 
 static void init(int argc, char **argv)
@@ -90,18 +63,16 @@ static void init(int argc, char **argv)
     if (argc < 2)
         utils_error(true, "No input files");
 
-    input_file = fopen(argv[1], "r");
-
-    if (input_file == NULL)
-        utils_error(true, "Cannot open file '%s': %s", argv[1], strerror(errno));
+    read_input_file(argv[1]);
 
     config.currentfile = basename(argv[1]);
     config.entryfile = config.currentfile;
 }
 
-static ast_stmt make_ast_node()
+static void make_ast(ast_t *ast)
 {
-    return parser_create_ast(content);
+    parser_create_ast(ast, source.data, source.length);
+    fold_ast(ast);
 }
 
 static char *make_output_file_name()
@@ -149,19 +120,23 @@ static void write_compiled_bytecode(bytecode_t *bytecode)
     fclose(output_file);
 }
 
-static void begin_compilation()
+/* Runs on the script stack (see callstack.h), as in blaze. */
+static void begin_compilation(void *data)
 {
     bytecode_t bytecode;
 
-    if (content_length == 0)
+    if (source.length == 0)
     {
         bytecode_push(&bytecode, OP_HLT);
     }
     else
     {
-        ast_stmt ast_node = make_ast_node();
-        bytecode = bytecode_compile(ast_node);
+        ast_t ast;
+
+        make_ast(&ast);
+        bytecode = bytecode_compile(&ast);
         bytecode_disassemble(&bytecode);
+        ast_free(&ast);
     }
 
     write_compiled_bytecode(&bytecode);
@@ -174,8 +149,7 @@ int main(int argc, char **argv)
     config.progname = basename(argv[0]);
 
     init(argc, argv);
-    read_input_file();
-    begin_compilation();
+    callstack_run(begin_compilation, NULL);
 
     return 0;
 }
\ No newline at end of file
@@ -30,10 +30,10 @@ int vasprintf(char **ptr, const char *fmt, ...);
 
 static uint8_t magic_bytes_start[] = { 0x23, 0x21 }; /* '#', '!' */
 
-bytecode_t bytecode_compile(ast_stmt astnode)
+bytecode_t bytecode_compile(const ast_t *ast)
 {
     bytecode_t bytecode = BYTECODE_INIT;
-    compile(astnode, &bytecode);
+    compile_ast(ast, &bytecode);
     return bytecode;
 }
 
@@ -204,6 +204,28 @@ void bytecode_disassemble(bytecode_t *bytecode)
                 printf("push %u\n", (*++ip));
                 break;
 
+            case OP_PUSH_INT64:
+            {
+                uint64_t value = 0;
+
+                for (int i = 8; i > 0; i--)
+                    value = value << 8 | ip[i];
+
+                printf("push_int64 %" PRId64 "\n", (int64_t) value);
+                ip += 8;
+            }
+                break;
+
+            case OP_JMP_FALSE_OR_POP:
+            case OP_JMP_TRUE_OR_POP:
+                printf("%s +%u\n", *ip == OP_JMP_FALSE_OR_POP ? "jmp_false_or_pop" : "jmp_true_or_pop", ip[1] | ip[2] << 8);
+                ip += 2;
+                break;
+
+            case OP_BOOL:
+                puts("bool");
+                break;
+
             case OP_PUSH_STR:
             {
                 printf("push_str \"%s\"\n", (char *) (++ip));
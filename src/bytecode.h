@@ -17,7 +17,7 @@ typedef struct {
     char *error;
 } bytecode_t;
 
-bytecode_t bytecode_compile(ast_stmt astnode);
+bytecode_t bytecode_compile(const ast_t *ast);
 void bytecode_write(bytecode_t *bytecode, FILE *file);
 void bytecode_read_from_file(bytecode_t *bytecode, FILE *file);
 void bytecode_write_magic_header(FILE *file);
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "callstack.h"
+#include "eval.h"
+#include "utils.h"
+
+/* Kept free below the limit, for what runs between two checks: native
+   functions, the GC and reporting the error itself. */
+#define CALLSTACK_RESERVE ((size_t) 1 << 20)
+
+uintptr_t callstack_floor = 0;
+static size_t limit = CALLSTACK_DEFAULT_LIMIT;
+
+typedef struct {
+    void (*fn)(void *data);
+    void *data;
+} callstack_job_t;
+
+static void *callstack_start(void *arg)
+{
+    callstack_job_t *job = arg;
+    char base;
+
+    callstack_floor = (uintptr_t) &base - limit;
+    job->fn(job->data);
+    callstack_floor = 0;
+
+    return NULL;
+}
+
+/* Runs fn(data) on the script stack and waits for it to return. */
+void callstack_run(void (*fn)(void *data), void *data)
+{
+    const char *value = getenv("BLAZE_STACK_LIMIT");
+
+    if (value != NULL && atol(value) > 0)
+        limit = atol(value);
+
+    callstack_job_t job = { .fn = fn, .data = data };
+    pthread_attr_t attr;
+    pthread_t thread;
+    int error;
+
+    pthread_attr_init(&attr);
+    error = pthread_attr_setstacksize(&attr, limit + CALLSTACK_RESERVE);
+
+    if (error == 0)
+        error = pthread_create(&thread, &attr, callstack_start, &job);
+
+    if (error != 0)
+        utils_error(true, "cannot reserve a stack of %zu bytes: %s", limit, strerror(error));
+
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+}
+
+void callstack_overflow()
+{
+    eval_error(true, "Maximum call depth exceeded (BLAZE_STACK_LIMIT is %zu bytes)", limit);
+}
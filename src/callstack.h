@@ -0,0 +1,30 @@
+#ifndef __CALLSTACK_H__
+#define __CALLSTACK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Scripts are evaluated on a stack of their own instead of the process
+   stack, so how deep they can recurse only depends on BLAZE_STACK_LIMIT
+   (in bytes, CALLSTACK_DEFAULT_LIMIT by default). The whole stack is
+   reserved up front, but its pages are only committed once recursion
+   reaches them. Every call checks how much of it is left, so running
+   out is a script error rather than a crash. */
+#define CALLSTACK_DEFAULT_LIMIT ((size_t) 256 << 20)
+
+/* Lowest address calls may use, or 0 when not running on the stack
+   (e.g. in the benchmarks), which disables the check. */
+extern uintptr_t callstack_floor;
+
+void callstack_run(void (*fn)(void *data), void *data);
+void callstack_overflow();
+
+static inline void callstack_check()
+{
+    char here;
+
+    if ((uintptr_t) &here < callstack_floor)
+        callstack_overflow();
+}
+
+#endif
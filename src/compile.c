@@ -9,33 +9,69 @@
 #include "vector.h"
 #include "utils.h"
 #include "runtimevalues.h"
+#include "callstack.h"
 
 static size_t si = 0;
+static const ast_t *ast = NULL;
 
-static void compile_program(ast_stmt astnode, bytecode_t *bytecode)
+#define NODE(ref) AST_NODE(ast, (ref))
+
+static void compile_program(const ast_node_t *astnode, bytecode_t *bytecode)
 {
-    for (size_t i = 0; i < astnode.size; i++)
-        compile(astnode.body[i], bytecode);
+    for (size_t i = 0; i < astnode->body.count; i++)
+    {
+        const ast_node_t *stmt = AST_LIST_NODE(ast, astnode->body, i);
+
+        compile(stmt, bytecode);
+
+        /* The value of an expression statement is unused. */
+        if (stmt->type == NODE_EXPR_CALL || stmt->type == NODE_EXPR_BINARY)
+            bytecode_push(bytecode, OP_POP);
+    }
 
     bytecode_push(bytecode, OP_HLT);
 }
 
-static void compile_number(ast_stmt astnode, bytecode_t *bytecode)
+/* OP_PUSH takes one byte. Anything wider (folded constants, mostly) is
+   pushed whole with OP_PUSH_INT64. */
+static void compile_integer(int64_t value, bytecode_t *bytecode)
 {
-    bytecode_push(bytecode, OP_PUSH);
-    bytecode_push(bytecode, (uint8_t) astnode.value);
+    if (value >= 0 && value <= UINT8_MAX)
+    {
+        bytecode_push(bytecode, OP_PUSH);
+        bytecode_push(bytecode, value);
+        return;
+    }
+
+    bytecode_push(bytecode, OP_PUSH_INT64);
+
+    for (int i = 0; i < 8; i++)
+        bytecode_push(bytecode, ((uint64_t) value >> (i * 8)) & 0xFF);
+}
+
+static void compile_number(const ast_node_t *astnode, bytecode_t *bytecode)
+{
+    if (astnode->is_float)
+    {
+        bytecode_push(bytecode, OP_PUSH);
+        bytecode_push(bytecode, (uint8_t) astnode->floatval);
+    }
+    else
+        compile_integer(astnode->intval, bytecode);
+
     si++;
 }
 
-static void compile_string(ast_stmt astnode, bytecode_t *bytecode)
+static void compile_string(const ast_node_t *astnode, bytecode_t *bytecode)
 {
-    size_t len = strlen(astnode.strval);
+    size_t len = astnode->str_length;
+    const char *str = AST_STRING(ast, astnode);
 
     bytecode_push(bytecode, OP_PUSH_STR);
 
     for (size_t i = 0; i < len; i++)
     {
-        bytecode_push(bytecode, (uint8_t) astnode.strval[i]);
+        bytecode_push(bytecode, (uint8_t) str[i]);
     }
 
     bytecode_push(bytecode, STRTERM);
@@ -47,12 +83,12 @@ bool is_number_dt(data_type_t type)
     return type == DT_INT || type == DT_FLOAT;
 }
 
-data_type_t ast_node_to_dt(ast_stmt node)
+data_type_t ast_node_to_dt(const ast_node_t *node)
 {
-    if (node.type == NODE_EXPR_BINARY)
+    if (node->type == NODE_EXPR_BINARY)
     {
-        data_type_t left_dt = ast_node_to_dt(*node.left);
-        data_type_t right_dt = ast_node_to_dt(*node.right);
+        data_type_t left_dt = ast_node_to_dt(NODE(node->left));
+        data_type_t right_dt = ast_node_to_dt(NODE(node->right));
 
         if (is_number_dt(left_dt) && is_number_dt(right_dt))
         {
@@ -70,10 +106,10 @@ data_type_t ast_node_to_dt(ast_stmt node)
         }
     }
 
-    return node.type == NODE_NUMERIC_LITERAL ? (
-        node.is_float ? DT_FLOAT : DT_INT
+    return node->type == NODE_NUMERIC_LITERAL ? (
+        node->is_float ? DT_FLOAT : DT_INT
     ) : (
-        node.type == NODE_STRING ? DT_STRING : (
+        node->type == NODE_STRING ? DT_STRING : (
             DT_UNKNOWN
         )
     );
@@ -90,33 +126,72 @@ runtime_valtype_t inline dt_to_rtval_type(data_type_t type)
     );
 }
 
-static void compile_builtin_call_expr(ast_stmt astnode, bytecode_t *bytecode)
+static void compile_builtin_call_expr(const ast_node_t *astnode, bytecode_t *bytecode)
 {
-    for (ssize_t i = (astnode.args.length - 1); i >= 0; i--)
+    for (ssize_t i = (astnode->args.count - 1); i >= 0; i--)
     {
-        ast_stmt arg = VEC_GET(astnode.args, i, ast_stmt);
+        const ast_node_t *arg = AST_LIST_NODE(ast, astnode->args, i);
         compile_force_push(arg, bytecode);
     }
 
+    atom_t *callee = NODE(astnode->callee)->symbol;
+
     bytecode_push(bytecode, OP_BUILTIN_FN_CALL);
-    bytecode_push(bytecode, astnode.args.length);
+    bytecode_push(bytecode, astnode->args.count);
 
-    for (size_t i = 0; i < strlen(astnode.callee->identifier); i++)
+    for (size_t i = 0; i < callee->length; i++)
     {
-        bytecode_push(bytecode, astnode.callee->identifier[i]);
+        bytecode_push(bytecode, callee->name[i]);
     }
 
     bytecode_push(bytecode, '\0');
 }
 
-static void compile_bin_expr(ast_stmt astnode, bytecode_t *bytecode)
+/* `a && b' is compiled as:
+
+       <a>
+       jmp_false_or_pop end
+       <b>
+       bool
+   end:
+
+   and `||' the same way, with jmp_true_or_pop. */
+static void compile_logical_expr(const ast_node_t *astnode, bytecode_t *bytecode)
 {
-    compile_force_push(*astnode.left, bytecode);
-    compile_force_push(*astnode.right, bytecode);
+    compile_force_push(NODE(astnode->left), bytecode);
+    bytecode_push(bytecode, astnode->operator == OP_LOGICAL_AND ? OP_JMP_FALSE_OR_POP : OP_JMP_TRUE_OR_POP);
+
+    size_t operand = bytecode->size;
+
+    bytecode_push(bytecode, 0);
+    bytecode_push(bytecode, 0);
+
+    compile_force_push(NODE(astnode->right), bytecode);
+    bytecode_push(bytecode, OP_BOOL);
+
+    size_t offset = bytecode->size - (operand + 2);
+
+    if (offset > UINT16_MAX)
+        utils_error(true, "right operand of a logical operator is too long");
+
+    bytecode->bytes[operand] = offset & 0xff;
+    bytecode->bytes[operand + 1] = offset >> 8;
+}
+
+static void compile_bin_expr(const ast_node_t *astnode, bytecode_t *bytecode)
+{
+    if (astnode->operator == OP_LOGICAL_AND || astnode->operator == OP_LOGICAL_OR)
+    {
+        compile_logical_expr(astnode, bytecode);
+        return;
+    }
+
+    compile_force_push(NODE(astnode->left), bytecode);
+    compile_force_push(NODE(astnode->right), bytecode);
 
     uint8_t opcode;
 
-    switch (astnode.operator)
+    switch (astnode->operator)
     {
         case OP_PLUS:
             opcode = OP_ADD;
@@ -139,36 +214,38 @@ static void compile_bin_expr(ast_stmt astnode, bytecode_t *bytecode)
             break;
 
         default:
-            utils_error(true, "unknown binary operator: %i", astnode.operator);
+            utils_error(true, "unknown binary operator: %i", astnode->operator);
     }
 
     bytecode_push(bytecode, opcode);
 }
 
-void compile_vardecl(ast_stmt astnode, bytecode_t* bytecode)
+void compile_vardecl(const ast_node_t *astnode, bytecode_t* bytecode)
 {
     bytecode_push(bytecode, OP_DECL_VAR);
 
-    for (size_t i = 0; i < strlen(astnode.identifier); i++)
-        bytecode_push(bytecode, astnode.identifier[i]);
+    for (size_t i = 0; i < astnode->identifier->length; i++)
+        bytecode_push(bytecode, astnode->identifier->name[i]);
 
     bytecode_push(bytecode, 0);
 
-    if (astnode.has_val)
+    if (astnode->varval != AST_NONE)
     {
-        compile_force_push(*astnode.varval, bytecode);
+        compile_force_push(NODE(astnode->varval), bytecode);
         bytecode_push(bytecode, OP_STORE_VARVAL);
 
-        for (size_t i = 0; i < strlen(astnode.identifier); i++)
-            bytecode_push(bytecode, astnode.identifier[i]);
+        for (size_t i = 0; i < astnode->identifier->length; i++)
+            bytecode_push(bytecode, astnode->identifier->name[i]);
 
         bytecode_push(bytecode, 0);
     }
 }
 
-void compile(ast_stmt astnode, bytecode_t *bytecode)
+void compile(const ast_node_t *astnode, bytecode_t *bytecode)
 {
-    switch (astnode.type)
+    callstack_check();
+
+    switch (astnode->type)
     {
         case NODE_PROGRAM:
             compile_program(astnode, bytecode);
@@ -192,10 +269,32 @@ void compile(ast_stmt astnode, bytecode_t *bytecode)
     }
 }
 
-void compile_force_push(ast_stmt astnode, bytecode_t *bytecode)
+/* The fold pass turns constant conditions into `true' and `false'. */
+static bool compile_boolean(const ast_node_t *astnode, bytecode_t *bytecode)
+{
+    bool is_true = strcmp(astnode->symbol->name, "true") == 0;
+
+    if (!is_true && strcmp(astnode->symbol->name, "false") != 0)
+        return false;
+
+    bytecode_push(bytecode, OP_PUSH);
+    bytecode_push(bytecode, is_true);
+    bytecode_push(bytecode, OP_BOOL);
+    si++;
+
+    return true;
+}
+
+void compile_force_push(const ast_node_t *astnode, bytecode_t *bytecode)
 {
-    switch (astnode.type)
+    switch (astnode->type)
     {
+        case NODE_IDENTIFIER:
+            if (compile_boolean(astnode, bytecode))
+                return;
+
+            return compile(astnode, bytecode);
+
         case NODE_STRING:
             compile_string(astnode, bytecode);
             return;
@@ -207,4 +306,10 @@ void compile_force_push(ast_stmt astnode, bytecode_t *bytecode)
         default:
             return compile(astnode, bytecode);
     }
-}
\ No newline at end of file
+}
+
+void compile_ast(const ast_t *tree, bytecode_t *bytecode)
+{
+    ast = tree;
+    compile(AST_NODE(tree, tree->root), bytecode);
+}
@@ -1,5 +1,4 @@
 #include <stdio.h>
-#include <math.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
@@ -11,20 +10,51 @@
 #include "blaze.h"
 #include "runtimevalues.h"
 #include "xmalloc.h"
-#include "bstring.h"
+#include "shape.h"
+#include "gc.h"
+#include "callstack.h"
 
-#define NUM(node) (node.is_float ? node.floatval : (node.type == VAL_BOOLEAN ? node.boolval : node.intval))
+#define NUM(node) to_number(node)
 
-static size_t line = 0;
+size_t eval_line = 0;
 
-static inline void update_line(ast_stmt astnode)
+size_t eval_ic_hits = 0;
+size_t eval_ic_misses = 0;
+static const ast_t *ast = NULL;
+
+#define NODE(ref) AST_NODE(ast, (ref))
+
+static inline void update_line(const ast_node_t *astnode)
+{
+    eval_line = astnode->line;
+}
+
+/* Finds the variable an identifier was resolved to. */
+static identifier_t *eval_lvalue(const ast_node_t *identifier, scope_t *scope)
+{
+    identifier_t *found = identifier->depth == AST_UNRESOLVED ? NULL : scope_resolve_slot(scope, identifier->depth, identifier->slot);
+
+    if (found == NULL || !found->declared)
+        eval_error(true, "Undefined identifier '%s' in the current scope", identifier->symbol->name);
+
+    return found;
+}
+
+/* Booleans count as 0 or 1; other non-numbers as 0. */
+static inline int64_t to_integer(runtime_val_t val)
 {
-    line = astnode.line;
+    if (rtval_is_int(val))
+        return rtval_int(val);
+
+    return rtval_bool(val);
 }
 
-static bool is_float(long double val) 
+static inline double to_number(runtime_val_t val)
 {
-    return ceill(val) != floorl(val);
+    if (rtval_is_float(val))
+        return rtval_float(val);
+
+    return to_integer(val);
 }
 
 void eval_error(bool should_exit, const char *fmt, ...)
@@ -33,7 +63,7 @@ void eval_error(bool should_exit, const char *fmt, ...)
     char fmt_processed[strlen(fmt) + 50];
     va_start(args, fmt);
 
-    sprintf(fmt_processed, COLOR("1", "%s:%lu: ") COLOR("1;31", "fatal error") ": %s\n", config.currentfile, line, fmt);
+    sprintf(fmt_processed, COLOR("1", "%s:%lu: ") COLOR("1;31", "fatal error") ": %s\n", config.currentfile, eval_line, fmt);
     vfprintf(stderr, fmt_processed, args); 
 
     va_end(args);
@@ -42,207 +72,204 @@ void eval_error(bool should_exit, const char *fmt, ...)
         exit(EXIT_FAILURE);
 }
 
-runtime_val_t eval_function_decl(ast_stmt decl, scope_t *scope)
+runtime_val_t eval_function_decl(const ast_node_t *decl, scope_t *scope)
 {
-    runtime_val_t fnval = {
-        .type = VAL_USER_FN,
-        .argnames = decl.argnames,
-        .body = decl.body,
-        .size = decl.size,
-        .fn_name = decl.fn_name,
-        .scope = NULL,
-        .literal = false
-    };
-
-    fnval.scope = xmalloc(sizeof (scope_t));
-    memcpy(fnval.scope, scope, sizeof (scope_t));
-    runtime_val_t *fnval_heap = xmemcpy(&fnval, runtime_val_t);
-
-    scope_declare_identifier(scope, decl.fn_name, fnval_heap, true);
-    return fnval;
+    scope_t *captured = scope_capture(scope);
+    user_fn_t *fn = gc_alloc(GC_USER_FN, sizeof (user_fn_t));
+
+    fn->fn_name = decl->fn_name;
+    fn->decl = decl;
+    fn->scope = captured;
+
+    return scope_declare_slot(scope, decl->fn_slot, decl->fn_name, BLAZE_USER_FN(fn), true)->value;
 }
 
-static runtime_val_t copy_rtval(runtime_val_t *value)
+/* The shape only depends on the keys, so it is computed once per literal
+   and cached on the node. */
+runtime_val_t eval_object_expr(ast_node_t *object, scope_t *scope)
 {
-    runtime_val_t copy = {
-        .type = value->type
-    };
-
-    if (value->type == VAL_BOOLEAN)
-    {
-        copy.boolval = value->boolval;
-    }
-    else if (value->type == VAL_NUMBER)
-    {
-        copy.is_float = value->is_float;
+    shape_t *shape = object->shape;
 
-        if (copy.is_float)
-            copy.floatval = value->floatval;
-        else
-            copy.intval = value->intval;
-    }
-    else if (value->type == VAL_OBJECT)
+    if (shape == NULL)
     {
-        copy.properties.array = xcalloc(sizeof (map_entry_t *), value->properties.size);
-        copy.properties.count = value->properties.count;
-        copy.properties.size = value->properties.size;
-        copy.properties.typesize = value->properties.typesize;
+        shape = shape_root();
 
-        for (size_t i = 0; i < value->properties.size; i++)
+        for (size_t i = 0; i < object->properties.count; i++)
         {
-            if (value->properties.array[i] == NULL)
-                continue;
-
-            copy.properties.array[i] = xmalloc(sizeof (map_entry_t));
-            map_entry_t *entry = value->properties.array[i];
-            map_entry_t entry_copy = {
-                .key = strdup(entry->key),
-                .value = xmalloc(sizeof (identifier_t))
-            };
-
-            memcpy(entry_copy.value, value->properties.array[i]->value, sizeof (identifier_t));
-            memcpy(copy.properties.array[i], &entry_copy, sizeof (map_entry_t));
+            atom_t *key = AST_LIST_NODE(ast, object->properties, i)->key;
+
+            if (shape_lookup(shape, key) == SHAPE_NOT_FOUND)
+                shape = shape_add(shape, key);
         }
+
+        object->shape = shape;
     }
-    else if (value->type == VAL_STRING)
-    {
-        copy.strval = strdup(value->strval);
-    }
-    else if (value->type == VAL_USER_FN)
-    {
-        copy.fn_name = strdup(value->fn_name);
-        copy.scope = value->scope;
-        copy.argnames = value->argnames;
-        copy.body = value->body;
-        copy.size = value->size;
-    }
-    else if (value->type == VAL_NULL || value->type == VAL_NATIVE_FN)
-    {
-        copy = *value;
-    }
-    else 
-    {
-        assert(false && "Unknown value type");
-    }
-    
-    return copy;
-}
 
-runtime_val_t eval_object_expr(ast_stmt object, scope_t *scope)
-{
-    map_t properties = MAP_INIT(identifier_t *, 4096);
+    object_t *obj = object_new(shape);
+
+    gc_push_root(BLAZE_OBJECT(obj));
+
+    /* Without duplicate keys property i lives in slot i. */
+    bool in_order = shape->count == object->properties.count;
 
-    for (size_t i = 0; i < object.properties.length; i++)
+    for (size_t i = 0; i < object->properties.count; i++)
     {
-        ast_stmt prop = VEC_GET(object.properties, i, ast_stmt);
-        assert(prop.type == NODE_PROPERTY_LITERAL);
+        const ast_node_t *prop = AST_LIST_NODE(ast, object->properties, i);
+        assert(prop->type == NODE_PROPERTY_LITERAL);
 
-        identifier_t *val = xmalloc(sizeof (identifier_t));
+        runtime_val_t value;
 
-        if (prop.propval == NULL)
+        if (prop->propval == AST_NONE)
         {
-            identifier_t *identifier = scope_resolve_identifier(scope, prop.key);
+            identifier_t *identifier = prop->key_depth == AST_UNRESOLVED ? NULL : scope_resolve_slot(scope, prop->key_depth, prop->key_slot);
 
-            if (identifier == NULL)
+            if (identifier == NULL || !identifier->declared)
             {
-                eval_error(true, "Undefined identifier '%s' in the current scope", prop.key);
+                eval_error(true, "Undefined identifier '%s' in the current scope", prop->key->name);
             }
 
-            identifier_t identifier_copy = {
-                .is_const = identifier->is_const,
-                .name = strdup(identifier->name),
-                .value = xmalloc(sizeof (runtime_val_t))
-            };
-
-            runtime_val_t rtval_copy = copy_rtval(identifier->value);
-
-            memcpy(identifier_copy.value, &rtval_copy, sizeof (runtime_val_t));
-            memcpy(val, &identifier_copy, sizeof (identifier_t));
+            value = identifier->value;
         }
         else 
-        {
-            runtime_val_t eval_result = eval(*prop.propval, scope);
-            runtime_val_t copy = copy_rtval(&eval_result);
-            
-            identifier_t i = {
-                .is_const = false,
-                .name = prop.key
-            };
-
-            memcpy(val, &i, sizeof i);
-
-            val->value = xmalloc(sizeof (runtime_val_t));
-            memcpy(val->value, &copy, sizeof copy);
-        }
+            value = eval(NODE(prop->propval), scope);
+
+        uint32_t slot = in_order ? i : shape_lookup(shape, prop->key);
 
-        map_set(&properties, prop.key, val);
+        rtval_retain(value);
+        obj->slots[slot] = value;
     }
-    
-    runtime_val_t obj = {
-        .type = VAL_OBJECT,
-        .properties = properties,
-        .literal = true
-    };
 
-    return obj;
+    gc_pop_roots(1);
+    return BLAZE_OBJECT(obj);
 }
 
-runtime_val_t eval_user_function_call(runtime_val_t callee, vector_t args)
+static void eval_call_bind(user_fn_t *fn, runtime_val_t *args, size_t argc, scope_t *frame)
 {
-    scope_t newscope = scope_init(callee.scope);
+    const ast_node_t *decl = fn->decl;
 
-    if (callee.argnames.length != args.length)
-        eval_error(true, "Argument count does match while calling function '%s()'", callee.fn_name);
+    if (decl->argnames.count != argc)
+        eval_error(true, "Argument count does match while calling function '%s()'", fn->fn_name->name);
 
-    for (size_t i = 0; i < callee.argnames.length; i++)
+    for (size_t i = 0; i < decl->argnames.count; i++)
     {
-        scope_declare_identifier(&newscope, VEC_GET(callee.argnames, i, char *), xmemcpy(&VEC_GET(args, i, runtime_val_t), runtime_val_t), true); 
+        const ast_node_t *argname = AST_LIST_NODE(ast, decl->argnames, i);
+        scope_declare_slot(frame, argname->slot, argname->symbol, args[i], true);
     }
+}
 
-#ifdef _DEBUG
-#ifndef _NODEBUG
-    // __debug_map_print(&newscope.identifiers, false);
+/* Opens the frame of a call and binds the arguments. */
+void eval_call_enter(user_fn_t *fn, runtime_val_t *args, size_t argc, scope_t *frame)
+{
+    callstack_check();
+    scope_init(frame, fn->scope, fn->decl->frame_size);
+    eval_call_bind(fn, args, argc, frame);
+}
 
-    // if (newscope.parent)
-    // {
-    //     puts("PARENT:");    
-    //     __debug_map_print(&newscope.parent->identifiers, false);
-    // }
-#endif
-#endif
+/* Replaces the call running in `frame' with a call to `fn', for a call
+   in tail position. The arguments may only be referenced by the locals
+   that are dropped, so they are held while the frame is reset. */
+void eval_tail_call(user_fn_t *fn, runtime_val_t *args, size_t argc, scope_t *frame)
+{
+    for (size_t i = 0; i < argc; i++)
+        rtval_retain(args[i]);
+
+    scope_reuse(frame, fn->scope, fn->decl->frame_size);
+    eval_call_bind(fn, args, argc, frame);
+
+    for (size_t i = 0; i < argc; i++)
+        rtval_release(args[i]);
+}
+
+/* Closes the frame of a call, keeping the returned value alive: it may
+   only be referenced by a local. */
+runtime_val_t eval_call_leave(scope_t *frame, runtime_val_t ret)
+{
+    rtval_retain(ret);
+    scope_free(frame);
+
+    if (rtval_type(ret) == VAL_STRING)
+        rtstring_unref(rtval_string(ret));
+
+    return ret;
+}
+
+/* Native functions only borrow their arguments, so the temporaries
+   among them are freed once the call returns, unless returned. */
+void eval_free_arguments(runtime_val_t *args, size_t argc, runtime_val_t ret)
+{
+    for (size_t i = 0; i < argc; i++)
+    {
+        if (args[i].bits != ret.bits)
+            rtval_free_temporary(args[i]);
+    }
+}
+
+static runtime_val_t eval_call_operands(const ast_node_t *expr, scope_t *scope, runtime_val_t **args);
+
+/* A `return f(...)' at the top level of the body is a tail call: the
+   frame is handed over to `f' and its body runs in this loop, so
+   recursion through tail calls needs neither native stack nor new
+   frames. */
+runtime_val_t eval_user_function_call(runtime_val_t callee, runtime_val_t *args, size_t argc)
+{
+    const ast_node_t *decl = rtval_user_fn(callee)->decl;
+    scope_t newscope;
+
+    eval_call_enter(rtval_user_fn(callee), args, argc, &newscope);
 
-    runtime_val_t ret = {
-        .type = VAL_NULL
-    };
+    runtime_val_t ret = BLAZE_NULL;
 
-    for (size_t i = 0; i < callee.size; i++)
+    for (size_t i = 0; i < decl->body.count; i++)
     {
-        if (callee.body[i].type == NODE_RETURN)
+        const ast_node_t *stmt = AST_LIST_NODE(ast, decl->body, i);
+
+        if (stmt->type != NODE_RETURN)
+        {
+            rtval_free_temporary(eval(stmt, &newscope));
+            continue;
+        }
+
+        const ast_node_t *expr = NODE(stmt->return_expr);
+
+        if (expr->type != NODE_EXPR_CALL)
+        {
+            ret = eval(expr, &newscope);
+            break;
+        }
+
+        runtime_val_t *tail_args;
+        runtime_val_t next = eval_call_operands(expr, &newscope, &tail_args);
+
+        if (rtval_type(next) == VAL_NATIVE_FN)
         {
-            runtime_val_t tmpval = eval(*callee.body[i].return_expr, &newscope);
-            ret = copy_rtval(&tmpval);
+            ret = rtval_native_fn(next)(tail_args, expr->args.count, (struct scope *) &newscope);
+            eval_free_arguments(tail_args, expr->args.count, ret);
+            gc_pop_roots(expr->args.count + 1);
             break;
         }
 
-        runtime_val_t tmpval = eval(callee.body[i], &newscope);
-        scope_runtime_val_free(&tmpval);
+        eval_tail_call(rtval_user_fn(next), tail_args, expr->args.count, &newscope);
+        decl = rtval_user_fn(next)->decl;
+        gc_pop_roots(expr->args.count + 1);
+
+        /* The loop's increment brings this back to 0. */
+        i = (size_t) -1;
     }
 
-    if (ret.type != VAL_USER_FN)
-        scope_free(&newscope); 
-    
-    return ret;
+    return eval_call_leave(&newscope, ret);
 }
 
-#define IS_TRUTHY(val) (NUM(val) != 0)
+#define IS_TRUTHY(val) rtval_truthy(val)
 
-runtime_val_t eval_block(ast_stmt block, scope_t *scope)
+runtime_val_t eval_block(const ast_node_t *block, scope_t *scope)
 {
-    scope_t new_scope = scope_init(scope);
+    scope_t new_scope;
+
+    scope_init(&new_scope, scope, block->frame_size);
 
-    for (size_t i = 0; i < block.size; i++)
+    for (size_t i = 0; i < block->body.count; i++)
     {
-        eval(block.body[i], &new_scope);
+        rtval_free_temporary(eval(AST_LIST_NODE(ast, block->body, i), &new_scope));
 
         if (new_scope.is_broken)
         {
@@ -261,21 +288,17 @@ runtime_val_t eval_block(ast_stmt block, scope_t *scope)
     return BLAZE_NULL;
 }
 
-typedef enum {
-    LS_RET,
-    LS_BREAK,
-    LS_CONT
-} loop_status_t;
-
-loop_status_t eval_if_block(ast_stmt block, scope_t *scope)
+loop_status_t eval_if_block(const ast_node_t *block, scope_t *scope)
 {
-    assert(block.type == NODE_BLOCK);
+    assert(block->type == NODE_BLOCK);
 
-    scope_t new_scope = scope_init(scope);
+    scope_t new_scope;
 
-    for (size_t i = 0; i < block.size; i++)
+    scope_init(&new_scope, scope, block->frame_size);
+
+    for (size_t i = 0; i < block->body.count; i++)
     {
-        eval(block.body[i], &new_scope);
+        rtval_free_temporary(eval(AST_LIST_NODE(ast, block->body, i), &new_scope));
 
         if (new_scope.is_broken)
         {
@@ -298,764 +321,882 @@ loop_status_t eval_if_block(ast_stmt block, scope_t *scope)
     );
 }
 
-runtime_val_t eval_ctrl_if(ast_stmt node, scope_t *scope)
+runtime_val_t eval_ctrl_if(const ast_node_t *node, scope_t *scope)
 {
-    runtime_val_t cond = eval(*node.ctrl_cond, scope);
+    runtime_val_t cond = eval(NODE(node->ctrl_cond), scope);
+    bool truthy = IS_TRUTHY(cond);
+
+    rtval_free_temporary(cond);
 
-    if (IS_TRUTHY(cond))
+    if (truthy)
     {
-        if (node.ctrl_body->type == NODE_BLOCK)
-            return BLAZE_INT(eval_if_block(*node.ctrl_body, scope));
+        if (NODE(node->ctrl_body)->type == NODE_BLOCK)
+            return BLAZE_INT(eval_if_block(NODE(node->ctrl_body), scope));
         else
-            eval(*node.ctrl_body, scope);
+            rtval_free_temporary(eval(NODE(node->ctrl_body), scope));
     }
-    else if (node.else_body != NULL)
+    else if (node->else_body != AST_NONE)
     {
-        if (node.else_body->type == NODE_BLOCK)
-            return BLAZE_INT(eval_if_block(*node.else_body, scope));
+        if (NODE(node->else_body)->type == NODE_BLOCK)
+            return BLAZE_INT(eval_if_block(NODE(node->else_body), scope));
         else
-            eval(*node.else_body, scope);
+            rtval_free_temporary(eval(NODE(node->else_body), scope));
     }
 
     return BLAZE_NULL;
 }
 
-loop_status_t eval_loop_block(ast_stmt block, scope_t *scope)
+/* Runs one iteration of a loop body in `body_scope', which the loop
+   creates once and resets between iterations. */
+loop_status_t eval_loop_body(const ast_node_t *block, scope_t *body_scope)
 {
-    assert(block.type == NODE_BLOCK);
-
-    scope_t new_scope = scope_init(scope);
+    assert(block->type == NODE_BLOCK);
 
-    for (size_t i = 0; i < block.size; i++)
+    for (size_t i = 0; i < block->body.count; i++)
     {
-        runtime_val_t value = eval(block.body[i], &new_scope);
+        runtime_val_t value = eval(AST_LIST_NODE(ast, block->body, i), body_scope);
 
-        if (block.body[i].type == NODE_CTRL_IF)
+        if (AST_LIST_NODE(ast, block->body, i)->type == NODE_CTRL_IF)
         {
-            if (value.type == VAL_NUMBER)
+            if (rtval_is_int(value))
             {
-                if (value.intval == LS_BREAK)
-                    new_scope.is_broken = true;
-                else if (value.intval == LS_CONT)
-                    new_scope.is_continued = true;
+                if (rtval_int(value) == LS_BREAK)
+                    body_scope->is_broken = true;
+                else if (rtval_int(value) == LS_CONT)
+                    body_scope->is_continued = true;
             }
         }
+        else
+            rtval_free_temporary(value);
 
-        if (new_scope.is_broken)
-        {
-            break;
-        }
-
-        if (new_scope.is_continued)
-        {
+        if (body_scope->is_broken || body_scope->is_continued)
             break;
-        }
     }
 
-    bool continued = new_scope.is_continued;
-    bool broken = new_scope.is_broken;
+    loop_status_t status = body_scope->is_continued ? LS_CONT : (
+        body_scope->is_broken ? LS_BREAK : LS_RET
+    );
 
-    scope_free(&new_scope);
+    scope_reset(body_scope);
+    return status;
+}
 
-    return continued ? LS_CONT : (
-        broken ? LS_BREAK : LS_RET
-    );
+/* A loop condition `i < bound' (or <=, >, >=), where `i' is a variable
+   and `bound' a variable or an integer literal, is tested without
+   eval() as long as both sides hold inline integers. The variables are
+   resolved once and re-read on every test, so the body may change them. */
+typedef struct {
+    identifier_t *counter;              /* NULL if the condition is not counted. */
+    identifier_t *bound;                /* NULL if the bound is a literal. */
+    int64_t bound_literal;
+    ast_operator_t operator;
+} counted_cond_t;
+
+static counted_cond_t counted_cond_init(const ast_node_t *cond, scope_t *scope)
+{
+    counted_cond_t counted = { .counter = NULL };
+
+    if (cond->type != NODE_EXPR_BINARY)
+        return counted;
+
+    if (cond->operator != OP_CMP_LESS_THAN && cond->operator != OP_CMP_LESS_THAN_EQUALS &&
+        cond->operator != OP_CMP_GREATER_THAN && cond->operator != OP_CMP_GREATER_THAN_EQUALS)
+        return counted;
+
+    const ast_node_t *left = NODE(cond->left), *right = NODE(cond->right);
+
+    if (left->type != NODE_IDENTIFIER || left->depth == AST_UNRESOLVED)
+        return counted;
+
+    if (right->type == NODE_IDENTIFIER && right->depth != AST_UNRESOLVED)
+        counted.bound = scope_resolve_slot(scope, right->depth, right->slot);
+    else if (right->type == NODE_NUMERIC_LITERAL && !right->is_float && right->intval >= RTVAL_INT_MIN && right->intval <= RTVAL_INT_MAX)
+        counted.bound_literal = right->intval;
+    else
+        return counted;
+
+    counted.counter = scope_resolve_slot(scope, left->depth, left->slot);
+    counted.operator = cond->operator;
+
+    return counted;
 }
 
-runtime_val_t eval_ctrl_while(ast_stmt node, scope_t *scope)
+/* 1 or 0, or -1 if the condition has to be evaluated. */
+static int counted_cond_test(const counted_cond_t *counted)
 {
-    runtime_val_t cond = eval(*node.ctrl_cond, scope);
+    runtime_val_t counter = counted->counter->value;
+    runtime_val_t bound = counted->bound == NULL ? BLAZE_INT(counted->bound_literal) : counted->bound->value;
+
+    if (!counted->counter->declared || rtval_tag(counter) != RTVAL_TAG_INT ||
+        (counted->bound != NULL && (!counted->bound->declared || rtval_tag(bound) != RTVAL_TAG_INT)))
+        return -1;
 
-    while (IS_TRUTHY(cond))
+    int64_t left = rtval_int(counter), right = rtval_int(bound);
+
+    switch (counted->operator)
     {
-        if (node.ctrl_body->type == NODE_BLOCK)
-        {
-            loop_status_t status = eval_loop_block(*node.ctrl_body, scope);
+        case OP_CMP_LESS_THAN:
+            return left < right;
 
-            if (status == LS_CONT)
-            {
-                cond = eval(*node.ctrl_cond, scope);
-                continue;
-            }
+        case OP_CMP_LESS_THAN_EQUALS:
+            return left <= right;
 
-            if (status == LS_BREAK)
-                break;
-        }
-        else
-            eval(*node.ctrl_body, scope);
+        case OP_CMP_GREATER_THAN:
+            return left > right;
 
-        cond = eval(*node.ctrl_cond, scope);
+        default:
+            return left >= right;
     }
+}
 
-    return BLAZE_NULL;
+static inline bool loop_cond(const ast_node_t *cond, const counted_cond_t *counted, scope_t *scope)
+{
+    if (counted->counter != NULL)
+    {
+        int result = counted_cond_test(counted);
+
+        if (result >= 0)
+            return result;
+    }
+
+    runtime_val_t value = eval(cond, scope);
+    bool truthy = IS_TRUTHY(value);
+
+    rtval_free_temporary(value);
+    return truthy;
+}
+
+/* `i++', `++i', `i--' or `--i' steps an inline integer in place. */
+typedef struct {
+    identifier_t *counter;              /* NULL if the step is not counted. */
+    int delta;
+} counted_step_t;
+
+static counted_step_t counted_step_init(const ast_node_t *incdec, scope_t *scope)
+{
+    counted_step_t counted = { .counter = NULL };
+
+    if (incdec->type != NODE_EXPR_UNARY || NODE(incdec->right)->type != NODE_IDENTIFIER)
+        return counted;
+
+    const ast_node_t *name = NODE(incdec->right);
+
+    counted.delta = incdec->operator == OP_PRE_INCREMENT || incdec->operator == OP_POST_INCREMENT ? 1 : (
+        incdec->operator == OP_PRE_DECREMENT || incdec->operator == OP_POST_DECREMENT ? -1 : 0
+    );
+
+    if (counted.delta != 0 && name->depth != AST_UNRESOLVED)
+        counted.counter = scope_resolve_slot(scope, name->depth, name->slot);
+
+    return counted;
 }
 
-runtime_val_t eval_ctrl_for(ast_stmt node, scope_t *scope)
+/* False if the step has to be evaluated. */
+static inline bool counted_step(const counted_step_t *counted)
 {
-    scope_t newscope = scope_init(scope);
+    identifier_t *counter = counted->counter;
+
+    if (counter == NULL || !counter->declared || counter->is_const || rtval_tag(counter->value) != RTVAL_TAG_INT)
+        return false;
 
-    if (node.for_init != NULL)
-        eval(*node.for_init, &newscope);
+    int64_t value = rtval_int(counter->value) + counted->delta;
+
+    if (value < RTVAL_INT_MIN || value > RTVAL_INT_MAX)
+        return false;
+
+    counter->value = BLAZE_INT(value);
+    return true;
+}
 
-    runtime_val_t cond = node.for_cond == NULL ? BLAZE_TRUE : eval(*node.for_cond, &newscope);
+runtime_val_t eval_ctrl_while(const ast_node_t *node, scope_t *scope)
+{
+    const ast_node_t *cond = NODE(node->ctrl_cond), *body = NODE(node->ctrl_body);
+    counted_cond_t counted = counted_cond_init(cond, scope);
 
-    while (IS_TRUTHY(cond))
+    if (body->type != NODE_BLOCK)
     {
-        if (node.for_body->type == NODE_BLOCK)
-        {
-            loop_status_t status = eval_loop_block(*node.for_body, &newscope);
+        while (loop_cond(cond, &counted, scope))
+            rtval_free_temporary(eval(body, scope));
 
-            if (status == LS_CONT)
-            {
-                cond = eval(*node.for_cond, &newscope);
-                continue;
-            }
+        return BLAZE_NULL;
+    }
 
-            if (status == LS_BREAK)
-                break;
-        }
-        else
-            eval(*node.for_body, &newscope);
+    scope_t body_scope;
 
-        if (node.for_incdec != NULL)    
-            eval(*node.for_incdec, &newscope);
+    scope_init(&body_scope, scope, body->frame_size);
 
-        if (node.for_cond != NULL)
-            cond = eval(*node.for_cond, &newscope);
+    while (loop_cond(cond, &counted, scope))
+    {
+        if (eval_loop_body(body, &body_scope) == LS_BREAK)
+            break;
     }
 
-    scope_free(&newscope);
+    scope_free(&body_scope);
     return BLAZE_NULL;
 }
 
-loop_status_t eval_ctrl_loop_block(ast_stmt block, scope_t *scope, char *ctrl_loop_identifier, long long int iteration)
+runtime_val_t eval_ctrl_for(const ast_node_t *node, scope_t *scope)
 {
-    assert(block.type == NODE_BLOCK);
-    scope_t new_scope = scope_init(scope);
+    scope_t newscope;
 
-    scope_declare_identifier(&new_scope, ctrl_loop_identifier == NULL ? "iteration" : ctrl_loop_identifier, & (runtime_val_t) {
-        .type = VAL_NUMBER,
-        .intval = iteration
-    }, false);
+    scope_init(&newscope, scope, node->for_frame_size);
 
-    for (size_t i = 0; i < block.size; i++)
-    {
-        runtime_val_t value = eval(block.body[i], &new_scope);
+    if (node->for_init != AST_NONE)
+        rtval_free_temporary(eval(NODE(node->for_init), &newscope));
 
-        if (block.body[i].type == NODE_CTRL_IF)
-        {
-            if (value.type == VAL_NUMBER)
-            {
-                if (value.intval == LS_BREAK)
-                    new_scope.is_broken = true;
-                else if (value.intval == LS_CONT)
-                    new_scope.is_continued = true;
-            }
-        }
+    const ast_node_t *cond = node->for_cond == AST_NONE ? NULL : NODE(node->for_cond);
+    const ast_node_t *body = NODE(node->for_body);
+    const ast_node_t *incdec = node->for_incdec == AST_NONE ? NULL : NODE(node->for_incdec);
+    counted_cond_t counted = cond == NULL ? (counted_cond_t) { .counter = NULL } : counted_cond_init(cond, &newscope);
+    counted_step_t step = incdec == NULL ? (counted_step_t) { .counter = NULL } : counted_step_init(incdec, &newscope);
+    scope_t body_scope;
 
-        if (new_scope.is_broken)
-        {
-            break;
-        }
+    if (body->type == NODE_BLOCK)
+        scope_init(&body_scope, &newscope, body->frame_size);
 
-        if (new_scope.is_continued)
+    while (cond == NULL || loop_cond(cond, &counted, &newscope))
+    {
+        if (body->type == NODE_BLOCK)
         {
-            break;
+            if (eval_loop_body(body, &body_scope) == LS_BREAK)
+                break;
         }
-    }
+        else
+            rtval_free_temporary(eval(body, &newscope));
 
-    bool continued = new_scope.is_continued;
-    bool broken = new_scope.is_broken;
+        /* A continue still steps the loop. */
+        if (incdec != NULL && !counted_step(&step))
+            rtval_free_temporary(eval(incdec, &newscope));
+    }
 
-    scope_free(&new_scope);
+    if (body->type == NODE_BLOCK)
+        scope_free(&body_scope);
 
-    return continued ? LS_CONT : (
-        broken ? LS_BREAK : LS_RET
-    );;
+    scope_free(&newscope);
+    return BLAZE_NULL;
 }
 
-runtime_val_t eval_ctrl_loop(ast_stmt node, scope_t *scope)
+runtime_val_t eval_ctrl_loop(const ast_node_t *node, scope_t *scope)
 {
-    runtime_val_t cond = eval(*node.ctrl_cond, scope);
+    static atom_t *iteration_atom = NULL;
+
+    runtime_val_t cond = eval(NODE(node->ctrl_cond), scope);
 
-    if (cond.type != VAL_NUMBER && cond.type != VAL_BOOLEAN)
+    if (rtval_type(cond) != VAL_NUMBER && rtval_type(cond) != VAL_BOOLEAN)
         eval_error(true, "Non-numeric values cannot be used with loop statement");
 
-    if (cond.is_float)
+    if (rtval_is_float(cond))
         eval_error(true, "Float values cannot be used with loop statement");
 
-    long long int value = cond.intval;
+    long long int value = rtval_is_int(cond) ? rtval_int(cond) : rtval_bool(cond);
 
     if (value < 0)
         eval_error(true, "Negative numbers cannot be used with loop statement");
 
-    if (cond.type == VAL_BOOLEAN && cond.boolval == true)
-    {
-        long long int i = 0;
+    /* `loop true' runs until a break. */
+    bool forever = rtval_bool(cond);
+    const ast_node_t *body = NODE(node->ctrl_body);
 
-        while (true)
-        {
-            if (node.ctrl_body->type == NODE_BLOCK)
-            {
-                loop_status_t status = eval_ctrl_loop_block(*node.ctrl_body, scope, node.ctrl_loop_identifier, i);
-
-                if (status == LS_CONT)
-                {
-                    i++;
-                    continue;
-                }
-                else if (status == LS_BREAK)
-                {
-                    break;
-                }
-            }
-            else
-                eval(*node.ctrl_body, scope);
+    if (body->type != NODE_BLOCK)
+    {
+        for (long long int i = 0; forever || i < value; i++)
+            rtval_free_temporary(eval(body, scope));
 
-            i++;
-        }
+        return BLAZE_NULL;
     }
-    else
+
+    if (iteration_atom == NULL)
+        iteration_atom = atom_get("iteration");
+
+    atom_t *name = node->ctrl_loop_identifier == NULL ? iteration_atom : node->ctrl_loop_identifier;
+    scope_t body_scope;
+
+    scope_init(&body_scope, scope, body->frame_size);
+
+    for (long long int i = 0; forever || i < value; i++)
     {
-        for (long long int i = 0; i < value; i++)
-        {
-            if (node.ctrl_body->type == NODE_BLOCK)
-            {
-                loop_status_t status = eval_ctrl_loop_block(*node.ctrl_body, scope, node.ctrl_loop_identifier, i);
-
-                if (status == LS_CONT)
-                {
-                    i++;
-                    continue;
-                }
-                else if (status == LS_BREAK)
-                {
-                    break;
-                }
-            }
-            else
-                eval(*node.ctrl_body, scope);
-        }
+        /* The resolver gives the counter the first slot of the block. */
+        scope_declare_slot(&body_scope, 0, name, BLAZE_INT(i), false);
+
+        if (eval_loop_body(body, &body_scope) == LS_BREAK)
+            break;
     }
 
+    scope_free(&body_scope);
     return BLAZE_NULL;
 }
 
-runtime_val_t eval_call_expr(ast_stmt expr, scope_t *scope)
+/* Evaluates the arguments of a call onto the root stack, then the
+   callee. `*args' points at the arguments there; all of them stay
+   rooted until gc_pop_roots(expr->args.count + 1). */
+static runtime_val_t eval_call_operands(const ast_node_t *expr, scope_t *scope, runtime_val_t **args)
 {
-    vector_t vector = VEC_INIT;
-
-    for (size_t i = 0; i < expr.args.length; i++)
+    for (size_t i = 0; i < expr->args.count; i++)
     {
-        ast_stmt arg = VEC_GET(expr.args, i, ast_stmt);
-        runtime_val_t evaled = eval(arg, scope);
-        VEC_PUSH(vector, evaled, runtime_val_t);
+        const ast_node_t *arg = AST_LIST_NODE(ast, expr->args, i);
+        gc_push_root(eval(arg, scope));
     }
 
-    runtime_val_t callee = eval(*expr.callee, scope);
+    runtime_val_t callee = eval(NODE(expr->callee), scope);
+    gc_push_root(callee);
 
-    if (callee.type != VAL_NATIVE_FN && callee.type != VAL_USER_FN)
+    if (rtval_type(callee) != VAL_NATIVE_FN && rtval_type(callee) != VAL_USER_FN)
     {
-        eval_error(true, "'%s' is not a function", expr.callee->symbol);
+        eval_error(true, "'%s' is not a function", NODE(expr->callee)->symbol->name);
     }
 
+    *args = gc_roots(expr->args.count + 1);
+    return callee;
+}
+
+runtime_val_t eval_call_expr(const ast_node_t *expr, scope_t *scope)
+{
+    runtime_val_t *args;
+    runtime_val_t callee = eval_call_operands(expr, scope, &args);
     runtime_val_t val;
 
-    if (callee.type == VAL_NATIVE_FN)
-        val = callee.fn(vector, (struct scope *) scope);
+    if (rtval_type(callee) == VAL_NATIVE_FN)
+    {
+        val = rtval_native_fn(callee)(args, expr->args.count, (struct scope *) scope);
+        eval_free_arguments(args, expr->args.count, val);
+    }
     else
-        val = eval_user_function_call(callee, vector);
-        
+        val = eval_user_function_call(callee, args, expr->args.count);
+
+    gc_pop_roots(expr->args.count + 1);
     return val;
 }
 
-runtime_val_t eval_assignment(ast_stmt expr, scope_t *scope)
+runtime_val_t eval_assignment(const ast_node_t *expr, scope_t *scope)
 {
-    if (expr.assignee->type != NODE_IDENTIFIER)
+    if (NODE(expr->assignee)->type != NODE_IDENTIFIER)
         eval_error(true, "Cannot assign a value to a non-modifiable expression");
     
-    char *varname = expr.assignee->symbol;
+    atom_t *varname = NODE(expr->assignee)->symbol;
     
-    identifier_t *identifier = scope_resolve_identifier(scope, varname);
+    identifier_t *identifier = eval_lvalue(NODE(expr->assignee), scope);
 
     update_line(expr);
 
-    if (identifier == NULL)
-        eval_error(true, "Undefined identifier '%s'", varname);
-    else if (identifier->is_const)    
-        eval_error(true, "Cannot re-assign a value to constant '%s'", varname);
+    if (identifier->is_const)    
+        eval_error(true, "Cannot re-assign a value to constant '%s'", varname->name);
     
-    runtime_val_t val = eval(*expr.assignment_value, scope);    
-    runtime_val_t result = *scope_assign_identifier(scope, varname, &val);
-
-    return result;
+    runtime_val_t val = eval(NODE(expr->assignment_value), scope);    
+    return scope_assign_slot(identifier, val);
 }
 
-runtime_val_t eval_member_expr(ast_stmt expr, scope_t *scope)
+/* A plain `obj.name` remembers the last shape it saw and where the
+   property lives in it, so that same-shaped objects skip the lookup. */
+runtime_val_t eval_member_expr(ast_node_t *expr, scope_t *scope)
 {
-    runtime_val_t object = eval(*expr.object, scope);
+    return eval_member_value(expr, eval(NODE(expr->object), scope), scope);
+}
 
-    if (object.type != VAL_OBJECT)
+/* Looks the property up on an already evaluated object. */
+runtime_val_t eval_member_value(ast_node_t *expr, runtime_val_t object, scope_t *scope)
+{
+    if (rtval_type(object) != VAL_OBJECT)
         eval_error(true, "Cannot access members on a non-object value");
 
-    char *prop;
+    object_t *obj = rtval_object(object);
+
+    if (!expr->computed)
+    {
+        if (expr->ic_shape == obj->shape)
+        {
+            eval_ic_hits++;
+            return obj->slots[expr->ic_slot];
+        }
+
+        eval_ic_misses++;
+    }
+
+    atom_t *prop;
+    const char *prop_name;
 
-    if (expr.computed)
+    if (expr->computed)
     {
-        runtime_val_t propval = eval(*expr.prop, scope);
+        gc_push_root(object);
+        runtime_val_t propval = eval(NODE(expr->prop), scope);
+        gc_pop_roots(1);
 
-        if (propval.type != VAL_STRING)
+        if (rtval_type(propval) != VAL_STRING)
             eval_error(true, "Object properties must be string, but non string value found");
 
-        prop = propval.strval;
+        /* A name that was never interned cannot be a property key. */
+        prop_name = rtstring_data(rtval_string(propval));
+        prop = atom_find(prop_name, rtval_string(propval)->length);
     }
     else 
-        prop = expr.prop->symbol;
+    {
+        prop = NODE(expr->prop)->symbol;
+        prop_name = prop->name;
+    }
 
-    identifier_t *i = map_get(&object.properties, prop);
+    uint32_t slot = prop == NULL ? SHAPE_NOT_FOUND : shape_lookup(obj->shape, prop);
 
-    if (i == NULL)
-        eval_error(true, "Trying to access unknown property '%s'", prop);
+    if (slot == SHAPE_NOT_FOUND)
+        eval_error(true, "Trying to access unknown property '%s'", prop_name);
+
+    if (!expr->computed)
+    {
+        expr->ic_shape = obj->shape;
+        expr->ic_slot = slot;
+    }
 
-    return *i->value;
+    return obj->slots[slot];
 }
 
-runtime_val_t eval_numeric_binop(runtime_val_t left, runtime_val_t right, ast_operator_t operator)
+/* Both operands are integers (or booleans). Results stay integers unless
+   they overflow 64 bits or a division is inexact, and then become floats. */
+static runtime_val_t eval_integer_binop(int64_t left, int64_t right, ast_operator_t operator)
 {
-    long double result;
+    int64_t result;
 
-    if (operator == OP_PLUS)
-        result = NUM(left) + NUM(right);
-    else if (operator == OP_MINUS)
-        result = NUM(left) - NUM(right);
-    else if (operator == OP_TIMES)
-        result = NUM(left) * NUM(right);
-    else if (operator == OP_DIVIDE)
+    switch (operator)
     {
-        if (NUM(right) == 0)
-            eval_error(true, "Result of divison by zero is undefined");
+        case OP_PLUS:
+            if (__builtin_add_overflow(left, right, &result))
+                return BLAZE_FLOAT((double) left + (double) right);
 
-        result = NUM(left) / NUM(right); 
-    }
-    else if (operator == OP_MOD)
-    {
-        if (left.is_float || right.is_float)
-            eval_error(true, "modulus operator requires the operands to be int, float given");
+            return BLAZE_INT(result);
 
-        if (NUM(right) == 0)
-            eval_error(true, "Result of divison by zero is undefined");
-        
-        result = (long long int) NUM(left) % (long long int) NUM(right); 
-    }
-    else if (operator == OP_CMP_EQUALS)
-    {
-        return (runtime_val_t) {
-            .type = VAL_BOOLEAN,
-            .boolval = (NUM(left)) == (NUM(right))
-        };
-    }
-    else if (operator == OP_CMP_EQUALS_STRICT)
-    {
-        return (runtime_val_t) {
-            .type = VAL_BOOLEAN,
-            .boolval = left.type == right.type && (NUM(left)) == (NUM(right))
-        };
-    }
-    else if (operator == OP_CMP_LESS_THAN)
-    {
-        return (runtime_val_t) {
-            .type = VAL_BOOLEAN,
-            .boolval = (NUM(left)) < (NUM(right))
-        };
-    }
-    else if (operator == OP_CMP_LESS_THAN_EQUALS)
-    {
-        return (runtime_val_t) {
-            .type = VAL_BOOLEAN,
-            .boolval = (NUM(left)) <= (NUM(right))
-        };
+        case OP_MINUS:
+            if (__builtin_sub_overflow(left, right, &result))
+                return BLAZE_FLOAT((double) left - (double) right);
+
+            return BLAZE_INT(result);
+
+        case OP_TIMES:
+            if (__builtin_mul_overflow(left, right, &result))
+                return BLAZE_FLOAT((double) left * (double) right);
+
+            return BLAZE_INT(result);
+
+        case OP_DIVIDE:
+            if (right == 0)
+                eval_error(true, "Result of divison by zero is undefined");
+
+            /* INT64_MIN / -1 is the one quotient that overflows. */
+            if (right == -1 && left == INT64_MIN)
+                return BLAZE_FLOAT(-(double) left);
+
+            if (left % right != 0)
+                return BLAZE_FLOAT((double) left / (double) right);
+
+            return BLAZE_INT(left / right);
+
+        case OP_MOD:
+            if (right == 0)
+                eval_error(true, "Result of divison by zero is undefined");
+
+            return BLAZE_INT(right == -1 ? 0 : left % right);
+
+        case OP_CMP_EQUALS:
+            return BLAZE_BOOL(left == right);
+
+        case OP_CMP_LESS_THAN:
+            return BLAZE_BOOL(left < right);
+
+        case OP_CMP_LESS_THAN_EQUALS:
+            return BLAZE_BOOL(left <= right);
+
+        case OP_CMP_GREATER_THAN:
+            return BLAZE_BOOL(left > right);
+
+        case OP_CMP_GREATER_THAN_EQUALS:
+            return BLAZE_BOOL(left >= right);
+
+        default:
+            utils_error(true, "invalid binary operator: %d", operator);
     }
-    else if (operator == OP_CMP_GREATER_THAN)
+
+    return BLAZE_NULL;
+}
+
+runtime_val_t eval_numeric_binop(runtime_val_t left, runtime_val_t right, ast_operator_t operator)
+{
+    if (operator == OP_CMP_EQUALS_STRICT)
     {
-        return (runtime_val_t) {
-            .type = VAL_BOOLEAN,
-            .boolval = (NUM(left)) > (NUM(right))
-        };
+        return BLAZE_BOOL(rtval_type(left) == rtval_type(right) && (NUM(left)) == (NUM(right)));
     }
-    else if (operator == OP_CMP_GREATER_THAN_EQUALS)
+
+    if (!rtval_is_float(left) && !rtval_is_float(right))
+        return eval_integer_binop(to_integer(left), to_integer(right), operator);
+
+    double lhs = NUM(left), rhs = NUM(right);
+
+    switch (operator)
     {
-        return (runtime_val_t) {
-            .type = VAL_BOOLEAN,
-            .boolval = (NUM(left)) >= (NUM(right))
-        };
-    }
-    else
-        utils_error(true, "invalid binary operator: %d", operator);
-    
-    runtime_val_t val = {
-        .type = VAL_NUMBER,
-        .literal = false
-    };
+        case OP_PLUS:
+            return BLAZE_FLOAT(lhs + rhs);
 
-    if (!left.is_float && !right.is_float)
-        val.is_float = is_float(result);
-    else 
-        val.is_float = true;
+        case OP_MINUS:
+            return BLAZE_FLOAT(lhs - rhs);
 
-    if (val.is_float)
-        val.floatval = result;
-    else 
-        val.intval = (long long int) result;
+        case OP_TIMES:
+            return BLAZE_FLOAT(lhs * rhs);
 
-    return val;
+        case OP_DIVIDE:
+            if (rhs == 0)
+                eval_error(true, "Result of divison by zero is undefined");
+
+            return BLAZE_FLOAT(lhs / rhs);
+
+        case OP_MOD:
+            eval_error(true, "modulus operator requires the operands to be int, float given");
+            break;
+
+        case OP_CMP_EQUALS:
+            return BLAZE_BOOL(lhs == rhs);
+
+        case OP_CMP_LESS_THAN:
+            return BLAZE_BOOL(lhs < rhs);
+
+        case OP_CMP_LESS_THAN_EQUALS:
+            return BLAZE_BOOL(lhs <= rhs);
+
+        case OP_CMP_GREATER_THAN:
+            return BLAZE_BOOL(lhs > rhs);
+
+        case OP_CMP_GREATER_THAN_EQUALS:
+            return BLAZE_BOOL(lhs >= rhs);
+
+        default:
+            utils_error(true, "invalid binary operator: %d", operator);
+    }
+
+    return BLAZE_NULL;
 }
 
 bool runtime_val_to_bool(runtime_val_t *val)
 {
-    return val->type != VAL_NUMBER && val->type != VAL_BOOLEAN && val->type != VAL_NULL ? true : (
-        val->type == VAL_NUMBER || val->type == VAL_BOOLEAN ? (NUM((*val))) == 1 : (
+    runtime_valtype_t type = rtval_type(*val);
+
+    return type != VAL_NUMBER && type != VAL_BOOLEAN && type != VAL_NULL ? true : (
+        type == VAL_NUMBER || type == VAL_BOOLEAN ? (NUM((*val))) == 1 : (
             false
         )
     );
 }
 
-#if !defined(asprintf)
-int asprintf(char **ptr, const char *fmt, ...) __attribute__((format(printf, 2, 3))); 
-#endif
-
 static bool cmp_str_num(const runtime_val_t *str, const runtime_val_t *num)
 {
-    if (strstr(str->strval, ".") == NULL)
-        return atoll(str->strval) == (num->is_float ? ((long long int) num->floatval) : num->intval);
+    const char *strval = rtstring_data(rtval_string(*str));
+
+    if (strstr(strval, ".") == NULL)
+        return atoll(strval) == (rtval_is_float(*num) ? ((long long int) rtval_float(*num)) : rtval_int(*num));
     else
-        return strtold(str->strval, NULL) == (num->is_float ? num->floatval : ((long double) num->intval));
+        return strtod(strval, NULL) == NUM(*num);
 }
 
-runtime_val_t eval_string_binop(runtime_val_t left, runtime_val_t right, ast_operator_t operator)
+static runtime_val_t eval_string_compare(runtime_val_t left, runtime_val_t right, ast_operator_t operator)
 {
-    assert(left.type == VAL_STRING || right.type == VAL_STRING);
+    runtime_valtype_t left_type = rtval_type(left);
+    runtime_valtype_t right_type = rtval_type(right);
 
-    if (operator == OP_PLUS)
+    if (operator == OP_CMP_EQUALS)
     {
-        if (left.type == VAL_STRING && right.type == VAL_STRING) 
-        {
-            size_t leftlen = strlen(left.strval);
-            size_t rightlen = strlen(right.strval);
-            size_t len = leftlen + rightlen;
+        if ((left_type != VAL_NULL &&
+            left_type != VAL_BOOLEAN &&
+            left_type != VAL_NUMBER &&
+            left_type != VAL_STRING) || 
+            (right_type != VAL_NULL &&
+            right_type != VAL_BOOLEAN &&
+            right_type != VAL_NUMBER &&
+            right_type != VAL_STRING))
+            return BLAZE_FALSE;
 
-            runtime_val_t str = {
-                .type = VAL_STRING,
-                .strval = xmalloc(len + 2)
-            };
+        if ((left_type == VAL_NULL && right_type != VAL_NULL) ||
+            (left_type != VAL_NULL && right_type == VAL_NULL))
+            return BLAZE_FALSE;
 
-            strncpy(str.strval, left.strval, leftlen + 1);
-            strncat(str.strval, right.strval, rightlen + 1);
+        if (left_type == VAL_STRING && right_type == VAL_NUMBER)
+            return BLAZE_BOOL(cmp_str_num(&left, &right));
 
-            return str;
-        }
-        else if ((left.type == VAL_STRING && right.type == VAL_NUMBER) || (left.type == VAL_NUMBER && right.type == VAL_STRING))
-        {
-            runtime_val_t str = {
-                .type = VAL_STRING,
-                .strval = NULL
-            };
+        if (right_type == VAL_STRING && left_type == VAL_NUMBER)
+            return BLAZE_BOOL(cmp_str_num(&right, &left));
 
-            string_t fmt = _str(""); 
+        return BLAZE_BOOL(rtstring_equals(rtval_string(left), rtval_string(right)));
+    }
+    else if (operator == OP_CMP_EQUALS_STRICT)
+    {
+        return BLAZE_BOOL(left_type == VAL_STRING && right_type == VAL_STRING && rtstring_equals(rtval_string(left), rtval_string(right)));
+    }
 
-            if (left.type == VAL_STRING)
-                concat(fmt, "%s");
+    return BLAZE_NULL;
+}
 
-            if (left.type == VAL_NUMBER)
-            {
-                concat(fmt, left.is_float ? "%Lg" : "%lld");
-            }
+runtime_val_t eval_string_binop(runtime_val_t left, runtime_val_t right, ast_operator_t operator)
+{
+    runtime_valtype_t left_type = rtval_type(left);
+    runtime_valtype_t right_type = rtval_type(right);
 
-            if (right.type == VAL_STRING)
-                concat(fmt, "%s");
+    assert(left_type == VAL_STRING || right_type == VAL_STRING);
 
-            if (right.type == VAL_NUMBER)
-            {
-                concat(fmt, right.is_float ? "%Lg" : "%lld");
-            }
+    if (operator == OP_PLUS)
+    {
+        if (left_type == VAL_STRING && right_type == VAL_STRING) 
+        {
+            return BLAZE_STRING(rtstring_concat(rtval_string(left), rtval_string(right)));
+        }
+        else if ((left_type == VAL_STRING && right_type == VAL_NUMBER) || (left_type == VAL_NUMBER && right_type == VAL_STRING))
+        {
+            char number[32];
+            runtime_val_t numval = left_type == VAL_NUMBER ? left : right;
+            rtstring_t *string = rtval_string(left_type == VAL_STRING ? left : right);
+            size_t length;
 
-            if (left.type == VAL_NUMBER)
-            {
-                if (left.is_float)
-                    asprintf(&str.strval, fmt, left.floatval, right.strval); 
-                else 
-                    asprintf(&str.strval, fmt, left.intval, right.strval); 
-            }
-            else if (right.type == VAL_NUMBER)
-            {
-                if (right.is_float)
-                    asprintf(&str.strval, fmt, left.strval, right.floatval); 
-                else 
-                    asprintf(&str.strval, fmt, left.strval, right.intval); 
-            }
+            if (rtval_is_float(numval))
+                length = snprintf(number, sizeof number, "%g", rtval_float(numval));
+            else
+                length = snprintf(number, sizeof number, "%lld", (long long int) rtval_int(numval));
 
-            strfree(fmt);
+            rtstring_t *number_string = rtstring_new(number, length);
 
-            return str;
+            if (left_type == VAL_NUMBER)
+                return BLAZE_STRING(rtstring_concat(number_string, string));
+
+            return BLAZE_STRING(rtstring_concat(string, number_string));
         }
         else 
             eval_error(true, "Invalid binary operation");
     }
-    else if (operator == OP_CMP_EQUALS)
-    {
-        if ((left.type != VAL_NULL &&
-            left.type != VAL_BOOLEAN &&
-            left.type != VAL_NUMBER &&
-            left.type != VAL_STRING) || 
-            (right.type != VAL_NULL &&
-            right.type != VAL_BOOLEAN &&
-            right.type != VAL_NUMBER &&
-            right.type != VAL_STRING))
-            return BLAZE_FALSE;
 
-        if ((left.type == VAL_NULL && right.type != VAL_NULL) ||
-            (left.type != VAL_NULL && right.type == VAL_NULL))
-            return BLAZE_FALSE;
+    /* Comparisons only read the operands: temporaries die here. */
+    runtime_val_t result = eval_string_compare(left, right, operator);
 
-        if (left.type == VAL_STRING && right.type == VAL_NUMBER)
-            return (runtime_val_t) {
-                .type = VAL_BOOLEAN,
-                .boolval = cmp_str_num(&left, &right)
-            };
-
-        if (right.type == VAL_STRING && left.type == VAL_NUMBER)
-            return (runtime_val_t) {
-                .type = VAL_BOOLEAN,
-                .boolval = cmp_str_num(&right, &left)
-            };
-
-        return (runtime_val_t) {
-            .type = VAL_BOOLEAN,
-            .boolval = strcmp(left.strval, right.strval) == 0
-        };
-    }
-    else if (operator == OP_CMP_EQUALS_STRICT)
-    {
-        return (runtime_val_t) {
-            .type = VAL_BOOLEAN,
-            .boolval = left.type == VAL_STRING && right.type == VAL_STRING && strcmp(left.strval, right.strval) == 0
-        };
-    }
+    rtval_free_temporary(left);
+    rtval_free_temporary(right);
+    return result;
+}
 
-    return BLAZE_NULL;
+/* `&&' and `||' evaluate their left operand first, and the right one
+   only when the left one does not decide the result. */
+static runtime_val_t eval_logical(const ast_node_t *binop, scope_t *scope)
+{
+    bool is_or = binop->operator == OP_LOGICAL_OR;
+    runtime_val_t left = eval(NODE(binop->left), scope);
+    bool decided = runtime_val_to_bool(&left) == is_or;
+
+    rtval_free_temporary(left);
+
+    if (decided)
+        return BLAZE_BOOL(is_or);
+
+    runtime_val_t right = eval(NODE(binop->right), scope);
+    bool result = runtime_val_to_bool(&right);
+
+    rtval_free_temporary(right);
+    return BLAZE_BOOL(result);
 }
 
-runtime_val_t eval_binop(ast_stmt binop, scope_t *scope)
+runtime_val_t eval_binop(const ast_node_t *binop, scope_t *scope)
 {
-    if (binop.type != NODE_EXPR_BINARY)
+    if (binop->type != NODE_EXPR_BINARY)
     {
         utils_error(true, "invalid binop found");
     }
 
     update_line(binop);
 
-    runtime_val_t right = eval(*binop.right, scope);
-    runtime_val_t left = eval(*binop.left, scope);
+    if (binop->operator == OP_LOGICAL_AND || binop->operator == OP_LOGICAL_OR)
+        return eval_logical(binop, scope);
+
+    runtime_val_t right = eval(NODE(binop->right), scope);
+
+    gc_push_root(right);
+    runtime_val_t left = eval(NODE(binop->left), scope);
+    gc_pop_roots(1);
+
+    return eval_binop_values(binop, left, right);
+}
+
+/* Applies a binary operator to evaluated operands. */
+runtime_val_t eval_binop_values(const ast_node_t *binop, runtime_val_t left, runtime_val_t right)
+{
+    runtime_valtype_t left_type = rtval_type(left);
+    runtime_valtype_t right_type = rtval_type(right);
 
-    if (left.type == VAL_NULL && right.type == VAL_NULL) 
+    if (left_type == VAL_NULL && right_type == VAL_NULL) 
     {
-        if (binop.operator == OP_CMP_EQUALS_STRICT || binop.operator == OP_CMP_EQUALS)
+        if (binop->operator == OP_CMP_EQUALS_STRICT || binop->operator == OP_CMP_EQUALS)
             return BLAZE_TRUE;
 
         return BLAZE_FALSE;
     }
 
-    if (binop.operator == OP_LOGICAL_AND || binop.operator == OP_LOGICAL_OR)
+    if (binop->operator == OP_LOGICAL_AND || binop->operator == OP_LOGICAL_OR)
     {
         bool leftbool = runtime_val_to_bool(&left);
         bool rightbool = runtime_val_to_bool(&right);
 
-        return (runtime_val_t) {
-            .type = VAL_BOOLEAN, 
-            .boolval = binop.operator == OP_LOGICAL_OR ? (leftbool || rightbool) : (leftbool && rightbool)
-        };
+        rtval_free_temporary(left);
+        rtval_free_temporary(right);
+        return BLAZE_BOOL(binop->operator == OP_LOGICAL_OR ? (leftbool || rightbool) : (leftbool && rightbool));
     } 
-    else if ((right.type == VAL_NUMBER && left.type == VAL_NUMBER) ||
-        (right.type == VAL_BOOLEAN || left.type == VAL_BOOLEAN) ||
-        ((right.type == VAL_BOOLEAN || left.type == VAL_BOOLEAN) && 
-        (right.type == VAL_NUMBER || left.type == VAL_NUMBER)))
+    else if ((right_type == VAL_NUMBER && left_type == VAL_NUMBER) ||
+        (right_type == VAL_BOOLEAN || left_type == VAL_BOOLEAN) ||
+        ((right_type == VAL_BOOLEAN || left_type == VAL_BOOLEAN) && 
+        (right_type == VAL_NUMBER || left_type == VAL_NUMBER)))
     {
         update_line(binop);
-        return eval_numeric_binop(left, right, binop.operator);
+
+        runtime_val_t result = eval_numeric_binop(left, right, binop->operator);
+
+        /* A boolean operand brings strings here too. */
+        rtval_free_temporary(left);
+        rtval_free_temporary(right);
+        return result;
     }
-    else if (right.type == VAL_STRING || left.type == VAL_STRING)
+    else if (right_type == VAL_STRING || left_type == VAL_STRING)
     {
-        return eval_string_binop(left, right, binop.operator);
+        return eval_string_binop(left, right, binop->operator);
     }
 
-    printf("%d %d\n", left.type, right.type);
+    printf("%d %d\n", left_type, right_type);
+
+    return BLAZE_NULL;
+}
+
+/* Adds a small integer to a number, keeping it an integer if it was one. */
+static runtime_val_t number_add(runtime_val_t number, int delta)
+{
+    if (rtval_is_float(number))
+        return BLAZE_FLOAT(rtval_float(number) + delta);
 
-    return (runtime_val_t) {
-        .type = VAL_NULL,
-        .literal = false
-    };
+    return eval_integer_binop(rtval_int(number), delta, OP_PLUS);
 }
 
-runtime_val_t eval_unary_expr(ast_stmt expr, scope_t *scope)
+runtime_val_t eval_unary_expr(const ast_node_t *expr, scope_t *scope)
 {
-    if (expr.type != NODE_EXPR_UNARY)
+    if (expr->type != NODE_EXPR_UNARY)
     {
         utils_error(true, "invalid unary operation found");
     }
 
     update_line(expr);
 
-    runtime_val_t operand = eval(*expr.right, scope);
+    bool is_increment = expr->operator == OP_PRE_INCREMENT || expr->operator == OP_POST_INCREMENT;
+    bool is_decrement = expr->operator == OP_PRE_DECREMENT || expr->operator == OP_POST_DECREMENT;
+
+    /* The variable is looked up once and updated in place. */
+    if (is_increment || is_decrement)
+    {
+        if (NODE(expr->right)->type != NODE_IDENTIFIER)
+            eval_error(true, "Expression must a modifiable lvalue");
+
+        identifier_t *identifier = eval_lvalue(NODE(expr->right), scope);
+        runtime_val_t old = identifier->value;
 
-    if (expr.operator == OP_LOGICAL_NOT) 
+        if (rtval_type(old) != VAL_NUMBER)
+            eval_error(true, "Cannot apply unary plus or minus operators on a non-number value");
+
+        runtime_val_t updated = scope_assign_slot(identifier, number_add(old, is_increment ? 1 : -1));
+
+        return expr->operator == OP_PRE_INCREMENT || expr->operator == OP_PRE_DECREMENT ? updated : old;
+    }
+
+    runtime_val_t operand = eval(NODE(expr->right), scope);
+    runtime_valtype_t type = rtval_type(operand);
+
+    if (expr->operator == OP_LOGICAL_NOT) 
     {
-        if (operand.type == VAL_NUMBER || operand.type == VAL_NULL || operand.type == VAL_BOOLEAN)
+        rtval_free_temporary(operand);
+
+        if (type == VAL_NUMBER || type == VAL_NULL || type == VAL_BOOLEAN)
         {
-            if (operand.type == VAL_NULL)
-                return (runtime_val_t) {
-                        .type = VAL_BOOLEAN, 
-                        .boolval = true
-                };
-
-            return (runtime_val_t) { 
-                .type = VAL_BOOLEAN,
-                .boolval = !(NUM(operand))
-            };
+            if (type == VAL_NULL)
+                return BLAZE_TRUE;
+
+            return BLAZE_BOOL(!(NUM(operand)));
         }
         else
         {
-            return (runtime_val_t) {
-                .type = VAL_BOOLEAN,
-                .boolval = false
-            };
+            return BLAZE_FALSE;
         }
     }
 
-    if (operand.type != VAL_NUMBER)
+    if (type != VAL_NUMBER)
         eval_error(true, "Cannot apply unary plus or minus operators on a non-number value");
 
-    runtime_val_t ret = {
-        .type = VAL_NUMBER,
-        .literal = false,
-        .is_float = operand.is_float,
-    };
-
-    if (expr.operator == OP_PLUS || expr.operator == OP_MINUS)
-    {
-        if (operand.is_float)
-            ret.floatval = expr.operator == OP_PLUS ? +operand.floatval : -operand.floatval;
-        else 
-            ret.intval = expr.operator == OP_PLUS ? +operand.intval : -operand.intval;
-    }
-    else if (expr.operator == OP_PRE_INCREMENT || expr.operator == OP_PRE_DECREMENT)
-    {
-        if (expr.right->type != NODE_IDENTIFIER)
-            eval_error(true, "Expression must a modifiable lvalue");
-            
-        if (operand.is_float)
-            ret.floatval = expr.operator == OP_PRE_INCREMENT ? ++operand.floatval : --operand.floatval;
-        else 
-            ret.intval = expr.operator == OP_PRE_INCREMENT ? ++operand.intval : --operand.intval;
+    runtime_val_t ret = operand;
 
-        scope_assign_identifier(scope, expr.right->symbol, &ret);        
-    }
-    else if (expr.operator == OP_POST_INCREMENT || expr.operator == OP_POST_DECREMENT)
+    if (expr->operator == OP_MINUS)
     {
-        if (expr.right->type != NODE_IDENTIFIER)
-            eval_error(true, "Expression must a modifiable lvalue");
-        
-        runtime_val_t store = ret;
-
-        if (operand.is_float)
-            ret.floatval = operand.floatval;
-        else
-            ret.intval = operand.intval;
-
-        if (operand.is_float)
-            store.floatval = expr.operator == OP_POST_INCREMENT ? operand.floatval + 1 : operand.floatval - 1;
+        if (rtval_is_float(operand))
+            ret = BLAZE_FLOAT(-rtval_float(operand));
         else 
-            store.intval = expr.operator == OP_POST_INCREMENT ? operand.intval + 1 : operand.intval - 1;
-
-        scope_assign_identifier(scope, expr.right->symbol, &store);        
+            ret = eval_integer_binop(0, rtval_int(operand), OP_MINUS);
     }
 
     return ret;
 }
 
-runtime_val_t eval_program(ast_stmt prog, scope_t *scope)
+runtime_val_t eval_program(const ast_node_t *prog, scope_t *scope)
 {
-    runtime_val_t last_eval = { .type = VAL_NULL };
+    runtime_val_t last_eval = BLAZE_NULL;
+
+    /* The program's globals follow the builtins. */
+    scope_reserve_slots(scope, prog->frame_size);
 
-    for (size_t i = 0; i < prog.size; i++)
+    for (size_t i = 0; i < prog->body.count; i++)
     {
-        last_eval = eval(prog.body[i], scope);
+        rtval_free_temporary(last_eval);
+        last_eval = eval(AST_LIST_NODE(ast, prog->body, i), scope);
     }
 
     return last_eval;
 }
 
-runtime_val_t eval_var_decl(ast_stmt decl, scope_t *scope)
+runtime_val_t eval_var_decl(const ast_node_t *decl, scope_t *scope)
 {
 #ifndef _NODEBUG
 #ifdef _DEBUG
-    printf("decl.has_val: %s\n", decl.identifier);
+    printf("decl.has_val: %s\n", decl->identifier->name);
 #endif
 #endif
 
-    runtime_val_t *value_heap = xmalloc(sizeof (runtime_val_t));
-
-    if (decl.has_val)
-    {
-        runtime_val_t value = eval(*(decl.varval), scope);
-        memcpy(value_heap, &value, sizeof value);
-    }
-    else 
-        value_heap->type = VAL_NULL;
+    runtime_val_t value = decl->varval == AST_NONE ? BLAZE_NULL : eval(NODE(decl->varval), scope);
 
-    return *(scope_declare_identifier(scope, decl.identifier, value_heap, decl.is_const)->value);
+    return scope_declare_slot(scope, decl->var_slot, decl->identifier, value, decl->is_const)->value;
 }
 
-runtime_val_t eval_identifier(ast_stmt identifier, scope_t *scope)
+runtime_val_t eval_identifier(const ast_node_t *identifier, scope_t *scope)
 {
-    identifier_t *identifier_ = scope_resolve_identifier(scope, identifier.symbol);
-    return *identifier_->value;
+    return eval_lvalue(identifier, scope)->value;
 }
 
-runtime_val_t eval(ast_stmt astnode, scope_t *scope)
+runtime_val_t eval(const ast_node_t *astnode, scope_t *scope)
 {
     runtime_val_t val;
     update_line(astnode);
 
-    switch (astnode.type)
+    switch (astnode->type)
     {
         case NODE_NUMERIC_LITERAL:
-            val.type = VAL_NUMBER;
-            // val.is_float = is_float(astnode.value);
-            val.is_float = astnode.is_float;
-
-            if (val.is_float)
-                val.floatval = astnode.value;
+            if (astnode->is_float)
+                val = BLAZE_FLOAT(astnode->floatval);
             else
-                val.intval = astnode.value;
-
-            val.literal = true;
+                val = BLAZE_INT(astnode->intval);
         break;
 
         case NODE_STRING:
-            val.type = VAL_STRING;
-            val.strval = astnode.strval;
-            val.literal = true;
+            /* Each literal is turned into a pinned string once. */
+            if (astnode->string == NULL)
+                ((ast_node_t *) astnode)->string = rtstring_pin(AST_STRING(ast, astnode), astnode->str_length);
+
+            val = BLAZE_STRING(astnode->string);
         break;
 
         case NODE_CTRL_BREAK:
         case NODE_CTRL_CONTINUE:
-            if (astnode.type == NODE_CTRL_BREAK)
+            if (astnode->type == NODE_CTRL_BREAK)
                 scope->is_broken = true;
             else
                 scope->is_continued = true;
 
-            return (runtime_val_t) {
-                .type = VAL_NULL
-            };
+            return BLAZE_NULL;
 
         case NODE_BLOCK:
             return eval_block(astnode, scope);
@@ -1084,11 +1225,12 @@ runtime_val_t eval(ast_stmt astnode, scope_t *scope)
         case NODE_CTRL_LOOP:
             return eval_ctrl_loop(astnode, scope);
 
+        /* The evaluator owns the caches in these nodes. */
         case NODE_EXPR_MEMBER_ACCESS:
-            return eval_member_expr(astnode, scope);
+            return eval_member_expr((ast_node_t *) astnode, scope);
 
         case NODE_OBJECT_LITERAL:
-            return eval_object_expr(astnode, scope);
+            return eval_object_expr((ast_node_t *) astnode, scope);
 
         case NODE_PROGRAM:
             return eval_program(astnode, scope);
@@ -1113,3 +1255,14 @@ runtime_val_t eval(ast_stmt astnode, scope_t *scope)
 
     return val;
 }
+
+void eval_set_tree(const ast_t *tree)
+{
+    ast = tree;
+}
+
+runtime_val_t eval_ast(const ast_t *tree, scope_t *scope)
+{
+    ast = tree;
+    return eval(AST_NODE(tree, tree->root), scope);
+}
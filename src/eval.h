@@ -5,7 +5,36 @@
 #include "scope.h"
 #include "runtimevalues.h"
 
-runtime_val_t eval(ast_stmt astnode, scope_t *scope);
+/* Member access inline cache counters. */
+extern size_t eval_ic_hits;
+extern size_t eval_ic_misses;
+
+/* What an if block or a loop body ended with. An if statement whose
+   body is a block evaluates to one of these. */
+typedef enum {
+    LS_RET,
+    LS_BREAK,
+    LS_CONT
+} loop_status_t;
+
+/* Line reported by eval_error(). */
+extern size_t eval_line;
+
+runtime_val_t eval_ast(const ast_t *ast, scope_t *scope);
+runtime_val_t eval(const ast_node_t *astnode, scope_t *scope);
+void eval_set_tree(const ast_t *tree);
 void eval_error(bool should_exit, const char *fmt, ...);
+void eval_free_arguments(runtime_val_t *args, size_t argc, runtime_val_t ret);
+
+/* How `&&', `||' and their bytecode see a value. */
+bool runtime_val_to_bool(runtime_val_t *val);
+
+/* Pieces of the evaluator shared with the closure engine (lower.c). */
+runtime_val_t eval_binop_values(const ast_node_t *binop, runtime_val_t left, runtime_val_t right);
+runtime_val_t eval_member_value(ast_node_t *expr, runtime_val_t object, scope_t *scope);
+runtime_val_t eval_user_function_call(runtime_val_t callee, runtime_val_t *args, size_t argc);
+void eval_call_enter(user_fn_t *fn, runtime_val_t *args, size_t argc, scope_t *frame);
+void eval_tail_call(user_fn_t *fn, runtime_val_t *args, size_t argc, scope_t *frame);
+runtime_val_t eval_call_leave(scope_t *frame, runtime_val_t ret);
 
 #endif
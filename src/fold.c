@@ -0,0 +1,657 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fold.h"
+#include "ast.h"
+#include "atom.h"
+#include "callstack.h"
+#include "eval.h"
+#include "gc.h"
+#include "rtstring.h"
+#include "runtimevalues.h"
+#include "xmalloc.h"
+
+/* Compile-time mirror of the runtime scopes, by name. A scope knows up
+   front every name declared directly in it, so that a use is never
+   bound to an outer constant that a later declaration shadows. */
+typedef struct {
+    atom_t *name;
+    bool known;                                     /* A constant whose value is known. */
+    ast_ref_t literal;                              /* Literal holding a number or string. */
+    runtime_val_t value;                            /* Or the value, for booleans and null. */
+} fold_binding_t;
+
+typedef struct fold_scope {
+    struct fold_scope *parent;
+    fold_binding_t *bindings;
+    uint32_t count;
+    uint32_t capacity;
+} fold_scope_t;
+
+static ast_t *ast = NULL;
+static fold_scope_t *root = NULL;
+static atom_t *null_atom, *true_atom, *false_atom, *iteration_atom;
+
+#define NODE(ref) AST_NODE(ast, (ref))
+
+static ast_ref_t fold_stmt(ast_ref_t ref, fold_scope_t *scope, bool direct);
+static bool fold_expr(ast_ref_t ref, fold_scope_t *scope, runtime_val_t *value);
+
+static fold_binding_t *fold_find(fold_scope_t *scope, atom_t *name)
+{
+    for (uint32_t i = 0; i < scope->count; i++)
+    {
+        if (scope->bindings[i].name == name)
+            return &scope->bindings[i];
+    }
+
+    return NULL;
+}
+
+static fold_binding_t *fold_lookup(fold_scope_t *scope, atom_t *name)
+{
+    for (; scope != NULL; scope = scope->parent)
+    {
+        fold_binding_t *binding = fold_find(scope, name);
+
+        if (binding != NULL)
+            return binding;
+    }
+
+    return NULL;
+}
+
+static fold_binding_t *fold_declare(fold_scope_t *scope, atom_t *name)
+{
+    fold_binding_t *binding = fold_find(scope, name);
+
+    if (binding != NULL)
+        return binding;
+
+    if (scope->count == scope->capacity)
+    {
+        scope->capacity = scope->capacity == 0 ? 8 : scope->capacity * 2;
+        scope->bindings = xrealloc(scope->bindings, sizeof (fold_binding_t) * scope->capacity);
+    }
+
+    binding = &scope->bindings[scope->count++];
+    *binding = (fold_binding_t) { .name = name, .known = false };
+
+    return binding;
+}
+
+/* Declarations that land in a scope: the statement itself, or the body
+   of a control statement that is not a block. */
+static void fold_prescan(ast_ref_t ref, fold_scope_t *scope)
+{
+    if (ref == AST_NONE)
+        return;
+
+    const ast_node_t *node = NODE(ref);
+
+    switch (node->type)
+    {
+        case NODE_DECL_VAR:
+            fold_declare(scope, node->identifier);
+            break;
+
+        case NODE_DECL_FUNCTION:
+            fold_declare(scope, node->fn_name);
+            break;
+
+        case NODE_CTRL_IF:
+            if (NODE(node->ctrl_body)->type != NODE_BLOCK)
+                fold_prescan(node->ctrl_body, scope);
+
+            if (node->else_body != AST_NONE && NODE(node->else_body)->type != NODE_BLOCK)
+                fold_prescan(node->else_body, scope);
+            break;
+
+        case NODE_CTRL_WHILE:
+        case NODE_CTRL_LOOP:
+            if (NODE(node->ctrl_body)->type != NODE_BLOCK)
+                fold_prescan(node->ctrl_body, scope);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static fold_scope_t *fold_scope_new(fold_scope_t *parent, ast_list_t list)
+{
+    fold_scope_t *scope = xcalloc(1, sizeof (fold_scope_t));
+
+    scope->parent = parent;
+
+    for (uint32_t i = 0; i < list.count; i++)
+        fold_prescan(ast->refs[list.start + i], scope);
+
+    return scope;
+}
+
+static void fold_scope_free(fold_scope_t *scope)
+{
+    free(scope->bindings);
+    free(scope);
+}
+
+/* The value of a literal node. Strings are new and hold a reference. */
+static runtime_val_t fold_literal_value(const ast_node_t *node)
+{
+    if (node->type == NODE_STRING)
+    {
+        rtstring_t *string = rtstring_new(AST_STRING(ast, node), node->str_length);
+
+        rtstring_retain(string);
+        return BLAZE_STRING(string);
+    }
+
+    return node->is_float ? BLAZE_FLOAT(node->floatval) : BLAZE_INT(node->intval);
+}
+
+static bool fold_is_literal(const ast_node_t *node)
+{
+    return node->type == NODE_NUMERIC_LITERAL || node->type == NODE_STRING;
+}
+
+/* Rewrites the node at `ref' into a literal holding `value'. Booleans
+   and null become the builtin constants, unless they are shadowed. */
+static void fold_materialize(ast_ref_t ref, runtime_val_t value, fold_scope_t *scope)
+{
+    ast_node_t *node = NODE(ref);
+    uint32_t line = node->line;
+
+    switch (rtval_type(value))
+    {
+        case VAL_NUMBER:
+            if (rtval_is_float(value))
+                *node = (ast_node_t) { .type = NODE_NUMERIC_LITERAL, .line = line, .floatval = rtval_float(value), .is_float = true };
+            else
+                *node = (ast_node_t) { .type = NODE_NUMERIC_LITERAL, .line = line, .intval = rtval_int(value) };
+            break;
+
+        case VAL_STRING:
+        {
+            rtstring_t *string = rtval_string(value);
+            uint32_t offset = ast_string_new(ast, rtstring_data(string), string->length);
+
+            *node = (ast_node_t) { .type = NODE_STRING, .line = line, .str_offset = offset, .str_length = string->length };
+        }
+        break;
+
+        case VAL_BOOLEAN:
+        case VAL_NULL:
+        {
+            atom_t *name = rtval_type(value) == VAL_NULL ? null_atom : (rtval_bool(value) ? true_atom : false_atom);
+
+            if (fold_lookup(scope, name) == fold_find(root, name))
+                *node = (ast_node_t) { .type = NODE_IDENTIFIER, .line = line, .symbol = name };
+        }
+        break;
+
+        default:
+            break;
+    }
+}
+
+/* Whether eval_binop_values() gives a result for these operands without
+   failing or printing anything. */
+static bool fold_binop_safe(ast_operator_t operator, runtime_val_t left, runtime_val_t right)
+{
+    runtime_valtype_t left_type = rtval_type(left), right_type = rtval_type(right);
+
+    if (operator == OP_LOGICAL_AND || operator == OP_LOGICAL_OR)
+        return true;
+
+    if (left_type == VAL_NULL && right_type == VAL_NULL)
+        return true;
+
+    bool left_number = left_type == VAL_NUMBER || left_type == VAL_BOOLEAN;
+    bool right_number = right_type == VAL_NUMBER || right_type == VAL_BOOLEAN;
+
+    if (left_number && right_number)
+    {
+        switch (operator)
+        {
+            case OP_DIVIDE:
+                return rtval_is_float(right) ? rtval_float(right) != 0 : (rtval_is_int(right) ? rtval_int(right) != 0 : rtval_bool(right));
+
+            case OP_MOD:
+                return !rtval_is_float(left) && !rtval_is_float(right) &&
+                    (rtval_is_int(right) ? rtval_int(right) != 0 : rtval_bool(right));
+
+            case OP_PLUS:
+            case OP_MINUS:
+            case OP_TIMES:
+            case OP_CMP_EQUALS:
+            case OP_CMP_EQUALS_STRICT:
+            case OP_CMP_LESS_THAN:
+            case OP_CMP_LESS_THAN_EQUALS:
+            case OP_CMP_GREATER_THAN:
+            case OP_CMP_GREATER_THAN_EQUALS:
+                return true;
+
+            default:
+                return false;
+        }
+    }
+
+    if ((left_type == VAL_STRING && (right_type == VAL_STRING || right_type == VAL_NUMBER)) ||
+        (right_type == VAL_STRING && left_type == VAL_NUMBER))
+        return operator == OP_PLUS || operator == OP_CMP_EQUALS || operator == OP_CMP_EQUALS_STRICT;
+
+    return false;
+}
+
+/* Mirrors eval_unary_expr() for `!', `-' and `+'. */
+static bool fold_unary(ast_operator_t operator, runtime_val_t operand, runtime_val_t *value)
+{
+    runtime_valtype_t type = rtval_type(operand);
+
+    if (operator == OP_LOGICAL_NOT)
+    {
+        if (type == VAL_NULL)
+            *value = BLAZE_TRUE;
+        else if (type == VAL_BOOLEAN)
+            *value = BLAZE_BOOL(!rtval_bool(operand));
+        else if (type == VAL_NUMBER)
+            *value = BLAZE_BOOL(rtval_is_float(operand) ? !rtval_float(operand) : !rtval_int(operand));
+        else
+            *value = BLAZE_FALSE;
+
+        return true;
+    }
+
+    if (type != VAL_NUMBER)
+        return false;
+
+    if (operator != OP_MINUS)
+        *value = operand;
+    else if (rtval_is_float(operand))
+        *value = BLAZE_FLOAT(-rtval_float(operand));
+    else if (rtval_int(operand) == INT64_MIN)
+        *value = BLAZE_FLOAT(-(double) rtval_int(operand));
+    else
+        *value = BLAZE_INT(-rtval_int(operand));
+
+    return true;
+}
+
+static bool fold_binary(ast_ref_t ref, fold_scope_t *scope, runtime_val_t *value)
+{
+    ast_node_t *node = NODE(ref);
+    runtime_val_t left, right;
+
+    /* Both sides are folded, whatever the other one is. A boxed integer
+       is a heap cell, and folding the right side may allocate one. */
+    bool left_constant = fold_expr(node->left, scope, &left);
+
+    if (left_constant)
+        gc_push_root(left);
+
+    bool right_constant = fold_expr(node->right, scope, &right);
+
+    if (left_constant)
+        gc_pop_roots(1);
+
+    bool constant = left_constant && right_constant && fold_binop_safe(node->operator, left, right);
+    bool is_or = node->operator == OP_LOGICAL_OR;
+
+    /* A left operand that decides && or || makes the right one dead. */
+    if (left_constant && (is_or || node->operator == OP_LOGICAL_AND) && runtime_val_to_bool(&left) == is_or)
+    {
+        *value = BLAZE_BOOL(is_or);
+        fold_materialize(ref, *value, scope);
+        constant = true;
+    }
+    else if (constant)
+    {
+        *value = eval_binop_values(node, left, right);
+        rtval_retain(*value);
+        fold_materialize(ref, *value, scope);
+    }
+
+    if (left_constant)
+        rtval_release(left);
+
+    if (right_constant)
+        rtval_release(right);
+
+    return constant;
+}
+
+/* Folds the expression at `ref' in place. Returns whether it is a
+   constant, and its value in `*value' then; a string value holds a
+   reference that the caller releases. */
+static bool fold_expr(ast_ref_t ref, fold_scope_t *scope, runtime_val_t *value)
+{
+    if (ref == AST_NONE)
+        return false;
+
+    callstack_check();
+
+    ast_node_t *node = NODE(ref);
+
+    switch (node->type)
+    {
+        case NODE_NUMERIC_LITERAL:
+        case NODE_STRING:
+            *value = fold_literal_value(node);
+            return true;
+
+        case NODE_IDENTIFIER:
+        {
+            fold_binding_t *binding = fold_lookup(scope, node->symbol);
+
+            if (binding == NULL || !binding->known)
+                return false;
+
+            if (binding->literal == AST_NONE)
+            {
+                *value = binding->value;
+                fold_materialize(ref, *value, scope);
+                return true;
+            }
+
+            uint32_t line = node->line;
+
+            *node = *NODE(binding->literal);
+            node->line = line;
+            *value = fold_literal_value(node);
+            return true;
+        }
+
+        case NODE_EXPR_BINARY:
+            return fold_binary(ref, scope, value);
+
+        case NODE_EXPR_UNARY:
+        {
+            runtime_val_t operand;
+
+            /* The operand of ++ and -- is a variable, not a value. */
+            if (node->operator == OP_PRE_INCREMENT || node->operator == OP_PRE_DECREMENT ||
+                node->operator == OP_POST_INCREMENT || node->operator == OP_POST_DECREMENT)
+                return false;
+
+            if (!fold_expr(node->right, scope, &operand))
+                return false;
+
+            bool constant = fold_unary(node->operator, operand, value);
+
+            if (constant)
+            {
+                rtval_retain(*value);
+                fold_materialize(ref, *value, scope);
+            }
+
+            rtval_release(operand);
+            return constant;
+        }
+
+        case NODE_EXPR_ASSIGNMENT:
+            fold_stmt(node->assignment_value, scope, false);
+            return false;
+
+        case NODE_EXPR_CALL:
+            for (uint32_t i = 0; i < node->args.count; i++)
+                fold_stmt(ast->refs[node->args.start + i], scope, false);
+
+            /* A callee that names a constant still fails as a call. */
+            if (NODE(node->callee)->type != NODE_IDENTIFIER)
+                fold_stmt(node->callee, scope, false);
+
+            return false;
+
+        case NODE_EXPR_MEMBER_ACCESS:
+            fold_stmt(node->object, scope, false);
+
+            if (node->computed)
+                fold_stmt(node->prop, scope, false);
+
+            return false;
+
+        case NODE_OBJECT_LITERAL:
+            for (uint32_t i = 0; i < node->properties.count; i++)
+            {
+                const ast_node_t *property = AST_LIST_NODE(ast, node->properties, i);
+
+                if (property->propval != AST_NONE)
+                    fold_stmt(property->propval, scope, false);
+            }
+
+            return false;
+
+        default:
+            return false;
+    }
+}
+
+/* Folds a statement list in place. Statements that can never run are
+   dropped from it. */
+static void fold_list(ast_list_t *list, fold_scope_t *scope)
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < list->count; i++)
+    {
+        ast_ref_t ref = fold_stmt(ast->refs[list->start + i], scope, true);
+
+        if (ref != AST_NONE)
+            ast->refs[list->start + count++] = ref;
+    }
+
+    list->count = count;
+}
+
+static void fold_body(ast_ref_t ref, fold_scope_t *scope, atom_t *loop_identifier)
+{
+    ast_node_t *node = NODE(ref);
+
+    if (node->type != NODE_BLOCK)
+    {
+        fold_stmt(ref, scope, false);
+        return;
+    }
+
+    fold_scope_t *block_scope = fold_scope_new(scope, node->body);
+
+    if (loop_identifier != NULL)
+        fold_declare(block_scope, loop_identifier);
+
+    fold_list(&node->body, block_scope);
+    fold_scope_free(block_scope);
+}
+
+/* Sets the condition of a control statement to 1 or 0. */
+static void fold_condition(ast_node_t *node, bool truthy)
+{
+    ast_node_t *cond = NODE(node->ctrl_cond);
+
+    *cond = (ast_node_t) { .type = NODE_NUMERIC_LITERAL, .line = cond->line, .intval = truthy };
+}
+
+static ast_ref_t fold_if(ast_ref_t ref, fold_scope_t *scope, bool direct)
+{
+    ast_node_t *node = NODE(ref);
+    runtime_val_t cond;
+    bool constant = fold_expr(node->ctrl_cond, scope, &cond);
+
+    fold_body(node->ctrl_body, scope, NULL);
+
+    if (node->else_body != AST_NONE)
+        fold_body(node->else_body, scope, NULL);
+
+    if (!constant)
+        return ref;
+
+    bool truthy = rtval_truthy(cond);
+
+    rtval_release(cond);
+
+    if (!truthy)
+    {
+        if (node->else_body == AST_NONE)
+        {
+            if (direct)
+                return AST_NONE;
+
+            fold_condition(node, false);
+            return ref;
+        }
+
+        node->ctrl_body = node->else_body;
+    }
+
+    node->else_body = AST_NONE;
+    fold_condition(node, true);
+
+    /* A single statement runs in the enclosing scope anyway. An `if'
+       keeps its wrapper: the status of a nested if block is dropped. So
+       does a `return', which is only honoured at the top of a body. */
+    const ast_node_t *body = NODE(node->ctrl_body);
+
+    if (direct && body->type != NODE_BLOCK && body->type != NODE_CTRL_IF && body->type != NODE_RETURN)
+        return node->ctrl_body;
+
+    return ref;
+}
+
+static ast_ref_t fold_function(ast_ref_t ref, fold_scope_t *scope)
+{
+    ast_node_t *node = NODE(ref);
+    fold_scope_t *body_scope = fold_scope_new(scope, node->body);
+
+    for (uint32_t i = 0; i < node->argnames.count; i++)
+        fold_declare(body_scope, AST_LIST_NODE(ast, node->argnames, i)->symbol);
+
+    fold_list(&node->body, body_scope);
+    fold_scope_free(body_scope);
+
+    return ref;
+}
+
+/* Folds a statement and returns what replaces it, or AST_NONE if it can
+   be dropped. `direct' is true for statements of a list: only those
+   replace themselves, and only their `const' declarations always run. */
+static ast_ref_t fold_stmt(ast_ref_t ref, fold_scope_t *scope, bool direct)
+{
+    if (ref == AST_NONE)
+        return AST_NONE;
+
+    callstack_check();
+
+    ast_node_t *node = NODE(ref);
+    runtime_val_t value;
+
+    switch (node->type)
+    {
+        case NODE_DECL_VAR:
+        {
+            bool constant = fold_expr(node->varval, scope, &value);
+
+            if (!constant)
+                return ref;
+
+            /* Numbers and strings always end up in a literal. */
+            if (node->is_const && direct)
+            {
+                fold_binding_t *binding = fold_declare(scope, node->identifier);
+
+                if (fold_is_literal(NODE(node->varval)))
+                    *binding = (fold_binding_t) { .name = node->identifier, .known = true, .literal = node->varval };
+                else if (rtval_tag(value) == RTVAL_TAG_SPECIAL)
+                    *binding = (fold_binding_t) { .name = node->identifier, .known = true, .value = value };
+            }
+
+            rtval_release(value);
+            return ref;
+        }
+
+        case NODE_DECL_FUNCTION:
+            return fold_function(ref, scope);
+
+        case NODE_BLOCK:
+            fold_body(ref, scope, NULL);
+            return ref;
+
+        case NODE_CTRL_IF:
+            return fold_if(ref, scope, direct);
+
+        case NODE_CTRL_WHILE:
+        {
+            bool constant = fold_expr(node->ctrl_cond, scope, &value);
+
+            fold_body(node->ctrl_body, scope, NULL);
+
+            if (!constant)
+                return ref;
+
+            bool truthy = rtval_truthy(value);
+
+            rtval_release(value);
+
+            if (!truthy && direct)
+                return AST_NONE;
+
+            fold_condition(node, truthy);
+            return ref;
+        }
+
+        case NODE_CTRL_LOOP:
+            if (fold_expr(node->ctrl_cond, scope, &value))
+                rtval_release(value);
+
+            fold_body(node->ctrl_body, scope,
+                node->ctrl_loop_identifier == NULL ? iteration_atom : node->ctrl_loop_identifier);
+            return ref;
+
+        case NODE_CTRL_FOR:
+        {
+            fold_scope_t *for_scope = fold_scope_new(scope, (ast_list_t) { 0 });
+
+            fold_prescan(node->for_init, for_scope);
+
+            fold_stmt(node->for_init, for_scope, true);
+            fold_stmt(node->for_cond, for_scope, false);
+            fold_stmt(node->for_incdec, for_scope, false);
+            fold_body(node->for_body, for_scope, NULL);
+            fold_scope_free(for_scope);
+            return ref;
+        }
+
+        case NODE_RETURN:
+            fold_stmt(node->return_expr, scope, false);
+            return ref;
+
+        default:
+            if (fold_expr(ref, scope, &value))
+                rtval_release(value);
+
+            return ref;
+    }
+}
+
+void fold_ast(ast_t *tree)
+{
+    ast = tree;
+    null_atom = atom_get("null");
+    true_atom = atom_get("true");
+    false_atom = atom_get("false");
+    iteration_atom = atom_get("iteration");
+
+    ast_node_t *program = NODE(ast->root);
+
+    /* The builtin constants, as create_global_scope() declares them. */
+    root = fold_scope_new(NULL, program->body);
+    *fold_declare(root, null_atom) = (fold_binding_t) { .name = null_atom, .known = true, .value = BLAZE_NULL };
+    *fold_declare(root, true_atom) = (fold_binding_t) { .name = true_atom, .known = true, .value = BLAZE_TRUE };
+    *fold_declare(root, false_atom) = (fold_binding_t) { .name = false_atom, .known = true, .value = BLAZE_FALSE };
+
+    fold_list(&program->body, root);
+    fold_scope_free(root);
+
+    root = NULL;
+    ast = NULL;
+}
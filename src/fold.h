@@ -0,0 +1,23 @@
+#ifndef __FOLD_H__
+#define __FOLD_H__
+
+#include "ast.h"
+
+/* Simplifies a freshly parsed tree in place, before it is resolved or
+   compiled:
+
+   - operators whose operands are literals are replaced by their result,
+     e.g. `60 * 60 * 24' becomes 86400 and `"prefix" + 1' "prefix1",
+     and so do `&&' and `||' once their left operand decides them;
+   - uses of a `const' initialized with a literal (or a foldable
+     expression) are replaced by that literal;
+   - `if' and `while' statements with a constant condition lose the
+     branches that can never run.
+
+   Results are computed with the evaluator's own operators, so folding
+   never changes what a program prints. Anything that would fail at run
+   time (a division by zero, an unsupported operand) is left alone to
+   fail there. */
+void fold_ast(ast_t *ast);
+
+#endif
@@ -6,42 +6,43 @@
 
 #include "runtimevalues.h"
 #include "scope.h"
-#include "vector.h"
 #include "functions.h"
 #include "eval.h"
 #include "utils.h"
+#include "shape.h"
 
 void print_rtval(runtime_val_t *result, bool newline, int tabs, bool quote_strings)
 {
-    if (result->type == VAL_NULL)
+    runtime_valtype_t type = rtval_type(*result);
+
+    if (type == VAL_NULL)
         printf("\033[35mnull\033[0m");
-    else if (result->type == VAL_BOOLEAN)
-        printf("\033[34m%s\033[0m", result->boolval ? "true" : "false");
-    else if (result->type == VAL_STRING)
-        printf("%s" COLOR("%s", "%s") "%s", quote_strings ? COLOR("2", "\"") : "", quote_strings ? "35" : "0", result->strval, quote_strings ? COLOR("2", "\"") : "");
-    else if (result->type == VAL_NUMBER)
+    else if (type == VAL_BOOLEAN)
+        printf("\033[34m%s\033[0m", rtval_bool(*result) ? "true" : "false");
+    else if (type == VAL_STRING)
+        printf("%s" COLOR("%s", "%s") "%s", quote_strings ? COLOR("2", "\"") : "", quote_strings ? "35" : "0", rtstring_data(rtval_string(*result)), quote_strings ? COLOR("2", "\"") : "");
+    else if (type == VAL_NUMBER)
     {
-        if (result->is_float)
-            printf("\033[33m%Lf\033[0m", result->floatval);
+        if (rtval_is_float(*result))
+            printf("\033[33m%f\033[0m", rtval_float(*result));
         else
-            printf("\033[33m%lld\033[0m", result->intval);    
+            printf("\033[33m%lld\033[0m", (long long int) rtval_int(*result));    
     }
-    else if (result->type == VAL_OBJECT)
+    else if (type == VAL_OBJECT)
     {
         printf(COLOR("1;36", "[Object]") " " COLOR("1;33", "{") "\n");
 
-        for (size_t i = 0, c = 0; i < result->properties.size; i++)
+        object_t *object = rtval_object(*result);
+        atom_t **keys = shape_keys(object->shape);
+
+        for (size_t i = 0; i < object->shape->count; i++)
         {
-            if (result->properties.array[i] == NULL)
-                continue;
-            
             for (int j = 0; j < tabs; j++)
                 putchar('\t');
 
-            printf("%s: ", result->properties.array[i]->key);
-            print_rtval(result->properties.array[i]->value->value, false, tabs + 1, true);
-            printf("%s\n", c != (result->properties.count - 1) ? "," : "");
-            c++;
+            printf("%s: ", keys[i]->name);
+            print_rtval(&object->slots[i], false, tabs + 1, true);
+            printf("%s\n", i != (object->shape->count - 1) ? "," : "");
         }
 
         for (int i = 0; i < (tabs - 1); i++)
@@ -50,7 +51,7 @@ void print_rtval(runtime_val_t *result, bool newline, int tabs, bool quote_strin
         printf(COLOR("1;33", "}"));
     }
     else 
-        printf("[Unknown Type: %d]", result->type);
+        printf("[Unknown Type: %d]", type);
 
     if (newline)
         printf("\n");
@@ -58,64 +59,63 @@ void print_rtval(runtime_val_t *result, bool newline, int tabs, bool quote_strin
 
 static runtime_val_t __native_null()
 {
-    return (runtime_val_t) { .type = VAL_NULL };
+    return BLAZE_NULL;
 }
 
 /* The `NATIVE_FN()` macro takes the base name of the native function,
    and declares a function prefixed with __native_ and suffixed with _fn.
    The function will take the following arguments:
 
-     - vector_t args
+     - runtime_val_t *args
+     - size_t argc
      - scope_t *scope 
     
-   These arguments can be used anywhere in the function body. */
+   These arguments can be used anywhere in the function body. The
+   arguments belong to the caller, and stay valid until the function
+   returns. */
 
 NATIVE_FN(println)
 {
-    for (size_t i = 0; i < args.length; i++)
+    for (size_t i = 0; i < argc; i++)
     {
-        runtime_val_t arg = VEC_GET(args, i, runtime_val_t);
+        runtime_val_t arg = args[i];
 
-        if (arg.type == VAL_STRING)
-            printf("%s", arg.strval);
+        if (rtval_type(arg) == VAL_STRING)
+            fwrite(rtstring_data(rtval_string(arg)), 1, rtval_string(arg)->length, stdout);
         else
             print_rtval(&arg, false, 1, false);
 
-        if (i != (args.length - 1))
+        if (i != (argc - 1))
             printf(" ");
     }
 
     printf("\n");
     fflush(stdout);
 
-    VEC_FREE(args);
     return __native_null();
 }
 
 NATIVE_FN(print)
 {
-    for (size_t i = 0; i < args.length; i++)
+    for (size_t i = 0; i < argc; i++)
     {
-        runtime_val_t arg = VEC_GET(args, i, runtime_val_t);
+        runtime_val_t arg = args[i];
         print_rtval(&arg, false, 1, false);
 
-        if (i != (args.length - 1))
+        if (i != (argc - 1))
             printf(" ");
     }
     
     fflush(stdout);
     
-    VEC_FREE(args);
     return __native_null();
 }
 
 NATIVE_FN(pause)
 {
-    if (args.length != 0) 
+    if (argc != 0) 
         eval_error(true, "pause() does not accept any parameters");
     
-    VEC_FREE(args);
-    
 #if defined(__WIN32__)
     while (true)
         getchar();
@@ -128,20 +128,21 @@ NATIVE_FN(pause)
 
 NATIVE_FN(sleep)
 {
-    if (args.length != 1) 
+    if (argc != 1) 
         eval_error(true, "sleep() takes exactly 1 parameter");
 
-    runtime_val_t number = VEC_GET(args, 0, runtime_val_t);
+    runtime_val_t number = args[0];
 
-    if (number.type != VAL_NUMBER) 
+    if (rtval_type(number) != VAL_NUMBER) 
         eval_error(true, "Parameter #1 of sleep() must be a Number");
 
-    if ((number.is_float ? number.floatval : number.intval) < 0) 
+    double seconds = rtval_is_float(number) ? rtval_float(number) : rtval_int(number);
+
+    if (seconds < 0) 
         eval_error(true, "Parameter #1 of sleep() must be a positive number");
     
-    usleep((unsigned long long int) ((number.is_float ? number.floatval : number.intval) * 1000000));
+    usleep((unsigned long long int) (seconds * 1000000));
 
-    VEC_FREE(args);    
     return __native_null();
 }
 
@@ -172,15 +173,15 @@ ssize_t getline(char **lineptr, FILE *stream)
 
 NATIVE_FN(read)
 {
-    if (args.length > 1) 
+    if (argc > 1) 
         eval_error(true, "read() accepts only 1 optional parameter");
 
-    if (args.length == 1) 
+    if (argc == 1) 
     {
-        if (VEC_GET(args, 0, runtime_val_t).type != VAL_STRING)
+        if (rtval_type(args[0]) != VAL_STRING)
             eval_error(true, "Parameter #1 of read() must be a String");
         
-        printf("%s", VEC_GET(args, 0, runtime_val_t).strval);
+        printf("%s", rtstring_data(rtval_string(args[0])));
     }
 
     char *line = NULL;
@@ -192,62 +193,65 @@ NATIVE_FN(read)
     getline(&line, &n, stdin);
 #endif
 
-    line[strlen(line) - 1] = '\0';
-    
-    VEC_FREE(args);
+    rtstring_t *string = rtstring_new(line, strlen(line) - 1);
+
+    free(line);
 
-    return (runtime_val_t) {
-        .type = VAL_STRING,
-        .strval = line
-    };
+    return BLAZE_STRING(string);
 }
 
 NATIVE_FN(typeof)
 {
-    if (args.length != 1)
+    if (argc != 1)
         eval_error(true, "typeof() expects exactly 1 parameter");
 
-    runtime_val_t val = {
-        .type = VAL_STRING
-    };
+    RTSTRING_STATIC(string_name, "String");
+    RTSTRING_STATIC(float_name, "Number (Float)");
+    RTSTRING_STATIC(integer_name, "Number (Integer)");
+    RTSTRING_STATIC(boolean_name, "Boolean");
+    RTSTRING_STATIC(native_fn_name, "Native Function");
+    RTSTRING_STATIC(null_name, "NULL");
+    RTSTRING_STATIC(object_name, "Object");
+    RTSTRING_STATIC(user_fn_name, "Function");
+    RTSTRING_STATIC(unknown_name, "Unknown");
 
-    runtime_val_t arg = VEC_GET(args, 0, runtime_val_t);
+    rtstring_t *name;
+    runtime_val_t arg = args[0];
 
-    switch (arg.type)
+    switch (rtval_type(arg))
     {
         case VAL_STRING:
-            val.strval = strdup("String");
+            name = &string_name;
             break;
 
         case VAL_NUMBER:
-            val.strval = strdup(arg.is_float ? "Number (Float)" : "Number (Integer)");
+            name = rtval_is_float(arg) ? &float_name : &integer_name;
             break;
 
         case VAL_BOOLEAN:
-            val.strval = strdup("Boolean");
+            name = &boolean_name;
             break;
 
         case VAL_NATIVE_FN:
-            val.strval = strdup("Native Function");
+            name = &native_fn_name;
             break;
 
         case VAL_NULL:
-            val.strval = strdup("NULL");
+            name = &null_name;
             break;
 
         case VAL_OBJECT:
-            val.strval = strdup("Object");
+            name = &object_name;
             break;
 
         case VAL_USER_FN:
-            val.strval = strdup("Function");
+            name = &user_fn_name;
             break;
 
         default:
-            val.strval = strdup("Unknown");
+            name = &unknown_name;
             break;
     }
     
-    VEC_FREE(args);
-    return val;
+    return BLAZE_STRING(name);
 }
@@ -3,11 +3,11 @@
 
 #include "runtimevalues.h"
 #include "scope.h"
-#include "vector.h"
 
-#define NATIVE_FN(name) runtime_val_t __native_##name##_fn(vector_t args, scope_t *scope)
+/* Native functions borrow their arguments: the caller frees them. */
+#define NATIVE_FN(name) runtime_val_t __native_##name##_fn(runtime_val_t *args, size_t argc, scope_t *scope)
 #define NATIVE_FN_REF(name) __native_##name##_fn
-#define NATIVE_FN_TYPE(identifier) runtime_val_t (*identifier)(vector_t args, scope_t *scope)
+#define NATIVE_FN_TYPE(identifier) runtime_val_t (*identifier)(runtime_val_t *args, size_t argc, scope_t *scope)
 
 NATIVE_FN(println);
 NATIVE_FN(print);
@@ -0,0 +1,369 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "gc.h"
+#include "scope.h"
+#include "shape.h"
+#include "xmalloc.h"
+
+/* Cells are multiples of GC_GRANULE bytes, header included. Cells of up
+   to GC_SMALL_MAX bytes are carved out of GC_CHUNK_SIZE chunks by bumping
+   a pointer, and once swept go to a free list per size; bigger ones come
+   from malloc(). */
+#define GC_GRANULE 16
+#define GC_SMALL_MAX 256
+#define GC_CHUNK_SIZE (64 * 1024)
+
+/* A collection runs once the heap, strings included, reaches the larger
+   of these: the minimum, or the bytes that survived the last collection
+   times the growth factor. Both can be set with BLAZE_GC_MIN_HEAP (in bytes) and
+   BLAZE_GC_GROWTH. */
+#define GC_DEFAULT_MIN_HEAP (1024 * 1024)
+#define GC_DEFAULT_GROWTH 2.0
+
+typedef struct gc_header {
+    struct gc_header *next;             /* All cells, or the free list once swept. */
+    uint32_t size;                      /* Cell size, header included. */
+    uint8_t type;
+    bool marked;
+} gc_header_t;
+
+typedef struct gc_chunk {
+    struct gc_chunk *next;
+} gc_chunk_t;
+
+gc_stats_t gc_stats = { 0 };
+
+static gc_header_t *cells = NULL;
+static gc_header_t *free_cells[GC_SMALL_MAX / GC_GRANULE + 1];
+static char *bump = NULL, *bump_end = NULL;
+static gc_chunk_t *chunks = NULL;
+
+static size_t threshold = 0;
+static size_t min_heap = GC_DEFAULT_MIN_HEAP;
+static double growth = GC_DEFAULT_GROWTH;
+
+/* Growable arrays of roots and of cells waiting to be scanned. */
+static struct scope **frames = NULL;
+static size_t frame_count = 0, frame_capacity = 0;
+static runtime_val_t *roots = NULL;
+static size_t root_count = 0, root_capacity = 0;
+static void (**markers)() = NULL;
+static size_t marker_count = 0;
+static gc_header_t **gray = NULL;
+static size_t gray_count = 0, gray_capacity = 0;
+
+#define GROW(array, count, capacity) do { \
+    if ((count) == (capacity)) { \
+        (capacity) = (capacity) == 0 ? 64 : (capacity) * 2; \
+        (array) = xrealloc((array), sizeof *(array) * (capacity)); \
+    } \
+} while (0)
+
+static inline gc_header_t *gc_header(void *pointer)
+{
+    return (gc_header_t *) pointer - 1;
+}
+
+static void gc_configure()
+{
+    const char *value = getenv("BLAZE_GC_MIN_HEAP");
+
+    if (value != NULL && atol(value) > 0)
+        min_heap = atol(value);
+
+    value = getenv("BLAZE_GC_GROWTH");
+
+    if (value != NULL && atof(value) > 1.0)
+        growth = atof(value);
+
+    threshold = min_heap;
+}
+
+static gc_header_t *gc_alloc_small(size_t size)
+{
+    gc_header_t *cell = free_cells[size / GC_GRANULE];
+
+    if (cell != NULL)
+    {
+        free_cells[size / GC_GRANULE] = cell->next;
+        return cell;
+    }
+
+    if (bump_end - bump < (ptrdiff_t) size)
+    {
+        gc_chunk_t *chunk = xmalloc(GC_CHUNK_SIZE);
+
+        chunk->next = chunks;
+        chunks = chunk;
+
+        /* Keep cells aligned to a granule. */
+        bump = (char *) chunk + GC_GRANULE;
+        bump_end = (char *) chunk + GC_CHUNK_SIZE;
+    }
+
+    cell = (gc_header_t *) bump;
+    bump += size;
+
+    return cell;
+}
+
+/* The returned cell is not a root: store it somewhere reachable (or push
+   it with gc_push_root()) before allocating again. */
+void *gc_alloc(gc_type_t type, size_t size)
+{
+    size = (sizeof (gc_header_t) + size + GC_GRANULE - 1) / GC_GRANULE * GC_GRANULE;
+
+    if (threshold == 0)
+        gc_configure();
+
+    if (gc_stats.heap_bytes + rtstring_bytes + size > threshold)
+        gc_collect();
+
+    gc_header_t *cell = size <= GC_SMALL_MAX ? gc_alloc_small(size) : xmalloc(size);
+
+    cell->next = cells;
+    cell->size = size;
+    cell->type = type;
+    cell->marked = false;
+    cells = cell;
+    gc_stats.allocations++;
+    gc_stats.heap_bytes += size;
+
+    return cell + 1;
+}
+
+static void gc_mark_cell(gc_header_t *cell)
+{
+    if (cell->marked)
+        return;
+
+    cell->marked = true;
+    GROW(gray, gray_count, gray_capacity);
+    gray[gray_count++] = cell;
+}
+
+void gc_mark_value(runtime_val_t value)
+{
+    switch (rtval_tag(value))
+    {
+        case RTVAL_TAG_OBJECT:
+        case RTVAL_TAG_USER_FN:
+        case RTVAL_TAG_INT64:
+            gc_mark_cell(gc_header(rtval_pointer(value)));
+            break;
+
+        case RTVAL_TAG_STRING:
+            rtstring_mark(rtval_string(value));
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void gc_mark_scope(scope_t *scope)
+{
+    for (size_t i = 0; i < scope->slot_count; i++)
+    {
+        if (scope->slots[i].declared)
+            gc_mark_value(scope->slots[i].value);
+    }
+
+    for (size_t i = 0; i < scope->identifiers.size; i++)
+    {
+        map_entry_t *entry = &scope->identifiers.array[i];
+
+        if (entry->key != NULL)
+            gc_mark_value(entry->value->value);
+    }
+
+    if (scope->captured != NULL)
+        gc_mark_cell(gc_header(scope->captured));
+
+    if (scope->parent != NULL && scope->parent->on_heap)
+        gc_mark_cell(gc_header(scope->parent));
+}
+
+static void gc_trace()
+{
+    while (gray_count > 0)
+    {
+        gc_header_t *cell = gray[--gray_count];
+
+        switch (cell->type)
+        {
+            case GC_OBJECT:
+            {
+                object_t *object = (object_t *) (cell + 1);
+
+                for (uint32_t i = 0; i < object->shape->count; i++)
+                    gc_mark_value(object->slots[i]);
+            }
+            break;
+
+            case GC_USER_FN:
+            {
+                user_fn_t *fn = (user_fn_t *) (cell + 1);
+
+                if (fn->scope->on_heap)
+                    gc_mark_cell(gc_header(fn->scope));
+            }
+            break;
+
+            case GC_SCOPE:
+                gc_mark_scope((scope_t *) (cell + 1));
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+static void gc_finalize(gc_header_t *cell)
+{
+    switch (cell->type)
+    {
+        case GC_OBJECT:
+        {
+            object_t *object = (object_t *) (cell + 1);
+
+            for (uint32_t i = 0; i < object->shape->count; i++)
+                rtval_release(object->slots[i]);
+        }
+        break;
+
+        case GC_SCOPE:
+            scope_free_slots((scope_t *) (cell + 1));
+            break;
+
+        default:
+            break;
+    }
+
+    if (cell->size > GC_SMALL_MAX)
+    {
+        free(cell);
+        return;
+    }
+
+    cell->next = free_cells[cell->size / GC_GRANULE];
+    free_cells[cell->size / GC_GRANULE] = cell;
+}
+
+static void gc_sweep()
+{
+    gc_header_t **link = &cells;
+    size_t live = 0;
+
+    while (*link != NULL)
+    {
+        gc_header_t *cell = *link;
+
+        if (cell->marked)
+        {
+            cell->marked = false;
+            live += cell->size;
+            link = &cell->next;
+            continue;
+        }
+
+        *link = cell->next;
+        gc_stats.freed_bytes += cell->size;
+        gc_finalize(cell);
+    }
+
+    gc_stats.heap_bytes = gc_stats.live_bytes = live;
+}
+
+void gc_collect()
+{
+    for (size_t i = 0; i < frame_count; i++)
+        gc_mark_scope(frames[i]);
+
+    for (size_t i = 0; i < root_count; i++)
+        gc_mark_value(roots[i]);
+
+    for (size_t i = 0; i < marker_count; i++)
+        markers[i]();
+
+    gc_trace();
+    gc_sweep();
+    rtstring_sweep();
+
+    gc_stats.collections++;
+    threshold = (gc_stats.live_bytes + rtstring_bytes) * growth;
+
+    if (threshold < min_heap)
+        threshold = min_heap;
+}
+
+/* Releases the whole heap at exit, without finalizing anything. */
+void gc_heap_free()
+{
+    while (cells != NULL)
+    {
+        gc_header_t *next = cells->next;
+
+        if (cells->size > GC_SMALL_MAX)
+            free(cells);
+
+        cells = next;
+    }
+
+    while (chunks != NULL)
+    {
+        gc_chunk_t *next = chunks->next;
+
+        free(chunks);
+        chunks = next;
+    }
+
+    free(frames);
+    free(roots);
+    free(markers);
+    free(gray);
+}
+
+/* Scopes are entered and left in LIFO order. */
+void gc_push_scope(struct scope *scope)
+{
+    GROW(frames, frame_count, frame_capacity);
+    frames[frame_count++] = scope;
+}
+
+void gc_pop_scope(struct scope *scope)
+{
+    assert(frame_count > 0 && frames[frame_count - 1] == scope);
+    frame_count--;
+}
+
+void gc_push_root(runtime_val_t value)
+{
+    GROW(roots, root_count, root_capacity);
+    roots[root_count++] = value;
+}
+
+void gc_pop_roots(size_t count)
+{
+    assert(count <= root_count);
+    root_count -= count;
+}
+
+/* The last `count' roots pushed, in the order they were pushed. Only
+   valid until the next gc_push_root(). */
+runtime_val_t *gc_roots(size_t count)
+{
+    assert(count <= root_count);
+    return roots + root_count - count;
+}
+
+/* A marker calls gc_mark_value() on each value it keeps alive. */
+void gc_add_root_marker(void (*marker)())
+{
+    markers = xrealloc(markers, sizeof *markers * (marker_count + 1));
+    markers[marker_count++] = marker;
+}
@@ -0,0 +1,55 @@
+#ifndef __GC_H__
+#define __GC_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "runtimevalues.h"
+
+/* Objects, user functions, boxed integers and the scopes closures
+   capture live on a mark-and-sweep heap. The roots are the scopes
+   currently being evaluated, values the evaluator holds on to while it
+   evaluates something else (see gc_push_root()), and whatever the
+   registered root markers report, e.g. the VM stack and registers.
+
+   The roots form the evaluator's value stack: the arguments of a call
+   are pushed one after the other and handed to the callee in place
+   (see gc_roots()), so passing them allocates nothing.
+
+   Strings stay reference counted: they cannot form cycles. A heap cell
+   that is swept releases the strings it holds. Collections also free
+   the temporary strings (see rtstring.h) that no root reaches, so a
+   string is a root as long as it is on the root stack, even when it
+   is not a cell. */
+typedef enum {
+    GC_OBJECT,
+    GC_USER_FN,
+    GC_INT64,
+    GC_SCOPE
+} gc_type_t;
+
+typedef struct {
+    size_t allocations;
+    size_t collections;
+    size_t heap_bytes;                  /* Bytes in live and not yet swept cells. */
+    size_t live_bytes;                  /* Bytes that survived the last collection. */
+    size_t freed_bytes;                 /* Bytes swept since startup. */
+} gc_stats_t;
+
+extern gc_stats_t gc_stats;
+
+struct scope;
+
+void *gc_alloc(gc_type_t type, size_t size);
+void gc_collect();
+void gc_heap_free();
+
+void gc_push_scope(struct scope *scope);
+void gc_pop_scope(struct scope *scope);
+void gc_push_root(runtime_val_t value);
+void gc_pop_roots(size_t count);
+runtime_val_t *gc_roots(size_t count);
+void gc_add_root_marker(void (*marker)());
+void gc_mark_value(runtime_val_t value);
+
+#endif
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libgen.h>
+
+#include "utils.h"
+#include "xmalloc.h"
+#include "lexer.h"
+
+/* Lexer microbenchmark: tokenizes a generated, identifier-heavy corpus
+   and reports keyword classification throughput for the old strcmp()
+   chain and for lex_keyword(), as well as full lex_next() throughput.
+
+   Build with `make lexbench'; an optional argument sets the number of
+   statements in the corpus. */
+
+#define ROUNDS 5
+
+config_t config = {
+    .currentfile = "<lexbench>",
+    .entryfile = "<lexbench>",
+    .outfile = NULL,
+    .progname = NULL
+};
+
+static const char *words[] = {
+    "counter", "value", "index", "result", "total", "name", "items", "left",
+    "right", "node", "parent", "child", "buffer", "offset", "length", "size",
+    "var", "const", "function", "if", "else", "while", "loop", "as",
+    "break", "continue", "return", "for", "println", "typeof", "system", "x"
+};
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The classifier lex_keyword() replaced, kept here as the baseline. */
+static lex_tokentype_t strcmp_keyword(const char *s)
+{
+    if (strcmp(s, "var") == 0)
+        return T_VAR;
+    if (strcmp(s, "const") == 0)
+        return T_CONST;
+    if (strcmp(s, "function") == 0)
+        return T_FUNCTION;
+    if (strcmp(s, "if") == 0)
+        return T_IF;
+    if (strcmp(s, "else") == 0)
+        return T_ELSE;
+    if (strcmp(s, "while") == 0)
+        return T_WHILE;
+    if (strcmp(s, "loop") == 0)
+        return T_LOOP;
+    if (strcmp(s, "as") == 0)
+        return T_AS;
+    if (strcmp(s, "break") == 0)
+        return T_BREAK;
+    if (strcmp(s, "continue") == 0)
+        return T_CONTINUE;
+    if (strcmp(s, "return") == 0)
+        return T_RETURN;
+    if (strcmp(s, "for") == 0)
+        return T_FOR;
+
+    return T_SKIPPABLE;
+}
+
+static char *make_corpus(size_t statements, size_t *length)
+{
+    size_t capacity = statements * 64 + 1, len = 0;
+    char *code = xmalloc(capacity);
+
+    srand(42);
+
+    for (size_t i = 0; i < statements; i++)
+    {
+        const char *a = words[rand() % (sizeof words / sizeof words[0])];
+        const char *b = words[rand() % (sizeof words / sizeof words[0])];
+        const char *c = words[rand() % (sizeof words / sizeof words[0])];
+
+        len += snprintf(code + len, capacity - len, "%s_%zu = %s(%s, %s_%zu);\n", a, i % 97, b, c, a, i % 13);
+    }
+
+    *length = len;
+    return code;
+}
+
+int main(int argc, char **argv)
+{
+    config.progname = basename(argv[0]);
+
+    size_t statements = argc > 1 ? strtoull(argv[1], NULL, 10) : 500000;
+    size_t length;
+    char *code = make_corpus(statements, &length);
+    lex_t lex;
+    lex_token_t token;
+
+    /* Collect the identifier and keyword spans once, NUL-terminated copies
+       included, so both classifiers see exactly the same input. */
+    size_t count = 0, capacity = 1024;
+    lex_token_t *spans = xmalloc(sizeof (lex_token_t) * capacity);
+    char **strings = xmalloc(sizeof (char *) * capacity);
+
+    lex_init(&lex, code, length);
+
+    while ((token = lex_next(&lex)).type != T_EOF)
+    {
+        if (token.type != T_IDENTIFIER && lex_keyword(token.value, token.length) == T_SKIPPABLE)
+            continue;
+
+        if (count == capacity)
+        {
+            capacity *= 2;
+            spans = xrealloc(spans, sizeof (lex_token_t) * capacity);
+            strings = xrealloc(strings, sizeof (char *) * capacity);
+        }
+
+        spans[count] = token;
+        strings[count] = lex_token_strdup(token);
+        count++;
+    }
+
+    double best_strcmp = 1e9, best_switch = 1e9, best_lex = 1e9;
+    size_t keywords_strcmp = 0, keywords_switch = 0, tokens = 0;
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        double start = now();
+        keywords_strcmp = 0;
+
+        for (size_t i = 0; i < count; i++)
+            keywords_strcmp += strcmp_keyword(strings[i]) != T_SKIPPABLE;
+
+        double mid = now();
+        keywords_switch = 0;
+
+        for (size_t i = 0; i < count; i++)
+            keywords_switch += lex_keyword(spans[i].value, spans[i].length) != T_SKIPPABLE;
+
+        double end = now();
+
+        if (mid - start < best_strcmp)
+            best_strcmp = mid - start;
+
+        if (end - mid < best_switch)
+            best_switch = end - mid;
+
+        start = now();
+        tokens = 0;
+        lex_init(&lex, code, length);
+
+        while (lex_next(&lex).type != T_EOF)
+            tokens++;
+
+        end = now();
+
+        if (end - start < best_lex)
+            best_lex = end - start;
+    }
+
+    if (keywords_strcmp != keywords_switch)
+    {
+        fprintf(stderr, "%s: keyword count mismatch: %zu != %zu\n", config.progname, keywords_strcmp, keywords_switch);
+        return 1;
+    }
+
+    printf("corpus: %zu bytes, %zu tokens, %zu identifiers (%zu keywords)\n", length, tokens, count, keywords_switch);
+    printf("keyword classification, strcmp chain:  %8.2f Mtokens/s\n", count / best_strcmp / 1e6);
+    printf("keyword classification, lex_keyword(): %8.2f Mtokens/s\n", count / best_switch / 1e6);
+    printf("full tokenization, lex_next():         %8.2f Mtokens/s\n", tokens / best_lex / 1e6);
+
+    for (size_t i = 0; i < count; i++)
+        free(strings[i]);
+
+    free(strings);
+    free(spans);
+    free(code);
+
+    return 0;
+}
@@ -5,38 +5,26 @@
 #include <stdbool.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
 
 #include "xmalloc.h"
 #include "lexer.h"
 #include "bstring.h"
 #include "blaze.h"
 
-static size_t line = 1;
-
-static void lex_token_array_resize(lex_t *array, size_t elements) 
-{
-    array->tokens = xrealloc(array->tokens, sizeof (lex_token_t) * (array->size + elements));
-    array->size += elements;
-}
-
-static void lex_token_array_push(lex_t *array, lex_token_t token)
-{
-    lex_token_array_resize(array, 1);
-    array->tokens[array->size - 1] = token;
-}
-
 static bool lex_is_skippable(char c)
 {
     return c == ' ' || c == '\t' || c == '\n' || c == '\r';
 }
 
-static void lex_error(bool should_exit, const char *fmt, ...)
+static void lex_error(lex_t *lex, bool should_exit, const char *fmt, ...)
 {
     va_list args;
     char fmt_processed[strlen(fmt) + 50];
     va_start(args, fmt);
 
-    sprintf(fmt_processed, COLOR("1", "%s:%lu: ") COLOR("1;31", "syntax error") ": %s\n", config.currentfile, line, fmt);
+    sprintf(fmt_processed, COLOR("1", "%s:%lu: ") COLOR("1;31", "syntax error") ": %s\n", config.currentfile, lex->line, fmt);
     vfprintf(stderr, fmt_processed, args);
 
     va_end(args);
@@ -45,55 +33,78 @@ static void lex_error(bool should_exit, const char *fmt, ...)
         exit(EXIT_FAILURE);
 }
 
-static lex_tokentype_t lex_keyword(char *s)
-{
-    if (strcmp(s, "var") == 0)
-        return T_VAR;
-    if (strcmp(s, "const") == 0)
-        return T_CONST;
-    if (strcmp(s, "function") == 0)
-        return T_FUNCTION;
-    if (strcmp(s, "if") == 0)
-        return T_IF;
-    if (strcmp(s, "else") == 0)
-        return T_ELSE;
-    if (strcmp(s, "while") == 0)
-        return T_WHILE;
-    if (strcmp(s, "loop") == 0)
-        return T_LOOP;
-    if (strcmp(s, "as") == 0)
-        return T_AS;
-    if (strcmp(s, "break") == 0)
-        return T_BREAK;
-    if (strcmp(s, "continue") == 0)
-        return T_CONTINUE;
-    if (strcmp(s, "return") == 0)
-        return T_RETURN;
-    if (strcmp(s, "for") == 0)
-        return T_FOR;
-
-    return T_SKIPPABLE;
-}
+#define KEYWORD(str, type) \
+    return memcmp(value, (str), sizeof (str) - 1) == 0 ? (type) : T_SKIPPABLE
 
-bool lex_token_array_shift(lex_t *array, lex_token_t *token)
+/* Classifies an identifier span. Keywords are dispatched on their length
+   and first character, so any identifier costs at most one memcmp(). */
+lex_tokentype_t lex_keyword(const char *value, size_t length)
 {
-    if (token) 
+    switch (length)
     {
-        if (array->size == 0)
-            return false;
+        case 2:
+            switch (value[0])
+            {
+                case 'a':
+                    KEYWORD("as", T_AS);
+                case 'i':
+                    KEYWORD("if", T_IF);
+            }
+            break;
 
-        *token = array->tokens[0];
-    }
+        case 3:
+            switch (value[0])
+            {
+                case 'v':
+                    KEYWORD("var", T_VAR);
+                case 'f':
+                    KEYWORD("for", T_FOR);
+            }
+            break;
 
-    for (size_t i = 0; (i + 1) < array->size; i++) 
-    {
-        array->tokens[i] = array->tokens[i + 1];
+        case 4:
+            switch (value[0])
+            {
+                case 'e':
+                    KEYWORD("else", T_ELSE);
+                case 'l':
+                    KEYWORD("loop", T_LOOP);
+            }
+            break;
+
+        case 5:
+            switch (value[0])
+            {
+                case 'c':
+                    KEYWORD("const", T_CONST);
+                case 'w':
+                    KEYWORD("while", T_WHILE);
+                case 'b':
+                    KEYWORD("break", T_BREAK);
+            }
+            break;
+
+        case 6:
+            if (value[0] == 'r')
+                KEYWORD("return", T_RETURN);
+            break;
+
+        case 8:
+            switch (value[0])
+            {
+                case 'f':
+                    KEYWORD("function", T_FUNCTION);
+                case 'c':
+                    KEYWORD("continue", T_CONTINUE);
+            }
+            break;
     }
 
-    array->size--;
-    return true;
+    return T_SKIPPABLE;
 }
 
+#undef KEYWORD
+
 static void line_update_set(size_t *lineptr, size_t newvalue)
 {
     *lineptr = newvalue;
@@ -104,18 +115,23 @@ static void line_update(size_t *lineptr, size_t incr)
     *lineptr += incr;
 }
 
-void lex_tokenize(lex_t *array, char *code)
+static lex_token_t lex_token(lex_t *lex, const char *value, size_t length, lex_tokentype_t type)
 {
-    array->tokens = NULL;
-    size_t len = strlen(code);
-    size_t i = 0;
+    return (lex_token_t) { .value = value, .length = length, .type = type, .line = lex->line };
+}
+
+/* Scans the next token off the source buffer. Once the end of the
+   buffer is reached, every further call returns a T_EOF token. */
+static lex_token_t lex_scan(lex_t *lex)
+{
+    const char *code = lex->code;
+    size_t len = lex->length;
+    size_t i = lex->pos;
 
     while (i < len)
     {
-        char char_buf[2];
-        sprintf(char_buf, "%c", code[i]);
-        lex_token_t token = { .value = strdup(char_buf), .type = T_SKIPPABLE, .line = line };
-        bool multi_char = false, string_parsing = false;
+        lex_token_t token = lex_token(lex, &code[i], 1, T_SKIPPABLE);
+        bool multi_char = false;
 
         switch (code[i]) 
         {
@@ -133,14 +149,14 @@ void lex_tokenize(lex_t *array, char *code)
                     {
                         i++;
 
-                        if (code[i] == '\r' || code[i] == '\n')
+                        if (i < len && (code[i] == '\r' || code[i] == '\n'))
                         {
                             i++;
                             break;
                         }
                     }
 
-                    line_update(&line, 1);
+                    line_update(&lex->line, 1);
                     continue;
                 }
                 else if ((i + 1) < len && code[i] == '/' && code[i + 1] == '*')
@@ -159,13 +175,13 @@ void lex_tokenize(lex_t *array, char *code)
                         }
                         
                         if (code[i + 1] == '\n' || code[i + 1] == '\r')
-                            line_update(&line, 1);
+                            line_update(&lex->line, 1);
                         
                         i++;
                     }
 
                     if (!is_terminated)
-                        lex_error(true, "Unterminated comment, missing `*/` to close the comment block");
+                        lex_error(lex, true, "Unterminated comment, missing `*/` to close the comment block");
 
                     continue;
                 } 
@@ -221,282 +237,277 @@ void lex_tokenize(lex_t *array, char *code)
             {
                 multi_char = true;
 
-                char c1 = code[i], c2 = i < (len - 1) ? code[i + 1] : '|';
-
-                if (string_parsing)
-                    lex_error(true, "Error parsing string");
-
                 if (code[i] == '\'' || code[i] == '"')
                 {
-                    string_parsing = true;
-
-                    char quote = code[i] == '\'' ? '\'' : '"';
-                    string_t str = _str("");
-                    size_t length = 0;
-
-                    i++;
+                    char quote = code[i];
+                    size_t begin = ++i;
 
+                    /* Only find the end of the literal here; escape sequences
+                       are processed by lex_token_unescape() when (and if) the
+                       parser asks for the value. */
                     while (i < len && code[i] != quote)
                     {
                         if ((i + 1) < len && code[i] == '\\' && (code[i + 1] == '\'' || code[i + 1] == '"'))
                         {
-                            concat_c_safe(str, &length, code[i + 1]);
                             i += 2;
                             continue;
                         }
 
                         if (code[i] == '\n' || code[i] == '\r')
-                            line_update(&line, 1);
-
-                        if ((i + 1) < len && code[i] == '\\')
-                        {
-                            if (code[i + 1] == 'n')
-                            {
-                                concat_c_safe(str, &length, '\n');
-                                i += 2;
-                            }
-                            else if (code[i + 1] == 'r')
-                            {
-                                concat_c_safe(str, &length, '\r');
-                                i += 2;
-                            }
-                            else if (code[i + 1] == 'b')
-                            {
-                                concat_c_safe(str, &length, '\b');
-                                i += 2;
-                            }
-                            else if (code[i + 1] == 'a')
-                            {
-                                concat_c_safe(str, &length, '\a');
-                                i += 2;
-                            }
-                            else if (code[i + 1] == 't')
-                            {
-                                concat_c_safe(str, &length, '\t');
-                                i += 2;
-                            }
-                            else if (code[i + 1] == 'v')
-                            {
-                                concat_c_safe(str, &length, '\v');
-                                i += 2;
-                            }
-                            else
-                            {
-                                concat_c_safe(str, &length, code[i]);
-                                i++;
-                            }
+                            line_update(&lex->line, 1);
 
-                            continue;
-                        }
-                        
-                        concat_c_safe(str, &length, code[i]);
                         i++;
                     }
 
-                    if (code[i] != quote)
+                    if (i >= len)
                     {
-                        line_update(&line, 1);
-                        lex_error(true, "Unterminated string, expected ending %s quote `%c`", quote == '"' ? "double" : "single", quote);
+                        line_update(&lex->line, 1);
+                        lex_error(lex, true, "Unterminated string, expected ending %s quote `%c`", quote == '"' ? "double" : "single", quote);
                     }
 
-                    concat_c_safe(str, &length, '\0');
-                    i++;
-
-                    free(token.value);
-
+                    token.value = &code[begin];
+                    token.length = i - begin;
                     token.type = T_STRING;
-                    token.value = str;
-                    string_parsing = false;
+                    i++;
                 }
                 else if (lex_is_skippable(code[i])) 
                 {
                     if (code[i] == '\n' || code[i] == '\r')
-                        line_update(&line, 1);
+                        line_update(&lex->line, 1);
                     
                     i++;
                     continue;
                 }
                 else if ((i + 1) < len && ((code[i] == '&' && code[i + 1] == '&') || (code[i] == '|' && code[i + 1] == '|')))
                 {
-                    token.type = T_BINARY_OPERATOR;
-                    token.value = strdup(code[i] == '&' ? "&&" : "||");
+                    token = lex_token(lex, &code[i], 2, T_BINARY_OPERATOR);
                     i += 2;
                 }
                 else if ((i + 2) < len && (code[i] == '=' && code[i + 1] == '=' && code[i + 2] == '='))
                 {
-                    token.type = T_BINARY_OPERATOR;
-                    token.value = strdup("===");
+                    token = lex_token(lex, &code[i], 3, T_BINARY_OPERATOR);
                     i += 3;
                 }
-                else if ((i + 1) < len && (code[i] == '=' && code[i + 1] == '='))
-                {
-                    token.type = T_BINARY_OPERATOR;
-                    token.value = strdup("==");
-                    i += 2;
-                }
-                else if ((i + 1) < len && (code[i] == '>' && code[i + 1] == '='))
-                {
-                    token.type = T_BINARY_OPERATOR;
-                    token.value = strdup(">=");
-                    i += 2;
-                }
-                else if ((i + 1) < len && (code[i] == '<' && code[i + 1] == '='))
+                else if ((i + 1) < len && ((code[i] == '=' || code[i] == '>' || code[i] == '<') && code[i + 1] == '='))
                 {
-                    token.type = T_BINARY_OPERATOR;
-                    token.value = strdup("<=");
+                    token = lex_token(lex, &code[i], 2, T_BINARY_OPERATOR);
                     i += 2;
                 }
-                else if ((i + 1) < len && (code[i] == '+' && code[i + 1] == '+'))
+                else if ((i + 1) < len && ((code[i] == '+' && code[i + 1] == '+') || (code[i] == '-' && code[i + 1] == '-')))
                 {
-                    token.type = T_UNARY_OPERATOR;
-                    token.value = strdup("++");
+                    token = lex_token(lex, &code[i], 2, T_UNARY_OPERATOR);
                     i += 2;
                 }
-                else if ((i + 1) < len && (code[i] == '-' && code[i + 1] == '-'))
-                {
-                    token.type = T_UNARY_OPERATOR;
-                    token.value = strdup("--");
-                    i += 2;
-                }
-                else if (i < len && code[i] == '<')
-                {
-                    token.type = T_BINARY_OPERATOR;
-                    token.value = strdup("<");
-                    i++;
-                }
-                else if (i < len && code[i] == '>')
-                {
-                    token.type = T_BINARY_OPERATOR;
-                    token.value = strdup(">");
-                    i++;
-                }
-                else if (i < len && code[i] == '+')
+                else if (code[i] == '<' || code[i] == '>' || code[i] == '+' || code[i] == '-')
                 {
-                    token.type = T_BINARY_OPERATOR;
-                    token.value = strdup("+");
+                    token = lex_token(lex, &code[i], 1, T_BINARY_OPERATOR);
                     i++;
                 }
-                else if (i < len && code[i] == '-')
+                else if (code[i] == '=')
                 {
-                    token.type = T_BINARY_OPERATOR;
-                    token.value = strdup("-");
-                    i++;
-                }
-                else if (i < len && code[i] == '=')
-                {
-                    token.type = T_ASSIGNMENT;
-                    token.value = strdup("=");
+                    token = lex_token(lex, &code[i], 1, T_ASSIGNMENT);
                     i++;
                 }
                 else if (isdigit(code[i])) 
                 {
-                    char *number = strdup(""); 
-                    size_t length = 0;
+                    size_t begin = i;
 
                     while (i < len && (isdigit(code[i]) || code[i] == '.'))
-                    {
-                        number = xrealloc(number, ++length);
-                        number[length - 1] = code[i];
                         i++;
-                    }
-
-                    number = xrealloc(number, ++length);
-                    number[length - 1] = '\0';
-
-                    free(token.value);
 
-                    token.type = T_NUMBER;
-                    token.value = number;
+                    token = lex_token(lex, &code[begin], i - begin, T_NUMBER);
                 }
                 else if (isalpha(code[i]) != 0 || code[i] == '_')
                 {
-                    char *identifier = strdup(""); 
-                    size_t length = 0;
+                    size_t begin = i;
 
                     while (i < len && (isalpha(code[i]) || isdigit(code[i]) || code[i] == '_'))
-                    {
-                        identifier = xrealloc(identifier, ++length);
-                        identifier[length - 1] = code[i];
                         i++;
-                    }
 
-                    identifier = xrealloc(identifier, ++length);
-                    identifier[length - 1] = '\0';
-                    
-                    free(token.value);
-                    token.value = identifier;
+                    token = lex_token(lex, &code[begin], i - begin, T_IDENTIFIER);
 
-                    lex_tokentype_t keyword_token_type = lex_keyword(identifier);
+                    lex_tokentype_t keyword_token_type = lex_keyword(token.value, token.length);
 
                     if (keyword_token_type != T_SKIPPABLE) 
-                    {
                         token.type = keyword_token_type;
-                    }
-                    else 
-                    {
-                        token.type = T_IDENTIFIER;
-                    }
+                    else
+                        token.atom = atom_intern(token.value, token.length);
                 }
                 else 
                 {
-                    string_t identifier = _str(""); 
-                    size_t length = 0;
+                    size_t begin = i;
 
-                    while (i < len)
-                    {
-                        if (isspace(code[i]))
-                        {
-                            break;
-                        }
-
-                        concat_c_safe(identifier, &length, code[i]);
+                    while (i < len && !isspace(code[i]))
                         i++;
-                    }
-
-                    concat_c_safe(identifier, &length, '\0');
 
-                    lex_error(true, "Unexpected token '%s' found", identifier);
+                    lex_error(lex, true, "Unexpected token '%.*s' found", (int) (i - begin), &code[begin]);
                 }
             }
             
             break;
         }
 
+        if (!multi_char) 
+            i++;
+
         if (token.type != T_SKIPPABLE)
         {
-            lex_token_array_push(array, token);
+            lex->pos = i;
+            return token;
         }
-        
-        if (!multi_char) 
-            i++;
     } 
     
-    lex_token_array_push(array, (lex_token_t) {
-        .type = T_EOF,
-        .value = NULL,
-        .line = line
-    });
+    lex->pos = i;
+    return lex_token(lex, NULL, 0, T_EOF);
 }
 
-void __debug_lex_print_token_array(lex_t *array)
+void lex_init(lex_t *lex, const char *code, size_t length)
 {
-    puts("Debug -------------");
+    lex->code = code;
+    lex->length = length;
+    lex->pos = 0;
+    lex->line = 1;
+    lex->head = 0;
+    lex->count = 0;
+}
+
+/* Returns the token `n` positions ahead of the current one without
+   consuming anything. Only LEX_LOOKAHEAD tokens are ever buffered. */
+lex_token_t lex_peek(lex_t *lex, size_t n)
+{
+    assert(n < LEX_LOOKAHEAD);
 
-    for (size_t i = 0; i < array->size; i++)
+    while (lex->count <= n)
     {
-        printf("[%lu] [Line: %lu] - %d - '%s'\n", i, array->tokens[i].line, array->tokens[i].type, array->tokens[i].value);
+        lex->ring[(lex->head + lex->count) & (LEX_LOOKAHEAD - 1)] = lex_scan(lex);
+        lex->count++;
     }
+
+    return lex->ring[(lex->head + n) & (LEX_LOOKAHEAD - 1)];
+}
+
+lex_token_t lex_next(lex_t *lex)
+{
+    lex_token_t token = lex_peek(lex, 0);
+
+    lex->head = (lex->head + 1) & (LEX_LOOKAHEAD - 1);
+    lex->count--;
+
+    return token;
+}
+
+char *lex_token_strdup(lex_token_t token)
+{
+    char *str = xmalloc(token.length + 1);
+    memcpy(str, token.value, token.length);
+    str[token.length] = '\0';
+    return str;
 }
 
-void lex_free(lex_t *array)
+/* Returns a heap copy of a string literal with its escape sequences
+   processed. Literals without a backslash are a plain copy. */
+char *lex_token_unescape(lex_token_t token)
 {
-    if (array->tokens != NULL)
+    assert(token.type == T_STRING);
+
+    const char *code = token.value;
+    size_t len = token.length;
+
+    if (memchr(code, '\\', len) == NULL)
+        return lex_token_strdup(token);
+
+    char *str = xmalloc(len + 1);
+    size_t length = 0;
+    size_t i = 0;
+
+    while (i < len)
     {
-        free(array->tokens);
-        array->tokens = NULL;
+        if ((i + 1) < len && code[i] == '\\')
+        {
+            char c;
+
+            switch (code[i + 1])
+            {
+                case '\'':
+                case '"':
+                    c = code[i + 1];
+                    break;
+                case 'n':
+                    c = '\n';
+                    break;
+                case 'r':
+                    c = '\r';
+                    break;
+                case 'b':
+                    c = '\b';
+                    break;
+                case 'a':
+                    c = '\a';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case 'v':
+                    c = '\v';
+                    break;
+                default:
+                    str[length++] = code[i++];
+                    continue;
+            }
+
+            str[length++] = c;
+            i += 2;
+            continue;
+        }
+
+        str[length++] = code[i++];
     }
 
-    array->size = 0;
+    str[length] = '\0';
+    return str;
+}
+
+long double lex_token_number(lex_token_t token)
+{
+    char buf[token.length + 1];
+
+    memcpy(buf, token.value, token.length);
+    buf[token.length] = '\0';
+
+    return (long double) atof(buf);
+}
+
+/* Parses a literal without a decimal point. Returns false if it does not
+   fit in an int64_t. */
+bool lex_token_integer(lex_token_t token, int64_t *value)
+{
+    char buf[token.length + 1];
+
+    memcpy(buf, token.value, token.length);
+    buf[token.length] = '\0';
+
+    errno = 0;
+    unsigned long long number = strtoull(buf, NULL, 10);
+
+    if (errno == ERANGE || number > INT64_MAX)
+        return false;
+
+    *value = (int64_t) number;
+    return true;
+}
+
+void __debug_lex_print_tokens(const char *code, size_t length)
+{
+    lex_t lex;
+    lex_token_t token;
+
+    lex_init(&lex, code, length);
+    puts("Debug -------------");
+
+    for (size_t i = 0; (token = lex_next(&lex)).type != T_EOF; i++)
+    {
+        printf("[%lu] [Line: %lu] - %d - '%.*s'\n", i, token.line, token.type, (int) token.length, token.value);
+    }
 }
 
 char *lex_token_stringify(lex_token_t token, bool quotes)
@@ -552,9 +563,8 @@ char *lex_token_stringify(lex_token_t token, bool quotes)
 
         default:
 token_return_as_is:
-            str = _str("\"");
-            concat(str, token.value);
-            concat_c(str, '"');
+            str = xmalloc(token.length + 3);
+            sprintf(str, "\"%.*s\"", (int) token.length, token.value != NULL ? token.value : "");
             return str;
     }
 }
@@ -3,9 +3,18 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
-#define LEX_INIT { .size = 0, .tokens = NULL }
+#include "atom.h"
+
+/* Number of tokens the parser may look ahead; must be a power of two. */
+#define LEX_LOOKAHEAD 4
+
+/* Compares a token span with a string literal. */
+#define LEX_TOKEN_IS(token, str) \
+    ((token).length == (sizeof (str) - 1) && memcmp((token).value, (str), sizeof (str) - 1) == 0)
 
 typedef enum 
 {
@@ -41,26 +50,45 @@ typedef enum
     T_FOR
 } lex_tokentype_t;
 
+/* A token is a view into the source buffer: `value` is not NUL-terminated
+   and stays valid only as long as the source does. For T_STRING the span
+   covers the raw literal between the quotes, with escapes still in place.
+   Identifiers are interned as they are scanned; `atom` is NULL for every
+   other token type. */
 typedef struct 
 {
-    char *value;
+    const char *value;
+    size_t length;
     lex_tokentype_t type;
     size_t line;
+    atom_t *atom;
 } lex_token_t;
 
+/* A pull-based lexer: tokens are scanned on demand and buffered in a
+   small ring, so memory use does not depend on the size of the input. */
 typedef struct 
 {
-    lex_token_t *tokens;
-    size_t size;
+    const char *code;
+    size_t length;
+    size_t pos;
+    size_t line;
+    lex_token_t ring[LEX_LOOKAHEAD];
+    size_t head;
+    size_t count;
 } lex_t;
 
-void lex_tokenize(lex_t *array, char *restrict code);
-void lex_free(lex_t *array);
-bool lex_token_array_shift(lex_t *array, lex_token_t *token);
+void lex_init(lex_t *lex, const char *code, size_t length);
+lex_token_t lex_peek(lex_t *lex, size_t n);
+lex_token_t lex_next(lex_t *lex);
+lex_tokentype_t lex_keyword(const char *value, size_t length);
 char *lex_token_stringify(lex_token_t token, bool quotes);
+char *lex_token_strdup(lex_token_t token);
+char *lex_token_unescape(lex_token_t token);
+long double lex_token_number(lex_token_t token);
+bool lex_token_integer(lex_token_t token, int64_t *value);
 
 #ifdef _DEBUG
-void __debug_lex_print_token_array(lex_t *array);
+void __debug_lex_print_tokens(const char *code, size_t length);
 #endif
 
 #endif
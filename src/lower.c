@@ -0,0 +1,760 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "lower.h"
+#include "callstack.h"
+#include "eval.h"
+#include "gc.h"
+#include "xmalloc.h"
+
+static const ast_t *ast = NULL;
+
+/* Every node and item array, so that lower_free() can release them. */
+static exec_node_t **nodes = NULL;
+static size_t node_count = 0, node_capacity = 0;
+
+#define NODE(ref) AST_NODE(ast, (ref))
+
+static runtime_val_t run_eval(const exec_node_t *node, scope_t *scope)
+{
+    return eval(node->ast, scope);
+}
+
+static runtime_val_t run_constant(const exec_node_t *node, scope_t *scope)
+{
+    (void) scope;
+    return node->constant;
+}
+
+static inline identifier_t *exec_variable(const exec_node_t *node, scope_t *scope)
+{
+    for (uint32_t i = 0; i < node->depth; i++)
+        scope = scope->parent;
+
+    identifier_t *identifier = &scope->slots[node->slot];
+
+    if (!identifier->declared)
+        eval_error(true, "Undefined identifier '%s' in the current scope", node->ast->symbol->name);
+
+    return identifier;
+}
+
+static runtime_val_t run_local(const exec_node_t *node, scope_t *scope)
+{
+    identifier_t *identifier = &scope->slots[node->slot];
+
+    if (!identifier->declared)
+        eval_error(true, "Undefined identifier '%s' in the current scope", node->ast->symbol->name);
+
+    return identifier->value;
+}
+
+static runtime_val_t run_variable(const exec_node_t *node, scope_t *scope)
+{
+    return exec_variable(node, scope)->value;
+}
+
+/* Heap cells and temporary strings need rooting; anything else
+   survives a collection. */
+static inline bool exec_needs_root(runtime_val_t value)
+{
+    rtval_tag_t tag = rtval_tag(value);
+    return tag == RTVAL_TAG_OBJECT || tag == RTVAL_TAG_USER_FN || tag == RTVAL_TAG_INT64 || tag == RTVAL_TAG_STRING;
+}
+
+static bool exec_int_operator(ast_operator_t operator)
+{
+    switch (operator)
+    {
+        case OP_PLUS:
+        case OP_MINUS:
+        case OP_CMP_LESS_THAN:
+        case OP_CMP_LESS_THAN_EQUALS:
+        case OP_CMP_GREATER_THAN:
+        case OP_CMP_GREATER_THAN_EQUALS:
+        case OP_CMP_EQUALS:
+        case OP_CMP_EQUALS_STRICT:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/* The operators exec_int_operator() accepts, on two inline integers:
+   neither can overflow 64 bits. */
+static inline runtime_val_t exec_int_binop(ast_operator_t operator, int64_t left, int64_t right)
+{
+    switch (operator)
+    {
+        case OP_PLUS:
+            return BLAZE_INT(left + right);
+
+        case OP_MINUS:
+            return BLAZE_INT(left - right);
+
+        case OP_CMP_LESS_THAN:
+            return BLAZE_BOOL(left < right);
+
+        case OP_CMP_LESS_THAN_EQUALS:
+            return BLAZE_BOOL(left <= right);
+
+        case OP_CMP_GREATER_THAN:
+            return BLAZE_BOOL(left > right);
+
+        case OP_CMP_GREATER_THAN_EQUALS:
+            return BLAZE_BOOL(left >= right);
+
+        default:
+            return BLAZE_BOOL(left == right);
+    }
+}
+
+/* Operands are evaluated right first, like eval_binop() does. */
+static runtime_val_t run_binary(const exec_node_t *node, scope_t *scope)
+{
+    runtime_val_t right = node->right->run(node->right, scope);
+    runtime_val_t left;
+
+    if (exec_needs_root(right))
+    {
+        gc_push_root(right);
+        left = node->left->run(node->left, scope);
+        gc_pop_roots(1);
+    }
+    else
+        left = node->left->run(node->left, scope);
+
+    if (rtval_tag(left) == RTVAL_TAG_INT && rtval_tag(right) == RTVAL_TAG_INT && exec_int_operator(node->ast->operator))
+        return exec_int_binop(node->ast->operator, rtval_int(left), rtval_int(right));
+
+    eval_line = node->ast->line;
+    return eval_binop_values(node->ast, left, right);
+}
+
+/* Mirrors eval_logical(): the right operand only runs when the left one
+   does not decide the result. */
+static runtime_val_t run_logical(const exec_node_t *node, scope_t *scope)
+{
+    bool is_or = node->ast->operator == OP_LOGICAL_OR;
+    runtime_val_t left = node->left->run(node->left, scope);
+    bool decided = runtime_val_to_bool(&left) == is_or;
+
+    rtval_free_temporary(left);
+
+    if (decided)
+        return BLAZE_BOOL(is_or);
+
+    runtime_val_t right = node->right->run(node->right, scope);
+    bool result = runtime_val_to_bool(&right);
+
+    rtval_free_temporary(right);
+    return BLAZE_BOOL(result);
+}
+
+/* `local op constant', with an inline integer constant. */
+static runtime_val_t run_local_int_binop(const exec_node_t *node, scope_t *scope)
+{
+    identifier_t *identifier = &scope->slots[node->left->slot];
+
+    if (identifier->declared && rtval_tag(identifier->value) == RTVAL_TAG_INT)
+        return exec_int_binop(node->ast->operator, rtval_int(identifier->value), rtval_int(node->right->constant));
+
+    runtime_val_t left = run_local(node->left, scope);
+
+    eval_line = node->ast->line;
+    return eval_binop_values(node->ast, left, node->right->constant);
+}
+
+static runtime_val_t run_assign(const exec_node_t *node, scope_t *scope)
+{
+    identifier_t *identifier = exec_variable(node, scope);
+
+    eval_line = node->ast->line;
+
+    if (identifier->is_const)
+        eval_error(true, "Cannot re-assign a value to constant '%s'", node->ast->symbol->name);
+
+    return scope_assign_slot(identifier, node->left->run(node->left, scope));
+}
+
+/* `i++' and friends on an inline integer; anything else goes through
+   eval() for its errors and conversions. */
+static runtime_val_t run_incdec(const exec_node_t *node, scope_t *scope)
+{
+    scope_t *frame = scope;
+
+    for (uint32_t i = 0; i < node->depth; i++)
+        frame = frame->parent;
+
+    identifier_t *identifier = &frame->slots[node->slot];
+    runtime_val_t old = identifier->value;
+
+    if (!identifier->declared || identifier->is_const || rtval_tag(old) != RTVAL_TAG_INT)
+        return eval(node->ast, scope);
+
+    int64_t value = rtval_int(old) + rtval_int(node->constant);
+
+    if (value < RTVAL_INT_MIN || value > RTVAL_INT_MAX)
+        return eval(node->ast, scope);
+
+    identifier->value = BLAZE_INT(value);
+
+    return node->ast->operator == OP_PRE_INCREMENT || node->ast->operator == OP_PRE_DECREMENT ? identifier->value : old;
+}
+
+static runtime_val_t run_var_decl(const exec_node_t *node, scope_t *scope)
+{
+    eval_line = node->ast->line;
+
+    runtime_val_t value = node->left == NULL ? BLAZE_NULL : node->left->run(node->left, scope);
+
+    return scope_declare_slot(scope, node->slot, node->ast->identifier, value, node->ast->is_const)->value;
+}
+
+static inline bool exec_cond(const exec_node_t *cond, scope_t *scope)
+{
+    runtime_val_t value = cond->run(cond, scope);
+    bool truthy = rtval_truthy(value);
+
+    rtval_free_temporary(value);
+    return truthy;
+}
+
+/* Mirrors eval_if_block(). */
+static loop_status_t exec_if_block(const exec_node_t *block, scope_t *scope)
+{
+    scope_t new_scope;
+
+    scope_init(&new_scope, scope, block->ast->frame_size);
+
+    for (uint32_t i = 0; i < block->count; i++)
+    {
+        rtval_free_temporary(block->items[i]->run(block->items[i], &new_scope));
+
+        if (new_scope.is_broken || new_scope.is_continued)
+            break;
+    }
+
+    loop_status_t status = new_scope.is_continued ? LS_CONT : (
+        new_scope.is_broken ? LS_BREAK : LS_RET
+    );
+
+    scope_free(&new_scope);
+    return status;
+}
+
+static runtime_val_t run_if(const exec_node_t *node, scope_t *scope)
+{
+    const exec_node_t *body = exec_cond(node->left, scope) ? node->right : node->third;
+
+    if (body == NULL)
+        return BLAZE_NULL;
+
+    if (body->ast->type == NODE_BLOCK)
+        return BLAZE_INT(exec_if_block(body, scope));
+
+    rtval_free_temporary(body->run(body, scope));
+    return BLAZE_NULL;
+}
+
+/* Mirrors eval_loop_body(). */
+static loop_status_t exec_loop_body(const exec_node_t *block, scope_t *body_scope)
+{
+    for (uint32_t i = 0; i < block->count; i++)
+    {
+        const exec_node_t *item = block->items[i];
+        runtime_val_t value = item->run(item, body_scope);
+
+        if (item->ast->type == NODE_CTRL_IF && rtval_is_int(value))
+        {
+            if (rtval_int(value) == LS_BREAK)
+                body_scope->is_broken = true;
+            else if (rtval_int(value) == LS_CONT)
+                body_scope->is_continued = true;
+        }
+        else
+            rtval_free_temporary(value);
+
+        if (body_scope->is_broken || body_scope->is_continued)
+            break;
+    }
+
+    loop_status_t status = body_scope->is_continued ? LS_CONT : (
+        body_scope->is_broken ? LS_BREAK : LS_RET
+    );
+
+    scope_reset(body_scope);
+    return status;
+}
+
+
+static runtime_val_t run_while(const exec_node_t *node, scope_t *scope)
+{
+    const exec_node_t *cond = node->left, *body = node->right;
+
+    if (body->ast->type != NODE_BLOCK)
+    {
+        while (exec_cond(cond, scope))
+            rtval_free_temporary(body->run(body, scope));
+
+        return BLAZE_NULL;
+    }
+
+    scope_t body_scope;
+
+    scope_init(&body_scope, scope, body->ast->frame_size);
+
+    while (exec_cond(cond, scope))
+    {
+        if (exec_loop_body(body, &body_scope) == LS_BREAK)
+            break;
+    }
+
+    scope_free(&body_scope);
+    return BLAZE_NULL;
+}
+
+static runtime_val_t run_for(const exec_node_t *node, scope_t *scope)
+{
+    const exec_node_t *init = node->left, *cond = node->right, *incdec = node->third, *body = node->fourth;
+    bool block = body->ast->type == NODE_BLOCK;
+    scope_t newscope, body_scope;
+
+    scope_init(&newscope, scope, node->ast->for_frame_size);
+
+    if (init != NULL)
+        rtval_free_temporary(init->run(init, &newscope));
+
+    if (block)
+        scope_init(&body_scope, &newscope, body->ast->frame_size);
+
+    while (cond == NULL || exec_cond(cond, &newscope))
+    {
+        if (block)
+        {
+            if (exec_loop_body(body, &body_scope) == LS_BREAK)
+                break;
+        }
+        else
+            rtval_free_temporary(body->run(body, &newscope));
+
+        if (incdec != NULL)
+            rtval_free_temporary(incdec->run(incdec, &newscope));
+    }
+
+    if (block)
+        scope_free(&body_scope);
+
+    scope_free(&newscope);
+    return BLAZE_NULL;
+}
+
+static runtime_val_t run_loop(const exec_node_t *node, scope_t *scope)
+{
+    static atom_t *iteration_atom = NULL;
+
+    runtime_val_t cond = node->left->run(node->left, scope);
+
+    if (rtval_type(cond) != VAL_NUMBER && rtval_type(cond) != VAL_BOOLEAN)
+        eval_error(true, "Non-numeric values cannot be used with loop statement");
+
+    if (rtval_is_float(cond))
+        eval_error(true, "Float values cannot be used with loop statement");
+
+    long long int value = rtval_is_int(cond) ? rtval_int(cond) : rtval_bool(cond);
+
+    if (value < 0)
+        eval_error(true, "Negative numbers cannot be used with loop statement");
+
+    bool forever = rtval_bool(cond);
+    const exec_node_t *body = node->right;
+
+    if (body->ast->type != NODE_BLOCK)
+    {
+        for (long long int i = 0; forever || i < value; i++)
+            rtval_free_temporary(body->run(body, scope));
+
+        return BLAZE_NULL;
+    }
+
+    if (iteration_atom == NULL)
+        iteration_atom = atom_get("iteration");
+
+    atom_t *name = node->ast->ctrl_loop_identifier == NULL ? iteration_atom : node->ast->ctrl_loop_identifier;
+    scope_t body_scope;
+
+    scope_init(&body_scope, scope, body->ast->frame_size);
+
+    for (long long int i = 0; forever || i < value; i++)
+    {
+        scope_declare_slot(&body_scope, 0, name, BLAZE_INT(i), false);
+
+        if (exec_loop_body(body, &body_scope) == LS_BREAK)
+            break;
+    }
+
+    scope_free(&body_scope);
+    return BLAZE_NULL;
+}
+
+static runtime_val_t run_call(const exec_node_t *node, scope_t *scope);
+static runtime_val_t exec_call(runtime_val_t callee, runtime_val_t *args, size_t argc, scope_t *scope);
+
+/* Like eval_call_operands(): the arguments, then the callee, go on the
+   root stack until gc_pop_roots(node->count + 1). */
+static runtime_val_t exec_call_operands(const exec_node_t *node, scope_t *scope, runtime_val_t **args)
+{
+    eval_line = node->ast->line;
+
+    for (uint32_t i = 0; i < node->count; i++)
+        gc_push_root(node->items[i]->run(node->items[i], scope));
+
+    runtime_val_t callee = node->left->run(node->left, scope);
+    gc_push_root(callee);
+
+    eval_line = node->left->ast->line;
+
+    if (rtval_type(callee) != VAL_NATIVE_FN && rtval_type(callee) != VAL_USER_FN)
+        eval_error(true, "'%s' is not a function", node->left->ast->symbol->name);
+
+    *args = gc_roots(node->count + 1);
+    return callee;
+}
+
+/* Runs a function with a lowered body. Like in eval_user_function_call(),
+   only a top-level return returns, and a `return f(...)' there hands the
+   frame over to `f'. */
+static runtime_val_t exec_user_call(user_fn_t *fn, runtime_val_t *args, size_t argc)
+{
+    const exec_node_t *body = fn->decl->exec;
+    runtime_val_t ret = BLAZE_NULL;
+    scope_t frame;
+
+    eval_call_enter(fn, args, argc, &frame);
+
+    for (uint32_t i = 0; i < body->count; i++)
+    {
+        const exec_node_t *item = body->items[i];
+
+        if (item->ast->type != NODE_RETURN)
+        {
+            rtval_free_temporary(item->run(item, &frame));
+            continue;
+        }
+
+        const exec_node_t *call = item->left;
+
+        if (call->run != run_call)
+        {
+            ret = call->run(call, &frame);
+            break;
+        }
+
+        runtime_val_t *tail_args;
+        runtime_val_t next = exec_call_operands(call, &frame, &tail_args);
+
+        if (rtval_type(next) == VAL_NATIVE_FN || rtval_user_fn(next)->decl->exec == NULL)
+        {
+            ret = exec_call(next, tail_args, call->count, &frame);
+            gc_pop_roots(call->count + 1);
+            break;
+        }
+
+        eval_tail_call(rtval_user_fn(next), tail_args, call->count, &frame);
+        body = rtval_user_fn(next)->decl->exec;
+        gc_pop_roots(call->count + 1);
+
+        /* The loop's increment brings this back to 0. */
+        i = (uint32_t) -1;
+    }
+
+    return eval_call_leave(&frame, ret);
+}
+
+static runtime_val_t exec_call(runtime_val_t callee, runtime_val_t *args, size_t argc, scope_t *scope)
+{
+    if (rtval_type(callee) == VAL_NATIVE_FN)
+    {
+        runtime_val_t value = rtval_native_fn(callee)(args, argc, scope);
+
+        eval_free_arguments(args, argc, value);
+        return value;
+    }
+
+    user_fn_t *fn = rtval_user_fn(callee);
+
+    if (fn->decl->exec != NULL)
+        return exec_user_call(fn, args, argc);
+
+    return eval_user_function_call(callee, args, argc);
+}
+
+static runtime_val_t run_call(const exec_node_t *node, scope_t *scope)
+{
+    runtime_val_t *args;
+    runtime_val_t callee = exec_call_operands(node, scope, &args);
+    runtime_val_t value = exec_call(callee, args, node->count, scope);
+
+    gc_pop_roots(node->count + 1);
+    return value;
+}
+
+static runtime_val_t run_member(const exec_node_t *node, scope_t *scope)
+{
+    runtime_val_t object = node->left->run(node->left, scope);
+
+    eval_line = node->ast->line;
+    return eval_member_value((ast_node_t *) node->ast, object, scope);
+}
+
+static runtime_val_t run_program(const exec_node_t *node, scope_t *scope)
+{
+    runtime_val_t last = BLAZE_NULL;
+
+    scope_reserve_slots(scope, node->ast->frame_size);
+
+    for (uint32_t i = 0; i < node->count; i++)
+    {
+        rtval_free_temporary(last);
+        last = node->items[i]->run(node->items[i], scope);
+    }
+
+    return last;
+}
+
+static exec_node_t *exec_new(const ast_node_t *source, exec_fn_t run)
+{
+    exec_node_t *node = xcalloc(1, sizeof *node);
+
+    node->run = run;
+    node->ast = source;
+
+    if (node_count == node_capacity)
+    {
+        node_capacity = node_capacity == 0 ? 256 : node_capacity * 2;
+        nodes = xrealloc(nodes, sizeof *nodes * node_capacity);
+    }
+
+    nodes[node_count++] = node;
+    return node;
+}
+
+static exec_node_t *lower(ast_ref_t ref);
+
+static exec_node_t *lower_optional(ast_ref_t ref)
+{
+    return ref == AST_NONE ? NULL : lower(ref);
+}
+
+static void lower_list(exec_node_t *node, ast_list_t list)
+{
+    node->count = list.count;
+    node->items = list.count == 0 ? NULL : xcalloc(list.count, sizeof *node->items);
+
+    for (size_t i = 0; i < list.count; i++)
+        node->items[i] = lower(ast->refs[list.start + i]);
+}
+
+/* Control statements run the statements of their block bodies
+   themselves, in the scopes they create. */
+static exec_node_t *lower_body(ast_ref_t ref)
+{
+    const ast_node_t *source = NODE(ref);
+
+    if (source->type != NODE_BLOCK)
+        return lower(ref);
+
+    exec_node_t *node = exec_new(source, run_eval);
+    lower_list(node, source->body);
+
+    return node;
+}
+
+static exec_node_t *lower_binary(const ast_node_t *source)
+{
+    exec_node_t *node = exec_new(source, run_binary);
+
+    node->left = lower(source->left);
+    node->right = lower(source->right);
+
+    if (source->operator == OP_LOGICAL_AND || source->operator == OP_LOGICAL_OR)
+        node->run = run_logical;
+    else if (node->left->run == run_local && node->right->run == run_constant &&
+        rtval_tag(node->right->constant) == RTVAL_TAG_INT && exec_int_operator(source->operator))
+        node->run = run_local_int_binop;
+
+    return node;
+}
+
+static exec_node_t *lower(ast_ref_t ref)
+{
+    callstack_check();
+
+    ast_node_t *source = (ast_node_t *) NODE(ref);
+    exec_node_t *node = exec_new(source, run_eval);
+
+    switch (source->type)
+    {
+        case NODE_NUMERIC_LITERAL:
+            /* Boxed integers are heap cells, and are made by eval(). */
+            if (source->is_float)
+                node->constant = BLAZE_FLOAT(source->floatval);
+            else if (source->intval >= RTVAL_INT_MIN && source->intval <= RTVAL_INT_MAX)
+                node->constant = BLAZE_INT(source->intval);
+            else
+                break;
+
+            node->run = run_constant;
+            break;
+
+        case NODE_STRING:
+            if (source->string == NULL)
+                source->string = rtstring_pin(AST_STRING(ast, source), source->str_length);
+
+            node->constant = BLAZE_STRING(source->string);
+            node->run = run_constant;
+            break;
+
+        case NODE_IDENTIFIER:
+            if (source->depth == AST_UNRESOLVED)
+                break;
+
+            node->depth = source->depth;
+            node->slot = source->slot;
+            node->run = source->depth == 0 ? run_local : run_variable;
+            break;
+
+        case NODE_EXPR_BINARY:
+            return lower_binary(source);
+
+        case NODE_EXPR_UNARY:
+        {
+            const ast_node_t *operand = NODE(source->right);
+            int delta = source->operator == OP_PRE_INCREMENT || source->operator == OP_POST_INCREMENT ? 1 : (
+                source->operator == OP_PRE_DECREMENT || source->operator == OP_POST_DECREMENT ? -1 : 0
+            );
+
+            if (delta == 0 || operand->type != NODE_IDENTIFIER || operand->depth == AST_UNRESOLVED)
+                break;
+
+            node->depth = operand->depth;
+            node->slot = operand->slot;
+            node->constant = BLAZE_INT(delta);
+            node->run = run_incdec;
+        }
+        break;
+
+        case NODE_EXPR_ASSIGNMENT:
+        {
+            const ast_node_t *assignee = NODE(source->assignee);
+
+            if (assignee->type != NODE_IDENTIFIER || assignee->depth == AST_UNRESOLVED)
+                break;
+
+            /* Errors name the variable, so point at the identifier. */
+            node->ast = assignee;
+            node->depth = assignee->depth;
+            node->slot = assignee->slot;
+            node->left = lower(source->assignment_value);
+            node->run = run_assign;
+        }
+        break;
+
+        case NODE_DECL_VAR:
+            node->slot = source->var_slot;
+            node->left = lower_optional(source->varval);
+            node->run = run_var_decl;
+            break;
+
+        case NODE_DECL_FUNCTION:
+            /* The declaration itself makes the closure; calls run the
+               lowered body. */
+            source->exec = exec_new(source, run_eval);
+            lower_list(source->exec, source->body);
+            break;
+
+        case NODE_RETURN:
+            node->left = lower(source->return_expr);
+            break;
+
+        case NODE_CTRL_IF:
+            node->left = lower(source->ctrl_cond);
+            node->right = lower_body(source->ctrl_body);
+            node->third = source->else_body == AST_NONE ? NULL : lower_body(source->else_body);
+            node->run = run_if;
+            break;
+
+        case NODE_CTRL_WHILE:
+            node->left = lower(source->ctrl_cond);
+            node->right = lower_body(source->ctrl_body);
+            node->run = run_while;
+            break;
+
+        case NODE_CTRL_FOR:
+            node->left = lower_optional(source->for_init);
+            node->right = lower_optional(source->for_cond);
+            node->third = lower_optional(source->for_incdec);
+            node->fourth = lower_body(source->for_body);
+            node->run = run_for;
+            break;
+
+        case NODE_CTRL_LOOP:
+            node->left = lower(source->ctrl_cond);
+            node->right = lower_body(source->ctrl_body);
+            node->run = run_loop;
+            break;
+
+        case NODE_EXPR_CALL:
+            lower_list(node, source->args);
+            node->left = lower(source->callee);
+            node->run = run_call;
+            break;
+
+        case NODE_EXPR_MEMBER_ACCESS:
+            node->left = lower(source->object);
+            node->run = run_member;
+            break;
+
+        case NODE_PROGRAM:
+            lower_list(node, source->body);
+            node->run = run_program;
+            break;
+
+        /* Blocks, object literals, break and continue. */
+        default:
+            break;
+    }
+
+    return node;
+}
+
+exec_node_t *lower_ast(const ast_t *tree)
+{
+    ast = tree;
+    eval_set_tree(tree);
+
+    return lower(tree->root);
+}
+
+runtime_val_t exec_run(const exec_node_t *program, scope_t *scope)
+{
+    return program->run(program, scope);
+}
+
+void lower_free()
+{
+    for (size_t i = 0; i < node_count; i++)
+    {
+        if (nodes[i]->ast->type == NODE_DECL_FUNCTION)
+            ((ast_node_t *) nodes[i]->ast)->exec = NULL;
+
+        free(nodes[i]->items);
+        free(nodes[i]);
+    }
+
+    free(nodes);
+    nodes = NULL;
+    node_count = node_capacity = 0;
+}
@@ -0,0 +1,39 @@
+#ifndef __LOWER_H__
+#define __LOWER_H__
+
+#include "ast.h"
+#include "scope.h"
+#include "runtimevalues.h"
+
+/* The closure engine (blaze --closures) runs a resolved AST after
+   lowering it once into a tree of exec nodes. Each node carries a
+   pointer to the function that runs it, picked for the shape of the
+   node when it is lowered (a local variable, a local compared with an
+   integer constant, ...), so running a node is one indirect call
+   instead of a dispatch on the AST node type. Nodes hold their
+   resolved slots and constants directly.
+
+   Nodes that are rare or not worth specializing run through eval(), so
+   both engines always agree. */
+typedef struct exec_node exec_node_t;
+typedef runtime_val_t (*exec_fn_t)(const exec_node_t *node, scope_t *scope);
+
+struct exec_node {
+    exec_fn_t run;
+    const ast_node_t *ast;              /* Source node, for errors and eval() fallbacks. */
+    exec_node_t *left;                  /* Operands, conditions and bodies. */
+    exec_node_t *right;
+    exec_node_t *third;
+    exec_node_t *fourth;
+    exec_node_t **items;                /* Statements or arguments. */
+    uint32_t count;
+    uint32_t depth;                     /* Resolved variable, if any. */
+    uint32_t slot;
+    runtime_val_t constant;
+};
+
+exec_node_t *lower_ast(const ast_t *ast);
+runtime_val_t exec_run(const exec_node_t *program, scope_t *scope);
+void lower_free();
+
+#endif
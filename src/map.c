@@ -9,169 +9,216 @@
 #include "xmalloc.h"
 #include "scope.h"
 
-static int call_number = 1;
+#define MAP_MIN_INDEX_SIZE 8
 
-/* TODO: support dynamic resizing of maps */
+/* Entries the map can hold before `index' has to grow. */
+#define MAP_CAPACITY(index_size) ((index_size) / 4 * 3)
 
-static inline size_t map_size(size_t size)
+/* Atom hashes are FNV-1a, whose low bits are weak on short, similar
+   keys; the murmur3 finalizer spreads them before masking. */
+static inline uint32_t map_hash(const atom_t *key)
 {
-    return size == 0 ? 1 : size;
+    uint32_t h = key->hash;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return h;
 }
 
-map_t map_init(size_t type_size, size_t max_elements) 
+size_t map_bucket(const map_t *map, uint32_t hash)
 {
-    return (map_t) {
-        .array = xcalloc(sizeof (map_entry_t *), max_elements),
-        .count = 0,
-        .size = max_elements,
-        .typesize = type_size
-    };
+    return hash & (map->index_size - 1);
 }
 
-static uint32_t hash_function(map_t *map, char *key)
+/* Returns the bucket holding `key', or the empty bucket where it would go. */
+static size_t map_find(const map_t *map, atom_t *key, uint32_t hash)
 {
-    uint32_t sum = 1;
-    size_t len = strlen(key);
+    size_t mask = map->index_size - 1;
+    size_t bucket = hash & mask;
 
-    for (size_t i = 0; i < len; i++) {
-        sum += key[i] * i;
-    }
+    while (map->index[bucket] != 0 && map->array[map->index[bucket] - 1].key != key)
+        bucket = (bucket + 1) & mask;
 
-    return sum % map_size(map->size);
+    return bucket;
 }
 
-void map_set(map_t *map, char *key, identifier_t *ptr)
+/* Drops deleted entries and rebuilds the index with `index_size' buckets. */
+static void map_rehash(map_t *map, size_t index_size)
 {
-    if (map->count >= map->size)
-        utils_error(true, "map_set(): overflow detected");
+    size_t capacity = MAP_CAPACITY(index_size);
 
-    uint32_t hash = hash_function(map, key);
+    if (capacity >= UINT32_MAX)
+        utils_error(true, "map_set(): too many elements");
 
-    while (map->size > hash && map->array[hash] != NULL && strcmp(map->array[hash]->key, key) != 0)
+    map_entry_t *array = xmalloc(sizeof (map_entry_t) * capacity);
+    uint32_t *index = xcalloc(sizeof (uint32_t), index_size);
+    size_t mask = index_size - 1;
+    size_t size = 0;
+
+    for (size_t i = 0; i < map->size; i++)
     {
-        hash++;
-        hash %= map_size(map->size);
-    }
+        if (map->array[i].key == NULL)
+            continue;
 
-    if (map->array[hash] == NULL)
-        map->count++;
-    else 
-        printf("Overwriting: %s\n", key);
+        size_t bucket = map->array[i].hash & mask;
 
-    map->array[hash] = xmalloc(sizeof (map_entry_t));
-    map->array[hash]->key = strdup(key);
-    map->array[hash]->value = ptr;
+        while (index[bucket] != 0)
+            bucket = (bucket + 1) & mask;
 
-    call_number++;
+        array[size] = map->array[i];
+        index[bucket] = ++size;
+    }
+
+    free(map->array);
+    free(map->index);
+
+    map->array = array;
+    map->index = index;
+    map->index_size = index_size;
+    map->capacity = capacity;
+    map->size = size;
 }
 
-void map_delete(map_t *map, char *key, bool _free)
+map_t map_init(size_t type_size, size_t expected_elements)
 {
-    uint32_t hash = hash_function(map, key);
+    map_t map = { .typesize = type_size };
 
-    while (map->size > hash && map->array[hash] != NULL)
-    {
-        if (strcmp(map->array[hash]->key, key) == 0)
-        {
-            if (_free)
-                free(map->array[hash]->value);
+    if (expected_elements == 0)
+        return map;
 
-            free(map->array[hash]->key);
-            free(map->array[hash]);
+    size_t index_size = MAP_MIN_INDEX_SIZE;
 
-            map->array[hash] = NULL;
+    while (MAP_CAPACITY(index_size) < expected_elements)
+        index_size *= 2;
 
-            map->count--;
+    map_rehash(&map, index_size);
+    return map;
+}
+
+void map_set(map_t *map, atom_t *key, identifier_t *ptr)
+{
+    uint32_t hash = map_hash(key);
+
+    if (map->index_size != 0)
+    {
+        size_t bucket = map_find(map, key, hash);
+
+        if (map->index[bucket] != 0)
+        {
+            printf("Overwriting: %s\n", key->name);
+            map->array[map->index[bucket] - 1].value = ptr;
             return;
         }
+    }
+
+    /* Out of entries: reclaim deleted ones if that frees at least half,
+       otherwise double. */
+    if (map->size == map->capacity)
+    {
+        size_t index_size = MAP_MIN_INDEX_SIZE;
 
-        hash++;
-        hash %= map_size(map->size);
+        if (map->index_size != 0)
+            index_size = map->count + 1 > map->capacity / 2 ? map->index_size * 2 : map->index_size;
+
+        map_rehash(map, index_size);
     }
+
+    size_t bucket = map_find(map, key, hash);
+
+    map->array[map->size] = (map_entry_t) { .hash = hash, .key = key, .value = ptr };
+    map->index[bucket] = ++map->size;
+    map->count++;
 }
 
-void map_set_free(map_t *map, char *key, identifier_t *_ptr)
+void map_delete(map_t *map, atom_t *key, bool _free)
 {
-    void *ptr = map_get(map, key);
+    if (map->count == 0)
+        return;
 
-    if (ptr)
-        free(ptr);
+    size_t mask = map->index_size - 1;
+    size_t hole = map_find(map, key, map_hash(key));
 
-    map_set(map, key, _ptr);
-}
+    if (map->index[hole] == 0)
+        return;
 
-identifier_t *map_get(map_t *map, char *key)
-{
-    uint32_t hash = hash_function(map, key);
+    map_entry_t *entry = &map->array[map->index[hole] - 1];
 
-    while (map->size > hash && map->array[hash] != NULL)
+    if (_free)
+        free(entry->value);
+
+    entry->key = NULL;
+    entry->value = NULL;
+    map->count--;
+
+    /* Backward-shift deletion: pull later buckets of the probe run into
+       the hole unless that would move them before their home bucket. */
+    for (size_t next = (hole + 1) & mask; map->index[next] != 0; next = (next + 1) & mask)
     {
-        if (strcmp(map->array[hash]->key, key) == 0)
-            return map->array[hash]->value;
+        size_t home = map->array[map->index[next] - 1].hash & mask;
 
-        hash++;
-        hash %= map_size(map->size);
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            map->index[hole] = map->index[next];
+            hole = next;
+        }
     }
 
-    return map->array[hash] == NULL ? NULL : map->array[hash]->value;
+    map->index[hole] = 0;
+}
+
+identifier_t *map_get(map_t *map, atom_t *key)
+{
+    if (map->count == 0)
+        return NULL;
+
+    uint32_t entry = map->index[map_find(map, key, map_hash(key))];
+    return entry == 0 ? NULL : map->array[entry - 1].value;
 }
 
-bool map_has(map_t *map, char *key)
+bool map_has(map_t *map, atom_t *key)
 {
     return map_get(map, key) != NULL;
 }
 
 void map_free(map_t *map, bool __recursive_free)
-{  
+{
     for (size_t i = 0; i < map->size; i++)
     {
-        if (map->array[i] != NULL)  
+        if (map->array[i].key != NULL && __recursive_free)
         {
-            xnfree(map->array[i]->key);
-
-            if (__recursive_free)
-            {
-                scope_runtime_val_free(map->array[i]->value->value);
-                znfree(map->array[i]->value, "Identifier");
-            }
-
-            xnfree(map->array[i]);
+            scope_runtime_val_free(&map->array[i].value->value);
+            znfree(map->array[i].value, "Identifier");
         }
     }
 
     xnfree(map->array);
+    xnfree(map->index);
+
+    map->count = map->size = map->capacity = map->index_size = 0;
 }
 
+/* Values are stored inline, so the copy never shares them. */
 map_t map_copy(map_t *map, bool __recursive)
-{  
-    map_t m = MAP_INIT(identifier_t *, map->size);
+{
+    (void) __recursive;
+
+    map_t m = MAP_INIT(identifier_t *, map->count);
 
     for (size_t i = 0; i < map->size; i++)
     {
-        if (map->array[i] != NULL)  
-        {
-            map_entry_t e = {
-                .key = strdup(map->array[i]->key),
-                .value = xmalloc(sizeof (identifier_t))
-            };
-
-            memcpy(e.value, map->array[i]->value, sizeof (identifier_t));
-            e.value->name = e.key;
-            e.value->is_const = map->array[i]->value->is_const;
-
-            if (__recursive)
-            {
-                e.value->value = xmalloc(sizeof (runtime_val_t));
-                memcpy(e.value->value, map->array[i]->value->value, sizeof (runtime_val_t));
-            }
-            else 
-            {
-                e.value->value = map->array[i]->value->value;
-            }
-
-            m.array[i] = xmalloc(sizeof (map_entry_t));
-            memcpy(m.array[i], &e, sizeof (map_entry_t));
-        }
+        if (map->array[i].key == NULL)
+            continue;
+
+        identifier_t *value = xmalloc(sizeof (identifier_t));
+
+        memcpy(value, map->array[i].value, sizeof (identifier_t));
+        value->name = map->array[i].key;
+
+        map_set(&m, map->array[i].key, value);
     }
 
     return m;
@@ -183,16 +230,16 @@ void __debug_map_print(map_t *map, bool printnull)
 
     for (size_t i = 0; i < map->size; i++)
     {
-        if (map->array[i] == NULL)
+        if (map->array[i].key == NULL)
         {
             if (printnull)
                 printf("[%lu]: NULL\n", i);
         }
-        else if (map->array[i]->value->value->type == VAL_NUMBER)
+        else if (rtval_is_int(map->array[i].value->value))
         {
-            printf("[%lu]: %s => %lld\n", i, map->array[i]->key, map->array[i]->value->value->intval);
+            printf("[%lu]: %s => %lld\n", i, map->array[i].key->name, (long long int) rtval_int(map->array[i].value->value));
         }
         else
-            printf("[%lu]: %s => %p\n", i, map->array[i]->key, map->array[i]->value);
+            printf("[%lu]: %s => %p\n", i, map->array[i].key->name, map->array[i].value);
     }
 }
@@ -2,35 +2,57 @@
 #define __MAP_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 
-#define MAP_INIT(type, max_elements) map_init(sizeof (type), (max_elements))
+#include "atom.h"
+#include "runtimevalues.h"
 
+/* `expected_elements' is only a hint: maps grow as needed. */
+#define MAP_INIT(type, expected_elements) map_init(sizeof (type), (expected_elements))
+
+/* The value is stored inline, so assigning to a variable allocates
+   nothing. */
 typedef struct {
     bool is_const;
-    char *name;
-    struct runtime_val_t *value;
+    bool declared;                      /* Slots exist before their declaration runs. */
+    atom_t *name;
+    runtime_val_t value;
 } identifier_t;
 
+/* Keys are atoms: they are hashed once when interned and compared by
+   pointer, and the map never owns them. */
 typedef struct {
-    char *key;
+    uint32_t hash;                      /* Mixed hash of the key, cached. */
+    atom_t *key;                        /* NULL once the entry is deleted. */
     identifier_t *value;
 } map_entry_t;
 
+/* Entries are stored inline, in insertion order, in `array'; iterate over
+   the first `size' of them and skip the ones with a NULL key. `index' is
+   an open-addressed (linear probing) table of entry numbers plus one, so
+   that zero marks an empty bucket. It is never more than 3/4 full, and
+   deletions shift later buckets back instead of leaving tombstones.
+
+   A zero-initialized map_t is a valid empty map. */
 typedef struct map {
-    map_entry_t **array;
-    size_t count;
-    size_t size;
+    map_entry_t *array;
+    size_t count;                       /* Live entries. */
+    size_t size;                        /* Used entries in array, deleted ones included. */
+    size_t capacity;                    /* Allocated entries in array. */
+    uint32_t *index;
+    size_t index_size;                  /* Zero or a power of two. */
     size_t typesize;
 } map_t;
 
-map_t map_init(size_t type_size, size_t max_elements);
-void map_set(map_t *map, char *key, identifier_t *ptr);
-identifier_t *map_get(map_t *map, char *key);
+map_t map_init(size_t type_size, size_t expected_elements);
+void map_set(map_t *map, atom_t *key, identifier_t *ptr);
+identifier_t *map_get(map_t *map, atom_t *key);
 void map_free(map_t *map, bool __recursive_free);
-void map_delete(map_t *map, char *key, bool _free);
-bool map_has(map_t *map, char *key);
+void map_delete(map_t *map, atom_t *key, bool _free);
+bool map_has(map_t *map, atom_t *key);
 map_t map_copy(map_t *map, bool __recursive);
+size_t map_bucket(const map_t *map, uint32_t hash);
 
 void __debug_map_print(map_t *map, bool printnull);
 
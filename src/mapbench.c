@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libgen.h>
+
+#include "utils.h"
+#include "xmalloc.h"
+#include "atom.h"
+#include "map.h"
+
+/* Map microbenchmark: runs insert, lookup and delete mixes over interned
+   keys and reports throughput together with the load factor and probe
+   lengths of the table after each phase.
+
+   Build with `make mapbench'; an optional argument sets the number of
+   keys. */
+
+#define ROUNDS 5
+#define LOOKUP_PASSES 8
+
+config_t config = {
+    .currentfile = "<mapbench>",
+    .entryfile = "<mapbench>",
+    .outfile = NULL,
+    .progname = NULL
+};
+
+/* The benchmark never frees values recursively. */
+void scope_runtime_val_free(struct runtime_val_t *val)
+{
+    (void) val;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* xorshift64, so that every run sees the same operations. */
+static uint64_t rng_state = 88172645463325252ull;
+
+static uint64_t rng()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+typedef struct {
+    size_t keys;
+    double load;
+    double avg_probes;
+    size_t max_probes;
+} map_stats_t;
+
+/* Probe length of a key is the number of buckets inspected to find it. */
+static map_stats_t collect_stats(const map_t *map)
+{
+    map_stats_t stats = { .keys = map->count };
+    size_t total_probes = 0;
+
+    for (size_t i = 0; i < map->index_size; i++)
+    {
+        if (map->index[i] == 0)
+            continue;
+
+        size_t home = map_bucket(map, map->array[map->index[i] - 1].hash);
+        size_t probes = ((i - home) & (map->index_size - 1)) + 1;
+
+        total_probes += probes;
+
+        if (probes > stats.max_probes)
+            stats.max_probes = probes;
+    }
+
+    if (map->index_size != 0)
+        stats.load = (double) map->count / map->index_size;
+
+    if (map->count != 0)
+        stats.avg_probes = (double) total_probes / map->count;
+
+    return stats;
+}
+
+int main(int argc, char **argv)
+{
+    config.progname = basename(argv[0]);
+
+    size_t keys = argc > 1 ? strtoull(argv[1], NULL, 10) : 200000;
+
+    /* The first half of the atoms goes into the map, the second half is
+       only ever looked up, to measure misses. */
+    atom_t **atoms = xmalloc(sizeof (atom_t *) * keys * 2);
+    identifier_t dummy = { 0 };
+    char name[32];
+
+    for (size_t i = 0; i < keys * 2; i++)
+    {
+        snprintf(name, sizeof name, "key_%zu", i);
+        atoms[i] = atom_get(name);
+    }
+
+    double best[5] = { 1e9, 1e9, 1e9, 1e9, 1e9 };
+    size_t ops[5] = { 0 };
+    map_stats_t stats[5];
+    size_t found = 0;
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        map_t map = MAP_INIT(identifier_t *, 0);
+        double start, end;
+
+        /* Insert into an empty map, growing it as we go. */
+        start = now();
+
+        for (size_t i = 0; i < keys; i++)
+            map_set(&map, atoms[i], &dummy);
+
+        end = now();
+        ops[0] = keys;
+
+        if (end - start < best[0])
+            best[0] = end - start;
+
+        stats[0] = collect_stats(&map);
+
+        /* Successful lookups. */
+        start = now();
+        found = 0;
+
+        for (int pass = 0; pass < LOOKUP_PASSES; pass++)
+            for (size_t i = 0; i < keys; i++)
+                found += map_get(&map, atoms[i]) != NULL;
+
+        end = now();
+        ops[1] = keys * LOOKUP_PASSES;
+
+        if (end - start < best[1])
+            best[1] = end - start;
+
+        stats[1] = collect_stats(&map);
+
+        /* Failed lookups. */
+        start = now();
+
+        for (int pass = 0; pass < LOOKUP_PASSES; pass++)
+            for (size_t i = keys; i < keys * 2; i++)
+                found += map_get(&map, atoms[i]) != NULL;
+
+        end = now();
+        ops[2] = keys * LOOKUP_PASSES;
+
+        if (end - start < best[2])
+            best[2] = end - start;
+
+        stats[2] = collect_stats(&map);
+
+        /* Delete every other key, then put them back. */
+        start = now();
+
+        for (size_t i = 0; i < keys; i += 2)
+            map_delete(&map, atoms[i], false);
+
+        for (size_t i = 0; i < keys; i += 2)
+            map_set(&map, atoms[i], &dummy);
+
+        end = now();
+        ops[3] = keys;
+
+        if (end - start < best[3])
+            best[3] = end - start;
+
+        stats[3] = collect_stats(&map);
+
+        /* Random mix: 60% lookups, 20% inserts, 20% deletes over all keys. */
+        start = now();
+
+        for (size_t i = 0; i < keys * 4; i++)
+        {
+            uint64_t r = rng();
+            atom_t *key = atoms[(r >> 8) % (keys * 2)];
+
+            switch (r % 5)
+            {
+                case 0:
+                    if (!map_has(&map, key))
+                        map_set(&map, key, &dummy);
+                break;
+
+                case 1:
+                    map_delete(&map, key, false);
+                break;
+
+                default:
+                    found += map_get(&map, key) != NULL;
+                break;
+            }
+        }
+
+        end = now();
+        ops[4] = keys * 4;
+
+        if (end - start < best[4])
+            best[4] = end - start;
+
+        stats[4] = collect_stats(&map);
+
+        map_free(&map, false);
+    }
+
+    static const char *phases[] = {
+        "insert (growing)", "lookup, hit", "lookup, miss", "delete + reinsert", "mixed 60/20/20"
+    };
+
+    printf("%zu keys, best of %d rounds (%zu hits)\n", keys, ROUNDS, found);
+
+    for (int i = 0; i < 5; i++)
+    {
+        printf("%-18s %8.2f Mops/s   %8zu keys  load %.2f  probes avg %.2f max %zu\n",
+            phases[i], ops[i] / best[i] / 1e6, stats[i].keys, stats[i].load, stats[i].avg_probes, stats[i].max_probes);
+    }
+
+    free(atoms);
+    atom_table_free();
+
+    return 0;
+}
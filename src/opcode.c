@@ -4,11 +4,12 @@
 
 #include "opcode.h"
 #include "scope.h"
-#include "vector.h"
 #include "bstring.h"
 #include "functions.h"
 #include "stack.h"
 #include "blaze.h"
+#include "gc.h"
+#include "eval.h"
 
 #define OPCODE_HANDLER(name) static uint8_t *opcode_handler_##name(uint8_t *ip, bytecode_t *bytecode)
 #define OPCODE_HANDLER_REF(name) opcode_handler_##name
@@ -30,7 +31,7 @@ static bool is_valid_regid(bytecode_t *bytecode, int regid)
     return true;
 }
 
-#define REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) (reg2_is_reg == 0x01 ? registers[reg2id].intval : number)
+#define REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) (reg2_is_reg == 0x01 ? rtval_int(registers[reg2id]) : number)
 
 static uint8_t *binary_operation_reg(bytecode_t *bytecode, uint8_t *ip, char operator)
 {
@@ -58,26 +59,26 @@ static uint8_t *binary_operation_reg(bytecode_t *bytecode, uint8_t *ip, char ope
         number = byte1 | byte2 << 8 | byte3 << 16 | byte4 << 32;
     }
 
-    if (registers[reg1id].type != VAL_NUMBER || (reg2_is_reg && registers[reg2id].type != VAL_NUMBER)) 
+    if (!rtval_is_int(registers[reg1id]) || (reg2_is_reg && !rtval_is_int(registers[reg2id]))) 
     {
         bytecode_set_error(bytecode, "operands must be number");
         return ++ip;
     }
 
-    if ((operator == '%' || operator == '/') && ((reg2_is_reg && registers[reg2id].intval == 0) || (!reg2_is_reg && number == 0)))
+    if ((operator == '%' || operator == '/') && ((reg2_is_reg && rtval_int(registers[reg2id]) == 0) || (!reg2_is_reg && number == 0)))
     {
         bytecode_set_error(bytecode, "operand #2 must be non-zero number");
         return ++ip;
     }
 
-    int value = operator == '+' ? registers[reg1id].intval + REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
-        operator == '-' ? registers[reg1id].intval - REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
-            operator == '*' ? registers[reg1id].intval * REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
-                operator == '/' ? registers[reg1id].intval / REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
-                    operator == '%' ? registers[reg1id].intval % REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
-                        operator == '|' ? registers[reg1id].intval | REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
-                            operator == '&' ? registers[reg1id].intval & REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
-                                operator == '^' ? registers[reg1id].intval ^ REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
+    int value = operator == '+' ? rtval_int(registers[reg1id]) + REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
+        operator == '-' ? rtval_int(registers[reg1id]) - REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
+            operator == '*' ? rtval_int(registers[reg1id]) * REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
+                operator == '/' ? rtval_int(registers[reg1id]) / REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
+                    operator == '%' ? rtval_int(registers[reg1id]) % REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
+                        operator == '|' ? rtval_int(registers[reg1id]) | REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
+                            operator == '&' ? rtval_int(registers[reg1id]) & REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
+                                operator == '^' ? rtval_int(registers[reg1id]) ^ REG2_OR_NUM_VAL(reg2_is_reg, reg2id, number) : (
                                     -1
                                 )
                             )
@@ -88,11 +89,7 @@ static uint8_t *binary_operation_reg(bytecode_t *bytecode, uint8_t *ip, char ope
         )
     );
 
-    registers[reg1id] = (runtime_val_t) {
-        .type = VAL_NUMBER,
-        .is_float = false,
-        .intval = value
-    };
+    registers[reg1id] = BLAZE_INT(value);
     
     return ++ip;
 }
@@ -150,11 +147,7 @@ OPCODE_HANDLER(mov)
     if (!is_valid_regid(bytecode, regid))
         return ++ip;
     
-    registers[regid] = (runtime_val_t) {
-        .type = VAL_NUMBER,
-        .is_float = false,
-        .intval = number
-    };
+    registers[regid] = BLAZE_INT(number);
     
     return ++ip;
 }
@@ -210,18 +203,26 @@ OPCODE_HANDLER(test)
 
 OPCODE_HANDLER(push)
 {
-    stack_push(&global, (runtime_val_t) {
-        .type = VAL_NUMBER,
-        .is_float = false,
-        .intval = *++ip
-    });
+    stack_push(&global, BLAZE_INT(*++ip));
 
     return ++ip;
 }
 
+OPCODE_HANDLER(push_int64)
+{
+    uint64_t value = 0;
+
+    for (int i = 8; i > 0; i--)
+        value = value << 8 | ip[i];
+
+    stack_push(&global, BLAZE_INT((int64_t) value));
+
+    return ip + 9;
+}
+
 OPCODE_HANDLER(pop)
 {
-    stack_pop(&global);
+    rtval_free_temporary(stack_pop(&global));
     return ++ip;
 }
 
@@ -230,29 +231,37 @@ static void binary_operation(bytecode_t *bytecode, ast_operator_t operator)
     runtime_val_t num2 = stack_pop(&global);
     runtime_val_t num1 = stack_pop(&global);
 
-    if (num1.type != VAL_NUMBER)
+    if (!rtval_is_int(num1))
+    {
         bytecode_set_error(bytecode, "Value #1 in stack is not a number");
-    else if (num2.type != VAL_NUMBER)
+        return;
+    }
+    else if (!rtval_is_int(num2))
+    {
         bytecode_set_error(bytecode, "Value #0 in stack is not a number");
+        return;
+    }
+
+    int64_t int1 = rtval_int(num1), int2 = rtval_int(num2);
 
     if (operator == OP_DIVIDE || operator == OP_MOD)
     {
-        if (num2.intval == 0)
+        if (int2 == 0)
+        {
             bytecode_set_error(bytecode, "Cannot divide by 0 (value #0)");
+            return;
+        }
     }
 
-    stack_push(&global, (runtime_val_t) {
-        .type = VAL_NUMBER,
-        .intval = operator == OP_PLUS ? num1.intval + num2.intval : (
-            operator == OP_MINUS ? num1.intval - num2.intval : (
-                operator == OP_TIMES ? num1.intval * num2.intval : (
-                    operator == OP_DIVIDE ? num1.intval / num2.intval : (
-                        num1.intval % num2.intval
-                    )
+    stack_push(&global, BLAZE_INT(operator == OP_PLUS ? int1 + int2 : (
+        operator == OP_MINUS ? int1 - int2 : (
+            operator == OP_TIMES ? int1 * int2 : (
+                operator == OP_DIVIDE ? int1 / int2 : (
+                    int1 % int2
                 )
             )
         )
-    });
+    )));
 }
 
 OPCODE_HANDLER(add)
@@ -285,11 +294,51 @@ OPCODE_HANDLER(mod)
     return ++ip;
 }
 
+/* The left operand of `&&' (or `||') is on the stack. If it decides the
+   result, it is replaced by false (or true) and the right operand is
+   jumped over; otherwise it is popped. The jump is a 16-bit little-endian
+   offset from the end of the instruction. */
+static uint8_t *jump_logical(uint8_t *ip, bool is_or)
+{
+    uint16_t offset = ip[1] | ip[2] << 8;
+    runtime_val_t value = stack_pop(&global);
+    bool decided = runtime_val_to_bool(&value) == is_or;
+
+    rtval_free_temporary(value);
+    ip += 3;
+
+    if (!decided)
+        return ip;
+
+    stack_push(&global, BLAZE_BOOL(is_or));
+    return ip + offset;
+}
+
+OPCODE_HANDLER(jmp_false_or_pop)
+{
+    return jump_logical(ip, false);
+}
+
+OPCODE_HANDLER(jmp_true_or_pop)
+{
+    return jump_logical(ip, true);
+}
+
+OPCODE_HANDLER(bool)
+{
+    runtime_val_t value = stack_pop(&global);
+    bool truthy = runtime_val_to_bool(&value);
+
+    rtval_free_temporary(value);
+    stack_push(&global, BLAZE_BOOL(truthy));
+    return ++ip;
+}
+
 OPCODE_HANDLER(decl_var)
 {
     ip++;
     char *identifier = bytecode_get_next_string(&ip);
-    scope_declare_identifier(&global_scope, identifier, & BLAZE_NULL, false);
+    scope_declare_identifier(&global_scope, atom_get(identifier), BLAZE_NULL, false);
     return ++ip;
 }
 
@@ -298,7 +347,7 @@ OPCODE_HANDLER(store_varval)
     ip++;
     char *identifier = bytecode_get_next_string(&ip);
     runtime_val_t value = stack_pop(&global);
-    scope_assign_identifier(&global_scope, identifier, &value);
+    scope_assign_identifier(&global_scope, atom_get(identifier), value);
     return ++ip;
 }
 
@@ -306,12 +355,12 @@ OPCODE_HANDLER(push_varval)
 {
     ip++;
     char *identifier = bytecode_get_next_string(&ip);
-    identifier_t *i = scope_resolve_identifier(&global_scope, identifier);
+    identifier_t *i = scope_resolve_identifier(&global_scope, atom_get(identifier));
 
     if (i == NULL)
         bytecode_set_error(bytecode, "'%s' is not defined", identifier);
     else
-        stack_push(&global, *i->value);
+        stack_push(&global, i->value);
 
     return ++ip;
 }
@@ -332,34 +381,23 @@ OPCODE_HANDLER(builtin_fn_call)
     ip++;
 
     char *symbol = bytecode_get_next_string(&ip);
-    vector_t args = VEC_INIT;
-    scope_t scope = scope_init(NULL);
-
-    for (uint8_t i = 0; i < numargs; i++)  
-    { 
-        runtime_val_t element = stack_pop(&global);
-        runtime_val_t value = {
-            .type = element.type
-        };
+    runtime_val_t args[UINT8_MAX];
+    scope_t scope;
 
-        if (element.type == VAL_NUMBER)
-        {
-            if (element.is_float)
-                value.floatval = element.floatval;
-            else
-                value.intval = element.intval;
-        }
-        else if (element.type == VAL_STRING)
-            value.strval = strdup(element.strval);
+    scope_init(&scope, NULL, 0);
 
-        VEC_PUSH(args, value, runtime_val_t);
-    }
+    /* The arguments were pushed last to first. */
+    for (uint8_t i = 0; i < numargs; i++)  
+        args[i] = stack_pop(&global);
 
     for (size_t i = 0; i < (sizeof (__native_functions) / sizeof (__native_functions[0])); i++) 
     {
-        if (STREQ(__native_functions[i].name, strdup(symbol)))
+        if (STREQ(__native_functions[i].name, symbol))
         {
-            __native_functions[i].callback(args, &scope);
+            runtime_val_t ret = __native_functions[i].callback(args, numargs, &scope);
+
+            eval_free_arguments(args, numargs, ret);
+            stack_push(&global, ret);
             scope_free(&scope);
             return ++ip;
         }
@@ -383,10 +421,8 @@ OPCODE_HANDLER(push_str)
 {
     ip++;
                     
-    stack_push(&global, (runtime_val_t) {
-        .type = VAL_STRING,
-        .strval = bytecode_get_next_string(&ip)
-    });
+    char *string = bytecode_get_next_string(&ip);
+    stack_push(&global, BLAZE_STRING(rtstring_new(string, strlen(string))));
 
     return ++ip;
 }
@@ -398,10 +434,9 @@ OPCODE_HANDLER(pop_str)
 
 OPCODE_HANDLER(print)
 {
-    vector_t args = VEC_INIT; 
     runtime_val_t value = stack_pop(&global);
-    VEC_PUSH(args, value, runtime_val_t);
-    NATIVE_FN_REF(println)(args, &global_scope);    
+    NATIVE_FN_REF(println)(&value, 1, &global_scope);
+    rtval_free_temporary(value);
     return ++ip;
 }
 
@@ -410,6 +445,7 @@ static void opcode_set_handlers()
     handlers[OP_HLT] = OPCODE_HANDLER_REF(hlt);
     handlers[OP_TEST] = OPCODE_HANDLER_REF(test);
     handlers[OP_PUSH] = OPCODE_HANDLER_REF(push);
+    handlers[OP_PUSH_INT64] = OPCODE_HANDLER_REF(push_int64);
     handlers[OP_ADD] = OPCODE_HANDLER_REF(add);
     handlers[OP_SUB] = OPCODE_HANDLER_REF(sub);
     handlers[OP_MUL] = OPCODE_HANDLER_REF(mul);
@@ -434,12 +470,26 @@ static void opcode_set_handlers()
     handlers[OP_REGOR] = OPCODE_HANDLER_REF(regor);
     handlers[OP_REGAND] = OPCODE_HANDLER_REF(regand);
     handlers[OP_REGXOR] = OPCODE_HANDLER_REF(regxor);
+    handlers[OP_JMP_FALSE_OR_POP] = OPCODE_HANDLER_REF(jmp_false_or_pop);
+    handlers[OP_JMP_TRUE_OR_POP] = OPCODE_HANDLER_REF(jmp_true_or_pop);
+    handlers[OP_BOOL] = OPCODE_HANDLER_REF(bool);
+}
+
+/* The stack and the registers are GC roots. */
+static void opcode_mark_roots()
+{
+    for (size_t i = 0; i < global.si; i++)
+        gc_mark_value(global.array[i]);
+
+    for (size_t i = 0; i < REG_COUNT; i++)
+        gc_mark_value(registers[i]);
 }
 
 void opcode_init()
 {
     global = stack_create(20);
-    global_scope = scope_init(NULL);
+    scope_init(&global_scope, NULL, 0);
+    gc_add_root_marker(&opcode_mark_roots);
 
     for (size_t i = 0; i < OPCODE_COUNT; i++)
         handlers[i] = &opcode_handler_nop;
@@ -36,6 +36,10 @@ typedef enum {
     OP_REGOR,
     OP_REGAND,
     OP_REGXOR,
+    OP_PUSH_INT64,                  /* Operand is 8 bytes, least significant first. */
+    OP_JMP_FALSE_OR_POP,
+    OP_JMP_TRUE_OR_POP,
+    OP_BOOL,
     OPCODE_COUNT,
 } opcode_t;
 
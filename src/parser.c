@@ -9,18 +9,32 @@
 #include "lexer.h"
 #include "blaze.h"
 #include "xmalloc.h"
-#include "vector.h"
 #include "bstring.h"
+#include "callstack.h"
 
 typedef struct {
-    lex_t lexer_data;
+    lex_t lexer;
+    bool eof_shifted;
+    ast_t *ast;
+    ast_ref_t *stack;           /* Children of the lists being parsed. */
+    size_t stack_size;
+    size_t stack_capacity;
 } parser_conf_t;
 
 static parser_conf_t conf;
 
-static inline lex_token_t parser_at() 
+/* Node pointers are only valid until the next node is allocated, so the
+   parser holds on to refs and looks nodes up right before using them. */
+#define NODE(ref) AST_NODE(conf.ast, (ref))
+
+static inline lex_token_t parser_at()
 {
-    return conf.lexer_data.tokens[0];
+    return lex_peek(&conf.lexer, 0);
+}
+
+static inline lex_token_t parser_peek(size_t n)
+{
+    return lex_peek(&conf.lexer, n);
 }
 
 static inline size_t parser_line()
@@ -28,6 +42,30 @@ static inline size_t parser_line()
     return parser_at().line;
 }
 
+static inline ast_ref_t parser_node(ast_nodetype_t type, size_t line)
+{
+    return ast_node_new(conf.ast, type, line);
+}
+
+static void parser_list_push(ast_ref_t ref)
+{
+    if (conf.stack_size == conf.stack_capacity)
+    {
+        conf.stack_capacity = conf.stack_capacity == 0 ? 64 : conf.stack_capacity * 2;
+        conf.stack = xrealloc(conf.stack, sizeof (ast_ref_t) * conf.stack_capacity);
+    }
+
+    conf.stack[conf.stack_size++] = ref;
+}
+
+/* Moves everything pushed since `mark` into the AST as one list. */
+static ast_list_t parser_list_end(size_t mark)
+{
+    ast_list_t list = ast_list_new(conf.ast, &conf.stack[mark], conf.stack_size - mark);
+    conf.stack_size = mark;
+    return list;
+}
+
 static void parser_error(bool should_exit, const char *fmt, ...)
 {
     va_list args;
@@ -43,19 +81,20 @@ static void parser_error(bool should_exit, const char *fmt, ...)
         exit(EXIT_FAILURE);
 }
 
-bool parser_eof() 
+bool parser_eof()
 {
-    return conf.lexer_data.size == 0 || conf.lexer_data.tokens[0].type == T_EOF;
+    return conf.eof_shifted || parser_at().type == T_EOF;
 }
 
 lex_token_t parser_shift()
 {
-    lex_token_t token;
-
-    if (!lex_token_array_shift(&conf.lexer_data, &token))
-    {
+    if (conf.eof_shifted)
         parser_error(true, "Unexpected end of file");
-    }
+
+    lex_token_t token = lex_next(&conf.lexer);
+
+    if (token.type == T_EOF)
+        conf.eof_shifted = true;
 
     return token;
 }
@@ -72,63 +111,62 @@ static char __debug_parser_print_ast_stmt_binop_operator_to_str(ast_operator_t o
         return '/';
     else if (operator == OP_MOD)
         return '%';
-    else 
+    else
         return operator;
 }
 
-static void __debug_parser_print_ast_stmt_binop(ast_stmt *binop)
+static void __debug_parser_print_ast_stmt_operand(ast_t *ast, ast_node_t *node);
+
+static void __debug_parser_print_ast_stmt_binop(ast_t *ast, ast_node_t *binop)
 {
     putchar('(');
-
-    ast_stmt *left = binop->left;
-
-    if (left->type == NODE_NUMERIC_LITERAL)
-        printf("\033[33m%Lf\033[0m", left->value);
-    else if (left->type == NODE_IDENTIFIER)
-        printf("%s", left->symbol);
-    else if (left->type == NODE_EXPR_BINARY)
-        __debug_parser_print_ast_stmt_binop(left);
-    else 
-        printf("[Unknown %d]", left->type);
-
+    __debug_parser_print_ast_stmt_operand(ast, AST_NODE(ast, binop->left));
     printf(" %c ", __debug_parser_print_ast_stmt_binop_operator_to_str(binop->operator));
-
-    ast_stmt *right = binop->right;
-
-    if (right->type == NODE_NUMERIC_LITERAL)
-        printf("\033[33m%Lf\033[0m", right->value);
-    else if (right->type == NODE_IDENTIFIER)
-        printf("%s", right->symbol);
-    else if (right->type == NODE_EXPR_BINARY)
-        __debug_parser_print_ast_stmt_binop(right);
-    else 
-        printf("[Unknown %d]", right->type);
-    
+    __debug_parser_print_ast_stmt_operand(ast, AST_NODE(ast, binop->right));
     putchar(')');
 }
 
-void __debug_parser_print_ast_stmt(ast_stmt *prog)
+static void __debug_parser_print_ast_stmt_operand(ast_t *ast, ast_node_t *node)
+{
+    if (node->type == NODE_NUMERIC_LITERAL && node->is_float)
+        printf("\033[33m%f\033[0m", node->floatval);
+    else if (node->type == NODE_NUMERIC_LITERAL)
+        printf("\033[33m%lld\033[0m", (long long int) node->intval);
+    else if (node->type == NODE_IDENTIFIER)
+        printf("%s", node->symbol->name);
+    else if (node->type == NODE_EXPR_BINARY)
+        __debug_parser_print_ast_stmt_binop(ast, node);
+    else
+        printf("[Unknown %d]", node->type);
+}
+
+void __debug_parser_print_ast_stmt(ast_t *ast)
 {
+    ast_node_t *prog = AST_NODE(ast, ast->root);
+
     assert(prog->type == NODE_PROGRAM);
 
-    for (size_t i = 0; i < prog->size; i++)
+    for (size_t i = 0; i < prog->body.count; i++)
     {
-        printf("[%lu] - {%d}", i, prog->body[i].type);
-
-        if (prog->body[i].type == NODE_IDENTIFIER) 
-            printf(" Identifier: '%s'", prog->body[i].symbol);
-        else if (prog->body[i].type == NODE_NUMERIC_LITERAL) 
-            printf(" Number: %Lf", prog->body[i].value);
-        else if (prog->body[i].type == NODE_STRING) 
-            printf(" String: \033[33m%s\033[0m", prog->body[i].strval);
-        else if (prog->body[i].type == NODE_DECL_VAR)
-            printf(" Variable declared: %s", prog->body[i].identifier);
-        else if (prog->body[i].type == NODE_EXPR_ASSIGNMENT)
-            printf(" Assignment: %s = %p", prog->body[i].assignee->symbol, prog->body[i].assignment_value);
-        else if (prog->body[i].type == NODE_EXPR_BINARY) 
+        ast_node_t *stmt = AST_LIST_NODE(ast, prog->body, i);
+
+        printf("[%lu] - {%d}", i, stmt->type);
+
+        if (stmt->type == NODE_IDENTIFIER || stmt->type == NODE_NUMERIC_LITERAL)
+        {
+            printf(" Operand: ");
+            __debug_parser_print_ast_stmt_operand(ast, stmt);
+        }
+        else if (stmt->type == NODE_STRING)
+            printf(" String: \033[33m%s\033[0m", AST_STRING(ast, stmt));
+        else if (stmt->type == NODE_DECL_VAR)
+            printf(" Variable declared: %s", stmt->identifier->name);
+        else if (stmt->type == NODE_EXPR_ASSIGNMENT)
+            printf(" Assignment: %s = #%u", AST_NODE(ast, stmt->assignee)->symbol->name, stmt->assignment_value);
+        else if (stmt->type == NODE_EXPR_BINARY)
         {
             printf(" Binary expression: ");
-            __debug_parser_print_ast_stmt_binop(&prog->body[i]);
+            __debug_parser_print_ast_stmt_binop(ast, stmt);
             printf("\n");
         }
         else
@@ -156,57 +194,68 @@ static lex_token_t parser_expect(lex_tokentype_t tokentype, const char *error_fm
     }
 
     return token;
-} 
+}
 
-ast_stmt parser_parse_primary_expr()
+ast_ref_t parser_parse_primary_expr()
 {
-    ast_stmt stmt;
+    ast_ref_t stmt = AST_NONE;
     lex_token_t token = parser_at();
 
     switch (token.type)
     {
         case T_IDENTIFIER:
-            stmt.type = NODE_IDENTIFIER;
-            stmt.line = parser_line();
-            stmt.symbol = parser_shift().value;
+            stmt = parser_node(NODE_IDENTIFIER, parser_line());
+            NODE(stmt)->symbol = parser_shift().atom;
         break;
-    
-        case T_STRING:
-            stmt.type = NODE_STRING;
-            stmt.line = parser_line();
-            stmt.strval = parser_shift().value;
+
+        case T_STRING: {
+            stmt = parser_node(NODE_STRING, parser_line());
+            char *str = lex_token_unescape(parser_shift());
+            size_t length = strlen(str);
+            uint32_t offset = ast_string_new(conf.ast, str, length);
+
+            NODE(stmt)->str_offset = offset;
+            NODE(stmt)->str_length = length;
+            free(str);
+        }
         break;
 
         case T_NUMBER: {
-            stmt.type = NODE_NUMERIC_LITERAL;
-            stmt.line = parser_line();
-            stmt.value = (long double) atof(parser_at().value);
-            stmt.is_float = strchr(parser_shift().value, '.') != NULL;
+            stmt = parser_node(NODE_NUMERIC_LITERAL, parser_line());
+            lex_token_t number = parser_shift();
+            ast_node_t *node = NODE(stmt);
+
+            /* Integers too wide for int64_t fall back to float. */
+            node->is_float = memchr(number.value, '.', number.length) != NULL ||
+                !lex_token_integer(number, &node->intval);
+
+            if (node->is_float)
+                node->floatval = lex_token_number(number);
         }
         break;
 
         case T_PAREN_OPEN:
         {
             parser_shift();
-            ast_stmt stmt = parser_parse_expr();
-            stmt.line = parser_line();
+            ast_ref_t stmt = parser_parse_expr();
+            NODE(stmt)->line = parser_line();
             parser_expect(T_PAREN_CLOSE, "Unexpcted token found. Expecting ')' (T_PAREN_CLOSE)\n");
             return stmt;
         }
         break;
 
         default:
-            parser_error(true, "Unexpected token '%s' found (%d)", token.value, token.type);
+            parser_error(true, "Unexpected token '%.*s' found (%d)", (int) token.length, token.value, token.type);
             parser_shift();
         break;
-    } 
+    }
 
     return stmt;
 }
 
 static ast_operator_t parser_char_to_operator(char c)
 {
-    switch (c) 
+    switch (c)
     {
         case '+':
             return OP_PLUS;
@@ -226,14 +275,14 @@ static ast_operator_t parser_char_to_operator(char c)
     }
 }
 
-static ast_stmt parser_parse_member_expr()
+static ast_ref_t parser_parse_member_expr()
 {
-    ast_stmt object = parser_parse_primary_expr();
+    ast_ref_t object = parser_parse_primary_expr();
 
     while (parser_at().type == T_DOT || parser_at().type == T_ARRAY_BRACKET_OPEN)
     {
         lex_tokentype_t operator = parser_shift().type;
-        ast_stmt prop;
+        ast_ref_t prop;
         bool computed;
 
         if (operator == T_DOT)
@@ -241,69 +290,60 @@ static ast_stmt parser_parse_member_expr()
             computed = false;
             prop = parser_parse_primary_expr();
 
-            if (prop.type != NODE_IDENTIFIER)
+            if (NODE(prop)->type != NODE_IDENTIFIER)
             {
                 parser_error(true, "Cannot use dot operator without an identifier on the right side");
             }
         }
-        else 
+        else
         {
             computed = true;
             prop = parser_parse_expr();
             parser_expect(T_ARRAY_BRACKET_CLOSE, "Expected closing brackets ']' after computed property access");
         }
 
-        ast_stmt *object_heap = xmalloc(sizeof object);
-        ast_stmt *prop_heap = xmalloc(sizeof prop);
+        ast_ref_t member = parser_node(NODE_EXPR_MEMBER_ACCESS, 0);
 
-        memcpy(object_heap, &object, sizeof object);
-        memcpy(prop_heap, &prop, sizeof prop);
+        NODE(member)->object = object;
+        NODE(member)->prop = prop;
+        NODE(member)->computed = computed;
 
-        object = (ast_stmt) {
-            .type = NODE_EXPR_MEMBER_ACCESS,
-            .object = object_heap,
-            .prop = prop_heap,
-            .computed = computed
-        };
+        object = member;
     }
 
     return object;
 }
 
-static void parser_parse_argument_list(vector_t *vector)
+static void parser_parse_argument_list()
 {
-    VEC_PUSH((*vector), parser_parse_assignment_expr(), ast_stmt);
+    parser_list_push(parser_parse_assignment_expr());
 
-    while (!parser_eof() && parser_at().type == T_COMMA) 
+    while (!parser_eof() && parser_at().type == T_COMMA)
     {
         parser_shift();
-        VEC_PUSH((*vector), parser_parse_assignment_expr(), ast_stmt);
+        parser_list_push(parser_parse_assignment_expr());
     }
 }
 
-/* Returns a vector of ast_stmt. */
-static vector_t parser_parse_args()
+static ast_list_t parser_parse_args()
 {
     parser_expect(T_PAREN_OPEN, "Expected open parenthesis");
-    vector_t vector = VEC_INIT;
-    
+    size_t mark = conf.stack_size;
+
     if (parser_at().type != T_PAREN_CLOSE)
-        parser_parse_argument_list(&vector);
+        parser_parse_argument_list();
 
     parser_expect(T_PAREN_CLOSE, "Expected closing parenthesis after function argument list");
-    return vector;
+    return parser_list_end(mark);
 }
 
-static ast_stmt parser_parse_call_expr(ast_stmt callee)
+static ast_ref_t parser_parse_call_expr(ast_ref_t callee)
 {
-    ast_stmt call_expr = {
-        .type = NODE_EXPR_CALL,
-        .args = parser_parse_args()
-    };
+    ast_list_t args = parser_parse_args();
+    ast_ref_t call_expr = parser_node(NODE_EXPR_CALL, 0);
 
-    call_expr.callee = xmalloc(sizeof callee);
-
-    memcpy(call_expr.callee, &callee, sizeof callee);
+    NODE(call_expr)->callee = callee;
+    NODE(call_expr)->args = args;
 
     if (parser_at().type == T_PAREN_OPEN)
         call_expr = parser_parse_call_expr(call_expr);
@@ -311,9 +351,9 @@ static ast_stmt parser_parse_call_expr(ast_stmt callee)
     return call_expr;
 }
 
-static ast_stmt parser_parse_call_member_expr()
+static ast_ref_t parser_parse_call_member_expr()
 {
-    ast_stmt member = parser_parse_member_expr();
+    ast_ref_t member = parser_parse_member_expr();
 
     if (parser_at().type == T_PAREN_OPEN)
         return parser_parse_call_expr(member);
@@ -321,321 +361,268 @@ static ast_stmt parser_parse_call_member_expr()
     return member;
 }
 
-static ast_stmt parser_parse_unary_expr()
+static ast_ref_t parser_parse_unary_expr()
 {
     size_t line;
 
-    if (conf.lexer_data.size > 1 && conf.lexer_data.tokens[1].type == T_UNARY_OPERATOR)
+    if (parser_peek(1).type == T_UNARY_OPERATOR)
     {
-        if (STREQ(conf.lexer_data.tokens[1].value, "++") || STREQ(conf.lexer_data.tokens[1].value, "--"))
+        if (LEX_TOKEN_IS(parser_peek(1), "++") || LEX_TOKEN_IS(parser_peek(1), "--"))
         {
             if (parser_at().type != T_IDENTIFIER)
                 parser_error(true, "Expression must be a modifiable lvalue");
 
-            ast_stmt left = parser_parse_call_member_expr();
+            line = parser_line();
+            ast_ref_t left = parser_parse_call_member_expr();
+            ast_ref_t ret = parser_node(NODE_EXPR_UNARY, line);
 
-            ast_stmt ret = {
-                .type = NODE_EXPR_UNARY,
-                .right = xmalloc(sizeof left),
-                .operator = STREQ(parser_at().value, "++") ? OP_POST_INCREMENT : (
-                    STREQ(parser_at().value, "--") ? OP_POST_DECREMENT : OP_POST_DECREMENT
-                ),
-                .line = line
-            };
+            NODE(ret)->right = left;
+            NODE(ret)->operator = LEX_TOKEN_IS(parser_at(), "++") ? OP_POST_INCREMENT : (
+                LEX_TOKEN_IS(parser_at(), "--") ? OP_POST_DECREMENT : OP_POST_DECREMENT
+            );
 
             parser_shift();
 
             while (!parser_eof() && parser_at().type == T_SEMICOLON)
                 parser_shift();
-            
-            memcpy(ret.right, &left, sizeof left);
+
             return ret;
         }
     }
 
-    if (parser_at().type != T_UNARY_OPERATOR || 
+    if (parser_at().type != T_UNARY_OPERATOR ||
         (
-            parser_at().value[0] != '+' && 
-            parser_at().value[0] != '-' && 
+            parser_at().value[0] != '+' &&
+            parser_at().value[0] != '-' &&
             parser_at().value[0] != '!' &&
-            !STREQ(parser_at().value, "++") &&
-            !STREQ(parser_at().value, "--")))
+            !LEX_TOKEN_IS(parser_at(), "++") &&
+            !LEX_TOKEN_IS(parser_at(), "--")))
     {
         return parser_parse_call_member_expr();
     }
 
-    char *full_operator = parser_shift().value;
-    char operator = full_operator[0];
+    lex_token_t full_operator = parser_shift();
+    char operator = full_operator.value[0];
     line = parser_line();
-    ast_stmt right = parser_parse_call_member_expr();
-
-    ast_stmt ret = {
-        .type = NODE_EXPR_UNARY,
-        .right = xmalloc(sizeof right),
-        .operator = STREQ(full_operator, "++") ? OP_PRE_INCREMENT : (
-            STREQ(full_operator, "--") ? OP_PRE_DECREMENT : (
-                operator == '+' ? OP_PLUS : operator == '-' ? OP_MINUS : OP_LOGICAL_NOT
-            )
-        ),
-        .line = line
-    };
+    ast_ref_t right = parser_parse_call_member_expr();
+    ast_ref_t ret = parser_node(NODE_EXPR_UNARY, line);
+
+    NODE(ret)->right = right;
+    NODE(ret)->operator = LEX_TOKEN_IS(full_operator, "++") ? OP_PRE_INCREMENT : (
+        LEX_TOKEN_IS(full_operator, "--") ? OP_PRE_DECREMENT : (
+            operator == '+' ? OP_PLUS : operator == '-' ? OP_MINUS : OP_LOGICAL_NOT
+        )
+    );
 
     while (!parser_eof() && parser_at().type == T_SEMICOLON)
         parser_shift();
 
-    memcpy(ret.right, &right, sizeof right);
-
     return ret;
 }
 
-static ast_stmt parser_parse_multiplicative_expr()
+static ast_ref_t parser_binop(ast_ref_t left, ast_ref_t right, ast_operator_t operator, size_t line)
+{
+    ast_ref_t binop = parser_node(NODE_EXPR_BINARY, line);
+
+    NODE(binop)->left = left;
+    NODE(binop)->right = right;
+    NODE(binop)->operator = operator;
+
+    return binop;
+}
+
+static ast_ref_t parser_parse_multiplicative_expr()
 {
-    ast_stmt left = parser_parse_unary_expr();
+    ast_ref_t left = parser_parse_unary_expr();
     size_t line;
 
-    while (conf.lexer_data.size > 0 && conf.lexer_data.tokens[0].type == T_BINARY_OPERATOR &&
-        (conf.lexer_data.tokens[0].value[0] == '/' || 
-            conf.lexer_data.tokens[0].value[0] == '*' || 
-                conf.lexer_data.tokens[0].value[0] == '%')) 
+    while (parser_at().type == T_BINARY_OPERATOR &&
+        (parser_at().value[0] == '/' ||
+            parser_at().value[0] == '*' ||
+                parser_at().value[0] == '%'))
     {
         line = parser_line();
 
         char operator = parser_shift().value[0];
-        ast_stmt right = parser_parse_unary_expr();
+        ast_ref_t right = parser_parse_unary_expr();
 
-        ast_stmt binop = {
-            .type = NODE_EXPR_BINARY,
-            .operator = parser_char_to_operator(operator),
-            .line = line
-        };
-
-        binop.left = xmalloc(sizeof (ast_stmt));
-        memcpy(binop.left, &left, sizeof left);
-
-        binop.right = xmalloc(sizeof (ast_stmt));
-        memcpy(binop.right, &right, sizeof right);
-
-        left = binop;
-    } 
+        left = parser_binop(left, right, parser_char_to_operator(operator), line);
+    }
 
     return left;
 }
 
-static ast_stmt parser_parse_additive_expr()
+static ast_ref_t parser_parse_additive_expr()
 {
-    ast_stmt left = parser_parse_multiplicative_expr();
+    ast_ref_t left = parser_parse_multiplicative_expr();
     size_t line;
 
-    while (conf.lexer_data.size > 0 && conf.lexer_data.tokens[0].type == T_BINARY_OPERATOR &&
-        (conf.lexer_data.tokens[0].value[0] == '+' || 
-            conf.lexer_data.tokens[0].value[0] == '-')) 
+    while (parser_at().type == T_BINARY_OPERATOR &&
+        (parser_at().value[0] == '+' ||
+            parser_at().value[0] == '-'))
     {
         line = parser_line();
 
         char operator = parser_shift().value[0];
-        ast_stmt right = parser_parse_multiplicative_expr();
+        ast_ref_t right = parser_parse_multiplicative_expr();
 
-        ast_stmt binop = {
-            .type = NODE_EXPR_BINARY,
-            .operator = parser_char_to_operator(operator),
-            .line = line
-        };
-
-        binop.left = xmalloc(sizeof (ast_stmt));
-        memcpy(binop.left, &left, sizeof left);
-
-        binop.right = xmalloc(sizeof (ast_stmt));
-        memcpy(binop.right, &right, sizeof right);
-
-        left = binop;
-    } 
+        left = parser_binop(left, right, parser_char_to_operator(operator), line);
+    }
 
     return left;
 }
 
-static ast_stmt parser_parse_comparison_expr()
+static ast_ref_t parser_parse_comparison_expr()
 {
-    ast_stmt left = parser_parse_additive_expr();
+    ast_ref_t left = parser_parse_additive_expr();
     size_t line;
 
-    while (conf.lexer_data.size > 0 && conf.lexer_data.tokens[0].type == T_BINARY_OPERATOR &&
-        (STREQ(parser_at().value, "==") ||
-         STREQ(parser_at().value, "===") ||
-         STREQ(parser_at().value, "<") ||
-         STREQ(parser_at().value, "<=") ||
-         STREQ(parser_at().value, ">=") ||
-         STREQ(parser_at().value, ">"))) 
+    while (parser_at().type == T_BINARY_OPERATOR &&
+        (LEX_TOKEN_IS(parser_at(), "==") ||
+         LEX_TOKEN_IS(parser_at(), "===") ||
+         LEX_TOKEN_IS(parser_at(), "<") ||
+         LEX_TOKEN_IS(parser_at(), "<=") ||
+         LEX_TOKEN_IS(parser_at(), ">=") ||
+         LEX_TOKEN_IS(parser_at(), ">")))
     {
         line = parser_line();
 
-        char *operator = parser_shift().value;
-        ast_stmt right = parser_parse_additive_expr();
-
-        ast_stmt binop = {
-            .type = NODE_EXPR_BINARY,
-            .operator = STREQ(operator, "==") ? OP_CMP_EQUALS : (
-                STREQ(operator, "<") ? OP_CMP_LESS_THAN : (
-                    STREQ(operator, "<=") ? OP_CMP_LESS_THAN_EQUALS : (
-                        STREQ(operator, ">") ? OP_CMP_GREATER_THAN : (
-                            STREQ(operator, ">=") ? OP_CMP_GREATER_THAN_EQUALS : (
-                                STREQ(operator, "===") ? OP_CMP_EQUALS_STRICT : OP_CMP_EQUALS_STRICT
-                            )
+        lex_token_t operator = parser_shift();
+        ast_ref_t right = parser_parse_additive_expr();
+
+        left = parser_binop(left, right, LEX_TOKEN_IS(operator, "==") ? OP_CMP_EQUALS : (
+            LEX_TOKEN_IS(operator, "<") ? OP_CMP_LESS_THAN : (
+                LEX_TOKEN_IS(operator, "<=") ? OP_CMP_LESS_THAN_EQUALS : (
+                    LEX_TOKEN_IS(operator, ">") ? OP_CMP_GREATER_THAN : (
+                        LEX_TOKEN_IS(operator, ">=") ? OP_CMP_GREATER_THAN_EQUALS : (
+                            LEX_TOKEN_IS(operator, "===") ? OP_CMP_EQUALS_STRICT : OP_CMP_EQUALS_STRICT
                         )
                     )
                 )
-            ),
-            .line = line
-        };
-
-        binop.left = xmalloc(sizeof (ast_stmt));
-        memcpy(binop.left, &left, sizeof left);
-
-        binop.right = xmalloc(sizeof (ast_stmt));
-        memcpy(binop.right, &right, sizeof right);
-
-        left = binop;
-    } 
+            )
+        ), line);
+    }
 
     return left;
 }
 
-static ast_stmt parser_parse_bin_logical_expr()
+static ast_ref_t parser_parse_bin_logical_expr()
 {
-    ast_stmt left = parser_parse_comparison_expr();
+    ast_ref_t left = parser_parse_comparison_expr();
     size_t line;
 
-    while (conf.lexer_data.size > 0 && conf.lexer_data.tokens[0].type == T_BINARY_OPERATOR &&
-        (conf.lexer_data.tokens[0].value[0] == '&' || 
-            conf.lexer_data.tokens[0].value[0] == '|')) 
+    while (parser_at().type == T_BINARY_OPERATOR &&
+        (parser_at().value[0] == '&' ||
+            parser_at().value[0] == '|'))
     {
         line = parser_line();
 
         char operator = parser_shift().value[0];
-        ast_stmt right = parser_parse_comparison_expr();
-
-        ast_stmt binop = {
-            .type = NODE_EXPR_BINARY,
-            .operator = operator == '|' ? OP_LOGICAL_OR : OP_LOGICAL_AND,
-            .line = line
-        };
-
-        binop.left = xmalloc(sizeof (ast_stmt));
-        memcpy(binop.left, &left, sizeof left);
-
-        binop.right = xmalloc(sizeof (ast_stmt));
-        memcpy(binop.right, &right, sizeof right);
+        ast_ref_t right = parser_parse_comparison_expr();
 
-        left = binop;
-    } 
+        left = parser_binop(left, right, operator == '|' ? OP_LOGICAL_OR : OP_LOGICAL_AND, line);
+    }
 
     return left;
 }
 
-ast_stmt parser_parse_object_expr()
+ast_ref_t parser_parse_object_expr()
 {
     if (parser_at().type != T_BLOCK_BRACE_OPEN)
         return parser_parse_bin_logical_expr();
 
     parser_shift();
-    
-    vector_t properties = VEC_INIT; /* Vector of ast_stmt */
+
+    size_t mark = conf.stack_size;
 
     while (!parser_eof() && parser_at().type != T_BLOCK_BRACE_CLOSE)
     {
-        char *key = parser_expect(T_IDENTIFIER, "Expected object key identifier").value;
+        atom_t *key = parser_expect(T_IDENTIFIER, "Expected object key identifier").atom;
+        ast_ref_t value = AST_NONE;
 
         if (parser_at().type == T_COMMA || parser_at().type == T_BLOCK_BRACE_CLOSE)
         {
             if (parser_at().type == T_COMMA)
                 parser_shift();
-
-            VEC_PUSH(properties, ((ast_stmt) {
-                .type = NODE_PROPERTY_LITERAL,
-                .key = key,
-                .propval = NULL
-            }), ast_stmt);
-
-            continue;
+        }
+        else
+        {
+            parser_expect(T_COLON, "Expected colon after object property name");
+            value = parser_parse_expr();
         }
 
-        parser_expect(T_COLON, "Expected colon after object property name");
+        ast_ref_t prop = parser_node(NODE_PROPERTY_LITERAL, 0);
 
-        ast_stmt value = parser_parse_expr();
-        ast_stmt *value_heap = xmalloc(sizeof value);
+        NODE(prop)->key = key;
+        NODE(prop)->propval = value;
+        parser_list_push(prop);
 
-        memcpy(value_heap, &value, sizeof value);
+        if (value == AST_NONE)
+            continue;
 
-        VEC_PUSH(properties, ((ast_stmt) {
-            .type = NODE_PROPERTY_LITERAL,
-            .key = key,
-            .propval = value_heap
-        }), ast_stmt);
-    
         if (parser_at().type != T_BLOCK_BRACE_CLOSE)
             parser_expect(T_COMMA, "Expected ending comma ',' or closing braces '}' after object literal");
     }
 
     parser_expect(T_BLOCK_BRACE_CLOSE, "Expected closing brace '}' after object literal");
 
-    return (ast_stmt) {
-        .type = NODE_OBJECT_LITERAL,
-        .properties = properties
-    };
+    ast_list_t properties = parser_list_end(mark);
+    ast_ref_t object = parser_node(NODE_OBJECT_LITERAL, 0);
+
+    NODE(object)->properties = properties;
+    return object;
 }
 
-ast_stmt parser_parse_assignment_expr_orig(bool semicolon)
+ast_ref_t parser_parse_assignment_expr_orig(bool semicolon)
 {
-    ast_stmt left = parser_parse_object_expr();
+    callstack_check();
+
+    ast_ref_t left = parser_parse_object_expr();
     size_t line = parser_line();
 
-    if (parser_at().type == T_ASSIGNMENT) 
+    if (parser_at().type == T_ASSIGNMENT)
     {
         parser_shift();
-        ast_stmt val = parser_parse_assignment_expr_orig(semicolon);
+        ast_ref_t val = parser_parse_assignment_expr_orig(semicolon);
 
-        if (val.type != NODE_EXPR_ASSIGNMENT)
+        if (NODE(val)->type != NODE_EXPR_ASSIGNMENT)
         {
             if (semicolon)
                 parser_expect(T_SEMICOLON, "Expected semicolon (T_SEMICOLON) after assignment");
         }
 
-        ast_stmt *val_heap = xmalloc(sizeof (ast_stmt)),
-                 *left_heap = xmalloc(sizeof (ast_stmt));
+        ast_ref_t assignment = parser_node(NODE_EXPR_ASSIGNMENT, line);
 
-        memcpy(val_heap, &val, sizeof val);
-        memcpy(left_heap, &left, sizeof left);
+        NODE(assignment)->assignee = left;
+        NODE(assignment)->assignment_value = val;
 
-        return (ast_stmt) {
-            .type = NODE_EXPR_ASSIGNMENT,
-            .assignee = left_heap,
-            .assignment_value = val_heap,
-            .line = line
-        };
+        return assignment;
     }
 
     return left;
 }
 
-ast_stmt parser_parse_assignment_expr() 
+ast_ref_t parser_parse_assignment_expr()
 {
     return parser_parse_assignment_expr_orig(true);
 }
 
-ast_stmt parser_parse_expr()
+ast_ref_t parser_parse_expr()
 {
     return parser_parse_assignment_expr();
 }
 
-ast_stmt parser_parse_expr_assignment_orig(bool semicolon)
+ast_ref_t parser_parse_expr_assignment_orig(bool semicolon)
 {
     return parser_parse_assignment_expr_orig(semicolon);
 }
 
-ast_stmt parser_parse_var_decl()
+ast_ref_t parser_parse_var_decl()
 {
     bool is_const = parser_shift().type == T_CONST;
-    char *identifier = parser_expect(T_IDENTIFIER, "Expected identifier after %s (%s)\n", is_const ? "const" : "var", is_const ? "T_CONST" : "T_VAR").value;
+    atom_t *identifier = parser_expect(T_IDENTIFIER, "Expected identifier after %s (%s)\n", is_const ? "const" : "var", is_const ? "T_CONST" : "T_VAR").atom;
     size_t line = parser_line();
+    ast_ref_t val = AST_NONE;
 
     if (parser_at().type == T_SEMICOLON)
     {
@@ -643,215 +630,177 @@ ast_stmt parser_parse_var_decl()
 
         if (is_const)
             parser_error(true, "Unexpected semicolon, expected an assignment to constant declaration");
+    }
+    else
+    {
+        parser_expect(T_ASSIGNMENT, "Expected assignment operator '=' (T_ASSIGNMENT)%s after %s (%s) name",
+            !is_const ? " or ';' (T_SEMICOLON)" : "", is_const ? "constant" : "variable", is_const ? "T_CONST" : "T_VAR");
 
-        return (ast_stmt) {
-            .type = NODE_DECL_VAR,
-            .is_const = is_const,
-            .identifier = identifier,
-            .has_val = false,
-            .line = line
-        };
+        val = parser_parse_expr();
+
+        parser_expect(T_SEMICOLON, "Unexpected %s after %s (%s) declaration", lex_token_stringify(parser_at(), true), is_const ? "constant" : "variable", is_const ? "T_CONST" : "T_VAR");
     }
 
-    parser_expect(T_ASSIGNMENT, "Expected assignment operator '=' (T_ASSIGNMENT)%s after %s (%s) name", 
-        !is_const ? " or ';' (T_SEMICOLON)" : "", is_const ? "constant" : "variable", is_const ? "T_CONST" : "T_VAR");
-    
-    ast_stmt vardecl = {
-        .type = NODE_DECL_VAR,
-        .is_const = is_const,
-        .identifier = identifier,
-        .has_val = true,
-        .line = line
-    };
-
-    ast_stmt val = parser_parse_expr();
-    
-    parser_expect(T_SEMICOLON, "Unexpected %s after %s (%s) declaration", lex_token_stringify(parser_at(), true), is_const ? "constant" : "variable", is_const ? "T_CONST" : "T_VAR");
-    
-    vardecl.varval = xmalloc(sizeof (ast_stmt));
-    memcpy(vardecl.varval, &val, sizeof val);
+    ast_ref_t vardecl = parser_node(NODE_DECL_VAR, line);
+
+    NODE(vardecl)->is_const = is_const;
+    NODE(vardecl)->identifier = identifier;
+    NODE(vardecl)->varval = val;
 
     return vardecl;
 }
 
-ast_stmt parser_parse_function_decl()
+/* Parses statements up to (not including) the closing brace. */
+static ast_list_t parser_parse_block_body()
 {
-    parser_shift();
-
-    char *name = parser_expect(T_IDENTIFIER, "Expected identifier after function keyword").value;
-    vector_t args = parser_parse_args(); /* Vector of ast_stmt. */
-    vector_t argnames = VEC_INIT; /* Vector of (char *). */
-    ast_stmt *body = NULL; 
-    size_t size = 0;
+    size_t mark = conf.stack_size;
 
-    for (size_t i = 0; i < args.length; i++)
+    while (!parser_eof() && parser_at().type != T_BLOCK_BRACE_CLOSE)
     {
-        if (VEC_GET(args, i, ast_stmt).type != NODE_IDENTIFIER)
-            parser_error(true, "Expected identifiers inside parenthesis");
+        ast_ref_t stmt = parser_parse_stmt();
 
-        VEC_PUSH(argnames, VEC_GET(args, i, ast_stmt).symbol, char *);
+        if (NODE(stmt)->type == NODE_EXPR_CALL && parser_at().type == T_SEMICOLON)
+            parser_shift();
+
+        parser_list_push(stmt);
     }
 
-    VEC_FREE(args);
+    return parser_list_end(mark);
+}
 
-    parser_expect(T_BLOCK_BRACE_OPEN, "Expected open braces after function name and parameters");
+ast_ref_t parser_parse_function_decl()
+{
+    parser_shift();
 
-    while (!parser_eof() && parser_at().type != T_BLOCK_BRACE_CLOSE)
-    {
-        ast_stmt stmt = parser_parse_stmt();
-        
-        if (stmt.type == NODE_EXPR_CALL && parser_at().type == T_SEMICOLON)
-            parser_shift();
+    atom_t *name = parser_expect(T_IDENTIFIER, "Expected identifier after function keyword").atom;
+    ast_list_t argnames = parser_parse_args();
 
-        body = xrealloc(body, sizeof (ast_stmt) * (++size));
-        body[size - 1] = stmt;
+    for (size_t i = 0; i < argnames.count; i++)
+    {
+        if (AST_LIST_NODE(conf.ast, argnames, i)->type != NODE_IDENTIFIER)
+            parser_error(true, "Expected identifiers inside parenthesis");
     }
 
+    parser_expect(T_BLOCK_BRACE_OPEN, "Expected open braces after function name and parameters");
+    ast_list_t body = parser_parse_block_body();
     parser_expect(T_BLOCK_BRACE_CLOSE, "Missing close braces after function body");
-    
-    return (ast_stmt) {
-        .type = NODE_DECL_FUNCTION,
-        .fn_name = name,
-        .argnames = argnames,
-        .size = size,
-        .body = body
-    };
+
+    ast_ref_t fn = parser_node(NODE_DECL_FUNCTION, 0);
+
+    NODE(fn)->fn_name = name;
+    NODE(fn)->argnames = argnames;
+    NODE(fn)->body = body;
+
+    return fn;
 }
 
-ast_stmt parser_parse_return_stmt()
+ast_ref_t parser_parse_return_stmt()
 {
     parser_expect(T_RETURN, "Expected return statement");
-    ast_stmt expr = parser_parse_expr();
+    ast_ref_t expr = parser_parse_expr();
     parser_expect(T_SEMICOLON, "Expected semicolon after return statement");
 
-    ast_stmt ret = {
-        .type = NODE_RETURN,
-        .return_expr = xmalloc(sizeof expr)
-    };
+    ast_ref_t ret = parser_node(NODE_RETURN, 0);
 
-    memcpy(ret.return_expr, &expr, sizeof expr);
+    NODE(ret)->return_expr = expr;
     return ret;
 }
 
-ast_stmt parser_parse_codeblock()
+ast_ref_t parser_parse_codeblock()
 {
-    ast_stmt *body = NULL; 
-    size_t size = 0;
-
     parser_expect(T_BLOCK_BRACE_OPEN, "Expected open braces to start block");
-
-    while (!parser_eof() && parser_at().type != T_BLOCK_BRACE_CLOSE)
-    {
-        ast_stmt stmt = parser_parse_stmt();
-        
-        if (stmt.type == NODE_EXPR_CALL && parser_at().type == T_SEMICOLON)
-            parser_shift();
-
-        body = xrealloc(body, sizeof (ast_stmt) * (++size));
-        body[size - 1] = stmt;
-    }
-
+    ast_list_t body = parser_parse_block_body();
     parser_expect(T_BLOCK_BRACE_CLOSE, "Missing close braces to end block");
 
-    return (ast_stmt) {
-        .type = NODE_BLOCK,
-        .body = body,
-        .size = size,
-        .line = parser_at().line
-    };
+    ast_ref_t block = parser_node(NODE_BLOCK, parser_at().line);
+
+    NODE(block)->body = body;
+    return block;
 }
 
-ast_stmt parser_parse_control_while()
+ast_ref_t parser_parse_control_while()
 {
     parser_shift();
     parser_expect(T_PAREN_OPEN, "Expected open parenthesis after while keyword");
-    ast_stmt cond = parser_parse_expr();
+    ast_ref_t cond = parser_parse_expr();
     parser_expect(T_PAREN_CLOSE, "Expected close parenthesis before while body");
-    
+
     bool is_block = parser_at().type == T_BLOCK_BRACE_OPEN;
-    ast_stmt if_block = is_block ? parser_parse_codeblock() : parser_parse_stmt();
+    ast_ref_t if_block = is_block ? parser_parse_codeblock() : parser_parse_stmt();
 
     while (!is_block && parser_at().type == T_SEMICOLON)
         parser_shift();
 
-    ast_stmt while_loop = {
-        .type = NODE_CTRL_WHILE,
-        .ctrl_body = xmalloc(sizeof (ast_stmt)),
-        .ctrl_cond = xmalloc(sizeof (ast_stmt)),
-        .line = parser_at().line
-    };
+    ast_ref_t while_loop = parser_node(NODE_CTRL_WHILE, parser_at().line);
 
-    memcpy(while_loop.ctrl_cond, &cond, sizeof (ast_stmt));
-    memcpy(while_loop.ctrl_body, &if_block, sizeof (ast_stmt));
+    NODE(while_loop)->ctrl_cond = cond;
+    NODE(while_loop)->ctrl_body = if_block;
 
     return while_loop;
 }
 
-ast_stmt parser_parse_control_loop()
+ast_ref_t parser_parse_control_loop()
 {
-    ast_stmt loop = {
-        .type = NODE_CTRL_LOOP,
-        .ctrl_loop_identifier = NULL
-    };
+    atom_t *ctrl_loop_identifier = NULL;
+    ast_ref_t cond;
 
     parser_shift();
 
-    ast_stmt cond = parser_at().type == T_BLOCK_BRACE_OPEN ? (ast_stmt) {
-        .type = NODE_IDENTIFIER,
-        .symbol = strdup("true")
-    } : parser_parse_expr();
+    if (parser_at().type == T_BLOCK_BRACE_OPEN)
+    {
+        cond = parser_node(NODE_IDENTIFIER, 0);
+        NODE(cond)->symbol = atom_get("true");
+    }
+    else
+        cond = parser_parse_expr();
 
     if (parser_at().type == T_AS)
     {
         parser_shift();
-        loop.ctrl_loop_identifier = parser_expect(T_IDENTIFIER, "Expected identifier after `as' keyword").value;
+        ctrl_loop_identifier = parser_expect(T_IDENTIFIER, "Expected identifier after `as' keyword").atom;
     }
 
     bool is_block = parser_at().type == T_BLOCK_BRACE_OPEN;
-    ast_stmt if_block = is_block ? parser_parse_codeblock() : parser_parse_stmt();
+    ast_ref_t if_block = is_block ? parser_parse_codeblock() : parser_parse_stmt();
 
     while (!is_block && parser_at().type == T_SEMICOLON)
         parser_shift();
 
-    loop.ctrl_body = xmalloc(sizeof (ast_stmt));
-    loop.ctrl_cond = xmalloc(sizeof (ast_stmt));
-    loop.line = parser_at().line;
+    ast_ref_t loop = parser_node(NODE_CTRL_LOOP, parser_at().line);
 
-    memcpy(loop.ctrl_cond, &cond, sizeof (ast_stmt));
-    memcpy(loop.ctrl_body, &if_block, sizeof (ast_stmt));
+    NODE(loop)->ctrl_cond = cond;
+    NODE(loop)->ctrl_body = if_block;
+    NODE(loop)->ctrl_loop_identifier = ctrl_loop_identifier;
 
     return loop;
 }
 
-#define NODE_UNKNOWN_INIT { .type = NODE_UNKNOWN }
-#define IS_UNKNOWN(node) ((node).type == NODE_UNKNOWN)
-
-ast_stmt parser_parse_control_for()
+ast_ref_t parser_parse_control_for()
 {
-    ast_stmt init = NODE_UNKNOWN_INIT,  
-             cond = NODE_UNKNOWN_INIT,
-             incdec = NODE_UNKNOWN_INIT;
-    
+    ast_ref_t init = AST_NONE,
+              cond = AST_NONE,
+              incdec = AST_NONE;
+
     parser_shift();
     parser_expect(T_PAREN_OPEN, "Expected open parenthesis after for keyword");
 
-    if (parser_at().type == T_SEMICOLON) 
+    if (parser_at().type == T_SEMICOLON)
         parser_shift();
-    else 
+    else
     {
         init = parser_at().type == T_VAR || parser_at().type == T_CONST ? parser_parse_var_decl() : parser_parse_expr_assignment_orig(false);
 
-        if (init.type != NODE_DECL_VAR)
+        if (NODE(init)->type != NODE_DECL_VAR)
             parser_expect(T_SEMICOLON, "Expected semicolon after for loop initialization");
     }
 
-    if (parser_at().type == T_SEMICOLON) 
+    if (parser_at().type == T_SEMICOLON)
         parser_shift();
-    else 
+    else
     {
         cond = parser_parse_expr_assignment_orig(false);
 
-        if (cond.type != NODE_EXPR_ASSIGNMENT)
+        if (NODE(cond)->type != NODE_EXPR_ASSIGNMENT)
             parser_expect(T_SEMICOLON, "Expected semicolon after for loop condition");
     }
 
@@ -859,67 +808,49 @@ ast_stmt parser_parse_control_for()
         incdec = parser_parse_expr_assignment_orig(false);
 
     parser_expect(T_PAREN_CLOSE, "Expected close parenthesis before for body");
-    
+
     bool is_block = parser_at().type == T_BLOCK_BRACE_OPEN;
-    ast_stmt block = is_block ? parser_parse_codeblock() : parser_parse_stmt();
+    ast_ref_t block = is_block ? parser_parse_codeblock() : parser_parse_stmt();
 
     while (!is_block && parser_at().type == T_SEMICOLON)
         parser_shift();
 
-    ast_stmt for_loop = {
-        .type = NODE_CTRL_FOR,
-        .for_body = xmalloc(sizeof (ast_stmt)),
-        .for_cond = IS_UNKNOWN(cond) ? NULL : xmalloc(sizeof (ast_stmt)),
-        .for_incdec = IS_UNKNOWN(incdec) ? NULL : xmalloc(sizeof (ast_stmt)),
-        .for_init = IS_UNKNOWN(init) ? NULL : xmalloc(sizeof (ast_stmt)),
-        .line = parser_at().line
-    };
+    ast_ref_t for_loop = parser_node(NODE_CTRL_FOR, parser_at().line);
+    ast_node_t *node = NODE(for_loop);
 
-    if (for_loop.for_init != NULL)
-        memcpy(for_loop.for_init, &init, sizeof (ast_stmt));
-
-    if (for_loop.for_cond)
-        memcpy(for_loop.for_cond, &cond, sizeof (ast_stmt));
-        
-    if (for_loop.for_incdec)
-        memcpy(for_loop.for_incdec, &incdec, sizeof (ast_stmt));
-
-    memcpy(for_loop.for_body, &block, sizeof (ast_stmt));
+    node->for_body = block;
+    node->for_init = init;
+    node->for_cond = cond;
+    node->for_incdec = incdec;
 
     return for_loop;
 }
 
-ast_stmt parser_parse_control_if()
+ast_ref_t parser_parse_control_if()
 {
     parser_shift();
     parser_expect(T_PAREN_OPEN, "Expected open parenthesis after if keyword");
-    ast_stmt cond = parser_parse_expr();
+    ast_ref_t cond = parser_parse_expr();
     parser_expect(T_PAREN_CLOSE, "Expected close parenthesis before if body");
-    
+
     bool is_if_block = parser_at().type == T_BLOCK_BRACE_OPEN;
-    ast_stmt if_block = is_if_block ? parser_parse_codeblock() : parser_parse_stmt();
+    ast_ref_t if_block = is_if_block ? parser_parse_codeblock() : parser_parse_stmt();
 
     while (!is_if_block && parser_at().type == T_SEMICOLON)
         parser_shift();
 
-    ast_stmt if_cond = {
-        .type = NODE_CTRL_IF,
-        .ctrl_body = xmalloc(sizeof (ast_stmt)),
-        .ctrl_cond = xmalloc(sizeof (ast_stmt)),
-        .else_body = NULL,
-        .line = parser_at().line
-    };
+    ast_ref_t if_cond = parser_node(NODE_CTRL_IF, parser_at().line);
 
-    memcpy(if_cond.ctrl_cond, &cond, sizeof (ast_stmt));
-    memcpy(if_cond.ctrl_body, &if_block, sizeof (ast_stmt));
+    NODE(if_cond)->ctrl_cond = cond;
+    NODE(if_cond)->ctrl_body = if_block;
+    NODE(if_cond)->else_body = AST_NONE;
 
     if (parser_at().type == T_ELSE)
-    {        
+    {
         parser_shift();
         bool is_else_block = parser_at().type == T_BLOCK_BRACE_OPEN;
-        ast_stmt else_block = parser_at().type == T_BLOCK_BRACE_OPEN ? parser_parse_codeblock() : parser_parse_stmt();
-        if_cond.else_body = xmalloc(sizeof (ast_stmt));
-        memcpy(if_cond.else_body, &else_block, sizeof (ast_stmt));
+        ast_ref_t else_block = parser_at().type == T_BLOCK_BRACE_OPEN ? parser_parse_codeblock() : parser_parse_stmt();
+        NODE(if_cond)->else_body = else_block;
 
         while (!is_else_block && parser_at().type == T_SEMICOLON)
             parser_shift();
@@ -934,8 +865,10 @@ void parser_shift_semicolons()
         parser_shift();
 }
 
-ast_stmt parser_parse_stmt()
+ast_ref_t parser_parse_stmt()
 {
+    callstack_check();
+
     switch (parser_at().type)
     {
         case T_VAR:
@@ -953,7 +886,7 @@ ast_stmt parser_parse_stmt()
 
         case T_LOOP:
             return parser_parse_control_loop();
-        
+
         case T_FOR:
             return parser_parse_control_for();
 
@@ -963,9 +896,7 @@ ast_stmt parser_parse_stmt()
             lex_tokentype_t type = parser_shift().type;
             parser_shift_semicolons();
 
-            return (ast_stmt) {
-                .type = type == T_BREAK ? NODE_CTRL_BREAK : NODE_CTRL_CONTINUE
-            };
+            return parser_node(type == T_BREAK ? NODE_CTRL_BREAK : NODE_CTRL_CONTINUE, 0);
         }
 
         case T_RETURN:
@@ -976,20 +907,17 @@ ast_stmt parser_parse_stmt()
     }
 }
 
-ast_stmt parser_create_ast(char *code)
+void parser_create_ast(ast_t *ast, const char *code, size_t length)
 {
-    ast_stmt prog = {
-        .type = NODE_PROGRAM,
-        .body = NULL,
-        .size = 0
-    };
+    ast_init(ast);
 
-    conf.lexer_data = (lex_t) LEX_INIT;
-    lex_tokenize(&conf.lexer_data, code);
+    lex_init(&conf.lexer, code, length);
+    conf.eof_shifted = false;
+    conf.ast = ast;
 
 #ifndef _NODEBUG
 #ifdef _DEBUG
-    __debug_lex_print_token_array(&conf.lexer_data);
+    __debug_lex_print_tokens(code, length);
 #endif
 #endif
 
@@ -1000,13 +928,16 @@ ast_stmt parser_create_ast(char *code)
             parser_shift();
             continue;
         }
-        
-        ast_stmt stmt = parser_parse_stmt();
-        prog.body = xrealloc(prog.body, sizeof (ast_stmt) * (prog.size + 1));
-        prog.body[prog.size++] = stmt;
+
+        parser_list_push(parser_parse_stmt());
     }
 
-    lex_free(&conf.lexer_data);
+    ast_list_t body = parser_list_end(0);
+
+    ast->root = parser_node(NODE_PROGRAM, 0);
+    NODE(ast->root)->body = body;
 
-    return prog;
+    xnfree(conf.stack);
+    conf.stack_size = conf.stack_capacity = 0;
+    conf.ast = NULL;
 }
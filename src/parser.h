@@ -3,13 +3,13 @@
 
 #include "ast.h"
 
-ast_stmt parser_create_ast(char *code);
-ast_stmt parser_parse_expr();
-ast_stmt parser_parse_assignment_expr();
-ast_stmt parser_parse_stmt();
+void parser_create_ast(ast_t *ast, const char *code, size_t length);
+ast_ref_t parser_parse_expr();
+ast_ref_t parser_parse_assignment_expr();
+ast_ref_t parser_parse_stmt();
 
 #ifdef _DEBUG
-void __debug_parser_print_ast_stmt(ast_stmt *prog);
+void __debug_parser_print_ast_stmt(ast_t *ast);
 #endif
 
 #endif
@@ -0,0 +1,336 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "resolver.h"
+#include "ast.h"
+#include "atom.h"
+#include "callstack.h"
+#include "scope.h"
+#include "utils.h"
+#include "xmalloc.h"
+
+#define RESOLVER_TABLE_INITIAL_SIZE 8
+#define RESOLVER_NOT_FOUND UINT32_MAX
+
+/* Compile-time mirror of a runtime scope. Slots are handed out in order
+   of declaration and looked up through a small open-addressed table of
+   slot numbers (plus one, so that zero means empty). */
+typedef struct resolver_scope {
+    struct resolver_scope *parent;
+    struct resolver_scope *next;                    /* Every scope, for freeing. */
+    atom_t **names;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *table;
+    uint32_t table_size;
+} resolver_scope_t;
+
+typedef struct {
+    ast_ref_t fn;
+    resolver_scope_t *scope;                        /* Where the function was declared. */
+} resolver_deferred_t;
+
+static ast_t *ast = NULL;
+static resolver_scope_t *scopes = NULL;
+static resolver_deferred_t *deferred = NULL;
+static size_t deferred_count = 0;
+static size_t deferred_capacity = 0;
+static atom_t *iteration_atom = NULL;
+
+#define NODE(ref) AST_NODE(ast, (ref))
+
+static void resolve_node(ast_ref_t ref, resolver_scope_t *scope);
+
+static resolver_scope_t *resolver_scope_new(resolver_scope_t *parent)
+{
+    resolver_scope_t *scope = xcalloc(sizeof (resolver_scope_t), 1);
+
+    scope->parent = parent;
+    scope->next = scopes;
+    scopes = scope;
+
+    return scope;
+}
+
+static uint32_t *resolver_table_entry(uint32_t *table, uint32_t size, atom_t **names, atom_t *name)
+{
+    uint32_t mask = size - 1;
+    uint32_t index = name->hash & mask;
+
+    while (table[index] != 0 && names[table[index] - 1] != name)
+        index = (index + 1) & mask;
+
+    return &table[index];
+}
+
+static uint32_t resolver_find(const resolver_scope_t *scope, atom_t *name)
+{
+    if (scope->count == 0)
+        return RESOLVER_NOT_FOUND;
+
+    uint32_t entry = *resolver_table_entry(scope->table, scope->table_size, scope->names, name);
+    return entry == 0 ? RESOLVER_NOT_FOUND : entry - 1;
+}
+
+/* Redeclaring a name reuses its slot, so that the evaluator still reports
+   the redeclaration when it gets there. */
+static uint32_t resolver_declare(resolver_scope_t *scope, atom_t *name)
+{
+    uint32_t slot = resolver_find(scope, name);
+
+    if (slot != RESOLVER_NOT_FOUND)
+        return slot;
+
+    if (scope->count == UINT32_MAX - 1)
+        utils_error(true, "too many declarations in one scope");
+
+    if (scope->count == scope->capacity)
+    {
+        scope->capacity = scope->capacity == 0 ? RESOLVER_TABLE_INITIAL_SIZE / 2 : scope->capacity * 2;
+        scope->names = xrealloc(scope->names, sizeof (atom_t *) * scope->capacity);
+    }
+
+    if ((scope->count + 1) * 2 > scope->table_size)
+    {
+        uint32_t new_size = scope->table_size == 0 ? RESOLVER_TABLE_INITIAL_SIZE : scope->table_size * 2;
+        uint32_t *new_table = xcalloc(sizeof (uint32_t), new_size);
+
+        for (uint32_t i = 0; i < scope->count; i++)
+            *resolver_table_entry(new_table, new_size, scope->names, scope->names[i]) = i + 1;
+
+        free(scope->table);
+        scope->table = new_table;
+        scope->table_size = new_size;
+    }
+
+    slot = scope->count++;
+    scope->names[slot] = name;
+    *resolver_table_entry(scope->table, scope->table_size, scope->names, name) = slot + 1;
+
+    return slot;
+}
+
+static void resolver_lookup(resolver_scope_t *scope, atom_t *name, uint32_t *depth, uint32_t *slot)
+{
+    for (uint32_t d = 0; scope != NULL; d++, scope = scope->parent)
+    {
+        uint32_t found = resolver_find(scope, name);
+
+        if (found != RESOLVER_NOT_FOUND)
+        {
+            *depth = d;
+            *slot = found;
+            return;
+        }
+    }
+
+    *depth = AST_UNRESOLVED;
+    *slot = 0;
+}
+
+static void resolve_list(ast_list_t list, resolver_scope_t *scope)
+{
+    for (uint32_t i = 0; i < list.count; i++)
+        resolve_node(ast->refs[list.start + i], scope);
+}
+
+/* Blocks always get a scope of their own; `loop` blocks declare their
+   counter in it first. */
+static void resolve_block(ast_ref_t ref, resolver_scope_t *parent, atom_t *loop_identifier)
+{
+    resolver_scope_t *scope = resolver_scope_new(parent);
+
+    if (loop_identifier != NULL)
+        resolver_declare(scope, loop_identifier);
+
+    resolve_list(NODE(ref)->body, scope);
+    NODE(ref)->frame_size = scope->count;
+}
+
+/* The body of a control statement only opens a scope when it is a block. */
+static void resolve_ctrl_body(ast_ref_t ref, resolver_scope_t *scope, atom_t *loop_identifier)
+{
+    if (NODE(ref)->type == NODE_BLOCK)
+        resolve_block(ref, scope, loop_identifier);
+    else
+        resolve_node(ref, scope);
+}
+
+static void resolve_defer(ast_ref_t fn, resolver_scope_t *scope)
+{
+    if (deferred_count == deferred_capacity)
+    {
+        deferred_capacity = deferred_capacity == 0 ? 16 : deferred_capacity * 2;
+        deferred = xrealloc(deferred, sizeof (resolver_deferred_t) * deferred_capacity);
+    }
+
+    deferred[deferred_count++] = (resolver_deferred_t) { .fn = fn, .scope = scope };
+}
+
+static void resolve_function_body(ast_ref_t ref, resolver_scope_t *parent)
+{
+    resolver_scope_t *scope = resolver_scope_new(parent);
+    ast_list_t argnames = NODE(ref)->argnames;
+
+    for (uint32_t i = 0; i < argnames.count; i++)
+    {
+        ast_node_t *arg = AST_LIST_NODE(ast, argnames, i);
+
+        arg->depth = 0;
+        arg->slot = resolver_declare(scope, arg->symbol);
+    }
+
+    resolve_list(NODE(ref)->body, scope);
+    NODE(ref)->frame_size = scope->count;
+}
+
+static void resolve_node(ast_ref_t ref, resolver_scope_t *scope)
+{
+    if (ref == AST_NONE)
+        return;
+
+    callstack_check();
+
+    ast_node_t *node = NODE(ref);
+
+    switch (node->type)
+    {
+        case NODE_IDENTIFIER:
+            resolver_lookup(scope, node->symbol, &node->depth, &node->slot);
+        break;
+
+        case NODE_DECL_VAR:
+            /* The initializer cannot see the variable it initializes. */
+            resolve_node(node->varval, scope);
+            node->var_slot = resolver_declare(scope, node->identifier);
+        break;
+
+        case NODE_DECL_FUNCTION:
+            node->exec = NULL;
+            node->fn_slot = resolver_declare(scope, node->fn_name);
+            resolve_defer(ref, scope);
+        break;
+
+        case NODE_BLOCK:
+            resolve_block(ref, scope, NULL);
+        break;
+
+        case NODE_CTRL_IF:
+            resolve_node(node->ctrl_cond, scope);
+            resolve_ctrl_body(node->ctrl_body, scope, NULL);
+
+            if (node->else_body != AST_NONE)
+                resolve_ctrl_body(node->else_body, scope, NULL);
+        break;
+
+        case NODE_CTRL_WHILE:
+            resolve_node(node->ctrl_cond, scope);
+            resolve_ctrl_body(node->ctrl_body, scope, NULL);
+        break;
+
+        case NODE_CTRL_LOOP:
+            resolve_node(node->ctrl_cond, scope);
+            resolve_ctrl_body(node->ctrl_body, scope,
+                node->ctrl_loop_identifier == NULL ? iteration_atom : node->ctrl_loop_identifier);
+        break;
+
+        case NODE_CTRL_FOR:
+        {
+            resolver_scope_t *for_scope = resolver_scope_new(scope);
+
+            resolve_node(node->for_init, for_scope);
+            resolve_node(node->for_cond, for_scope);
+            resolve_node(node->for_incdec, for_scope);
+            resolve_ctrl_body(node->for_body, for_scope, NULL);
+            node->for_frame_size = for_scope->count;
+        }
+        break;
+
+        case NODE_EXPR_BINARY:
+            resolve_node(node->left, scope);
+            resolve_node(node->right, scope);
+        break;
+
+        case NODE_EXPR_UNARY:
+            resolve_node(node->right, scope);
+        break;
+
+        case NODE_EXPR_ASSIGNMENT:
+            resolve_node(node->assignee, scope);
+            resolve_node(node->assignment_value, scope);
+        break;
+
+        case NODE_EXPR_CALL:
+            resolve_list(node->args, scope);
+            resolve_node(node->callee, scope);
+        break;
+
+        case NODE_EXPR_MEMBER_ACCESS:
+            node->ic_shape = NULL;
+            resolve_node(node->object, scope);
+
+            /* A plain `obj.name` is a property name, not a variable. */
+            if (node->computed)
+                resolve_node(node->prop, scope);
+        break;
+
+        case NODE_OBJECT_LITERAL:
+            /* Whatever a cached tree holds here is meaningless. */
+            node->shape = NULL;
+            resolve_list(node->properties, scope);
+        break;
+
+        case NODE_PROPERTY_LITERAL:
+            if (node->propval == AST_NONE)
+                resolver_lookup(scope, node->key, &node->key_depth, &node->key_slot);
+            else
+                resolve_node(node->propval, scope);
+        break;
+
+        case NODE_RETURN:
+            resolve_node(node->return_expr, scope);
+        break;
+
+        case NODE_STRING:
+            node->string = NULL;
+        break;
+
+        default:
+        break;
+    }
+}
+
+void resolve_ast(ast_t *tree, const scope_t *global)
+{
+    ast = tree;
+    iteration_atom = atom_get("iteration");
+
+    resolver_scope_t *root = resolver_scope_new(NULL);
+
+    for (size_t i = 0; i < global->slot_count; i++)
+        resolver_declare(root, global->slots[i].name);
+
+    resolve_list(NODE(ast->root)->body, root);
+
+    /* Bodies can defer functions of their own, so the queue may grow. */
+    for (size_t i = 0; i < deferred_count; i++)
+        resolve_function_body(deferred[i].fn, deferred[i].scope);
+
+    NODE(ast->root)->frame_size = root->count;
+
+    while (scopes != NULL)
+    {
+        resolver_scope_t *next = scopes->next;
+
+        free(scopes->names);
+        free(scopes->table);
+        free(scopes);
+        scopes = next;
+    }
+
+    free(deferred);
+    deferred = NULL;
+    deferred_count = deferred_capacity = 0;
+    ast = NULL;
+}
@@ -0,0 +1,17 @@
+#ifndef __RESOLVER_H__
+#define __RESOLVER_H__
+
+#include "ast.h"
+#include "scope.h"
+
+/* Binds every identifier in the tree to a (depth, slot) pair, so that the
+   evaluator can reach variables by index instead of by name. Each scope
+   the evaluator creates gets the number of slots it needs, and every
+   declaration gets the slot it fills. The global scope must already hold
+   the builtins; the program's own globals are numbered after them.
+
+   Function bodies are resolved after the code around them, so they can
+   refer to variables that are declared later in an enclosing scope. */
+void resolve_ast(ast_t *ast, const scope_t *global);
+
+#endif
@@ -0,0 +1,295 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "rtstring.h"
+#include "xmalloc.h"
+
+/* Shorter concatenations are copied right away: a rope node would cost
+   about as much as the characters. */
+#define RTSTRING_ROPE_MIN 64
+
+size_t rtstring_bytes = 0;
+static rtstring_t *strings = NULL;
+
+/* Sets up a new temporary and adds it to the list of strings. */
+static rtstring_t *rtstring_init(rtstring_t *string, size_t length, size_t size)
+{
+    string->refcount = 0;
+    string->hash = 0;
+    string->length = length;
+    string->left = string->right = NULL;
+    string->prev = NULL;
+    string->next = strings;
+    string->marked = false;
+
+    if (strings != NULL)
+        strings->prev = string;
+
+    strings = string;
+    rtstring_bytes += size;
+
+    return string;
+}
+
+static rtstring_t *rtstring_alloc(size_t length)
+{
+    size_t size = sizeof (rtstring_t) + length + 1;
+    rtstring_t *string = rtstring_init(xmalloc(size), length, size);
+
+    string->data = string->chars;
+    string->chars[length] = '\0';
+
+    return string;
+}
+
+rtstring_t *rtstring_new(const char *data, size_t length)
+{
+    rtstring_t *string = rtstring_alloc(length);
+
+    memcpy(string->chars, data, length);
+    return string;
+}
+
+rtstring_t *rtstring_pin(const char *data, size_t length)
+{
+    rtstring_t *string = rtstring_new(data, length);
+
+    string->refcount = RTSTRING_PINNED;
+    return string;
+}
+
+/* Growable stack of strings, for walking ropes without recursion: they
+   can be as deep as the number of appends that built them. */
+typedef struct {
+    rtstring_t **items;
+    size_t count;
+    size_t capacity;
+} rtstring_stack_t;
+
+static void rtstring_stack_push(rtstring_stack_t *stack, rtstring_t *string)
+{
+    if (stack->count == stack->capacity)
+    {
+        stack->capacity = stack->capacity == 0 ? 16 : stack->capacity * 2;
+        stack->items = xrealloc(stack->items, sizeof (rtstring_t *) * stack->capacity);
+    }
+
+    stack->items[stack->count++] = string;
+}
+
+/* Drops a reference, telling whether it was the last one. */
+static bool rtstring_drop(rtstring_t *string)
+{
+    if (string->refcount == RTSTRING_PINNED || string->refcount == 0)
+        return false;
+
+    return --string->refcount == 0;
+}
+
+static void rtstring_free(rtstring_t *string)
+{
+    rtstring_stack_t pending = { 0 };
+
+    rtstring_stack_push(&pending, string);
+
+    while (pending.count != 0)
+    {
+        string = pending.items[--pending.count];
+
+        /* A rope owns references to its halves. */
+        if (string->left != NULL)
+        {
+            if (rtstring_drop(string->left))
+                rtstring_stack_push(&pending, string->left);
+
+            if (rtstring_drop(string->right))
+                rtstring_stack_push(&pending, string->right);
+        }
+
+        if (string->prev != NULL)
+            string->prev->next = string->next;
+        else
+            strings = string->next;
+
+        if (string->next != NULL)
+            string->next->prev = string->prev;
+
+        rtstring_bytes -= sizeof (rtstring_t) + (string->data != NULL ? string->length + 1 : 0);
+
+        if (string->data != string->chars)
+            free(string->data);
+
+        free(string);
+    }
+
+    free(pending.items);
+}
+
+/* Frees a string that nothing references once it has been consumed. */
+void rtstring_free_temporary(rtstring_t *string)
+{
+    if (string->refcount == 0)
+        rtstring_free(string);
+}
+
+rtstring_t *rtstring_concat(rtstring_t *left, rtstring_t *right)
+{
+    size_t length = left->length + right->length;
+
+    if (length < RTSTRING_ROPE_MIN)
+    {
+        rtstring_t *string = rtstring_alloc(length);
+
+        memcpy(string->chars, rtstring_data(left), left->length);
+        memcpy(string->chars + left->length, rtstring_data(right), right->length);
+
+        if (left != right)
+            rtstring_free_temporary(left);
+
+        rtstring_free_temporary(right);
+        return string;
+    }
+
+    rtstring_t *rope = rtstring_init(xmalloc(sizeof (rtstring_t)), length, sizeof (rtstring_t));
+
+    rope->data = NULL;
+    rope->left = left;
+    rope->right = right;
+
+    rtstring_retain(left);
+    rtstring_retain(right);
+
+    return rope;
+}
+
+/* Copies the leaves right to left into one buffer, then lets go of the
+   halves. The rope stays the same object, so every value that refers
+   to it sees the flat string. */
+const char *rtstring_flatten(rtstring_t *string)
+{
+    char *data = xmalloc(string->length + 1);
+    size_t end = string->length;
+    rtstring_stack_t stack = { 0 };
+
+    data[end] = '\0';
+    rtstring_stack_push(&stack, string);
+
+    while (stack.count != 0)
+    {
+        rtstring_t *node = stack.items[--stack.count];
+
+        if (node->data != NULL)
+        {
+            end -= node->length;
+            memcpy(data + end, node->data, node->length);
+            continue;
+        }
+
+        rtstring_stack_push(&stack, node->left);
+        rtstring_stack_push(&stack, node->right);
+    }
+
+    free(stack.items);
+
+    rtstring_t *left = string->left, *right = string->right;
+
+    string->data = data;
+    string->left = string->right = NULL;
+    rtstring_bytes += string->length + 1;
+
+    rtstring_release(left);
+    rtstring_release(right);
+
+    return data;
+}
+
+void rtstring_retain(rtstring_t *string)
+{
+    if (string->refcount != RTSTRING_PINNED)
+        string->refcount++;
+}
+
+void rtstring_release(rtstring_t *string)
+{
+    if (rtstring_drop(string))
+        rtstring_free(string);
+}
+
+/* Drops a reference without freeing the string, turning it back into a
+   temporary when it was the last one. */
+void rtstring_unref(rtstring_t *string)
+{
+    if (string->refcount != RTSTRING_PINNED && string->refcount != 0)
+        string->refcount--;
+}
+
+/* Keeps a string through the next rtstring_sweep(). */
+void rtstring_mark(rtstring_t *string)
+{
+    if (string->refcount != RTSTRING_PINNED)
+        string->marked = true;
+}
+
+/* Frees the temporaries no root reached. They cannot be the halves of a
+   rope, which hold references, so freeing one never frees another. */
+void rtstring_sweep()
+{
+    rtstring_t **unreached = NULL;
+    size_t count = 0, capacity = 0;
+
+    for (rtstring_t *string = strings; string != NULL; string = string->next)
+    {
+        if (string->refcount == 0 && !string->marked)
+        {
+            if (count == capacity)
+            {
+                capacity = capacity == 0 ? 16 : capacity * 2;
+                unreached = xrealloc(unreached, sizeof (rtstring_t *) * capacity);
+            }
+
+            unreached[count++] = string;
+        }
+
+        string->marked = false;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        rtstring_free(unreached[i]);
+
+    free(unreached);
+}
+
+/* 32-bit FNV-1a, like atoms. */
+uint32_t rtstring_hash(rtstring_t *string)
+{
+    if (string->hash != 0)
+        return string->hash;
+
+    const char *data = rtstring_data(string);
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < string->length; i++)
+    {
+        hash ^= (unsigned char) data[i];
+        hash *= 16777619u;
+    }
+
+    string->hash = hash;
+    return hash;
+}
+
+/* Only compares the characters when lengths, and hashes if both are
+   known, are equal. */
+bool rtstring_equals(rtstring_t *left, rtstring_t *right)
+{
+    if (left == right)
+        return true;
+
+    if (left->length != right->length)
+        return false;
+
+    if (left->hash != 0 && right->hash != 0 && left->hash != right->hash)
+        return false;
+
+    return memcmp(rtstring_data(left), rtstring_data(right), left->length) == 0;
+}
@@ -0,0 +1,64 @@
+#ifndef __RTSTRING_H__
+#define __RTSTRING_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RTSTRING_PINNED UINT32_MAX
+
+/* Declares a pinned string with static storage. */
+#define RTSTRING_STATIC(name, literal) \
+    static rtstring_t name = { .refcount = RTSTRING_PINNED, .length = sizeof (literal) - 1, .data = literal }
+
+/* Runtime strings are immutable and shared: copying a string value only
+   copies the pointer. Variables and object properties each hold a
+   reference; a string is freed when the last one is released. A new
+   string starts with no references: it is a temporary, owned by the
+   code that made it until that code stores it somewhere or hands it to
+   rtstring_free_temporary() once done with it. Pinned strings (literals
+   and builtin names) ignore reference counting and are never freed.
+
+   Temporaries that slip through are reclaimed by the garbage collector:
+   every collection marks the strings its roots reach, then
+   rtstring_sweep() frees the temporaries it did not mark.
+
+   Concatenating long strings builds a rope: a node that references both
+   halves instead of copying them. The characters are only put together
+   when they are first read through rtstring_data(), so appending to a
+   string in a loop is linear. */
+typedef struct rtstring {
+    uint32_t refcount;                  /* RTSTRING_PINNED if pinned. */
+    uint32_t hash;                      /* FNV-1a, or 0 until computed. */
+    size_t length;
+    char *data;                         /* NUL-terminated; NULL for an unflattened rope. */
+    struct rtstring *left;              /* Halves of a rope, each holding a reference. */
+    struct rtstring *right;
+    struct rtstring *prev;              /* All allocated strings, for rtstring_sweep(). */
+    struct rtstring *next;
+    bool marked;
+    char chars[];                       /* Storage of strings created flat. */
+} rtstring_t;
+
+/* Bytes held by allocated strings, characters included. */
+extern size_t rtstring_bytes;
+
+rtstring_t *rtstring_new(const char *data, size_t length);
+rtstring_t *rtstring_pin(const char *data, size_t length);
+rtstring_t *rtstring_concat(rtstring_t *left, rtstring_t *right);
+const char *rtstring_flatten(rtstring_t *string);
+void rtstring_retain(rtstring_t *string);
+void rtstring_release(rtstring_t *string);
+void rtstring_unref(rtstring_t *string);
+void rtstring_free_temporary(rtstring_t *string);
+void rtstring_mark(rtstring_t *string);
+void rtstring_sweep();
+uint32_t rtstring_hash(rtstring_t *string);
+bool rtstring_equals(rtstring_t *left, rtstring_t *right);
+
+static inline const char *rtstring_data(rtstring_t *string)
+{
+    return string->data != NULL ? string->data : rtstring_flatten(string);
+}
+
+#endif
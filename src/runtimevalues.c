@@ -0,0 +1,13 @@
+#include <stdint.h>
+
+#include "runtimevalues.h"
+#include "gc.h"
+
+/* Boxes are immutable, so values that share one never see it change. */
+runtime_val_t rtval_box_int64(int64_t value)
+{
+    int64_t *box = gc_alloc(GC_INT64, sizeof (int64_t));
+
+    *box = value;
+    return rtval_from_pointer(RTVAL_TAG_INT64, box);
+}
@@ -2,16 +2,12 @@
 #define __RUNTIMEVALUES_H__
 
 #include <stdbool.h>
-#include "map.h"
+#include <stdint.h>
 #include "vector.h"
 #include "ast.h"
+#include "rtstring.h"
 
-#define BLAZE_NULL ((runtime_val_t) { .type = VAL_NULL })
-#define BLAZE_INT(n) ((runtime_val_t) { .type = VAL_NUMBER, .is_float = false, .intval = n })
-#define BLAZE_TRUE ((runtime_val_t) { .type = VAL_BOOLEAN, .boolval = true })
-#define BLAZE_FALSE ((runtime_val_t) { .type = VAL_BOOLEAN, .boolval = false })
-
-typedef enum 
+typedef enum
 {
     VAL_NUMBER,
     VAL_NULL,
@@ -23,46 +19,210 @@ typedef enum
     VAL_ANY
 } runtime_valtype_t;
 
+/* Values are NaN-boxed into 64 bits. A float is stored as the bits of
+   its double. Everything else lives in the payload of a negative quiet
+   NaN: the top 16 bits are 0xFFF8 plus a tag, the low 48 bits an integer
+   or a pointer. Arithmetic NaNs are canonicalized to a positive NaN, so
+   they never look like a tag.
+
+   Integers that fit in 48 bits are stored inline; wider ones are boxed
+   on the heap. Either way they are VAL_NUMBER values that are not float. */
 typedef struct runtime_val_t
 {
-    runtime_valtype_t type;
-    bool literal;
-
-    union {
-        /* if (type == VAL_NUMBER) */
-        struct {
-            long long int intval;
-            long double floatval;
-            bool is_float;
-        };
-        /* endif */
-        
-        /* if (type == VAL_BOOLEAN) */
-        bool boolval;
-        /* endif */
-        
-        /* if (type == VAL_OBJECT) */
-        map_t properties;
-        /* endif */
-        
-        /* if (type == VAL_STRING) */
-        char *strval;
-        /* endif */
-        
-        /* if (type == VAL_NATIVE_FN) */
-        struct runtime_val_t (*fn)(vector_t args, struct scope *scope);
-        /* endif */
-        
-        /* if (type == VAL_USER_FN) */
-        struct {
-            char *fn_name;
-            vector_t argnames; 
-            ast_stmt *body;
-            size_t size;
-            struct scope *scope;
-        };
-        /* endif */
-    };
+    uint64_t bits;
 } runtime_val_t;
 
+typedef enum
+{
+    RTVAL_TAG_FLOAT = 0,                    /* Any non-NaN-boxed double. */
+    RTVAL_TAG_INT,
+    RTVAL_TAG_SPECIAL,                      /* null, false and true. */
+    RTVAL_TAG_OBJECT,
+    RTVAL_TAG_STRING,
+    RTVAL_TAG_NATIVE_FN,
+    RTVAL_TAG_USER_FN,
+    RTVAL_TAG_INT64                         /* Pointer to a boxed int64_t. */
+} rtval_tag_t;
+
+#define RTVAL_TAGGED(tag) ((0xFFF8ull | (tag)) << 48)
+#define RTVAL_PAYLOAD_MASK ((1ull << 48) - 1)
+#define RTVAL_CANONICAL_NAN 0x7FF8000000000000ull
+#define RTVAL_INT_MIN (-(1ll << 47))
+#define RTVAL_INT_MAX ((1ll << 47) - 1)
+
+struct scope;
+
+typedef runtime_val_t (*native_fn_t)(runtime_val_t *args, size_t argc, struct scope *scope);
+
+/* A user function value points to one of these. */
+typedef struct user_fn {
+    atom_t *fn_name;
+    const struct ast_node *decl;            /* The NODE_DECL_FUNCTION node. */
+    struct scope *scope;
+} user_fn_t;
+
+#define BLAZE_NULL ((runtime_val_t) { .bits = RTVAL_TAGGED(RTVAL_TAG_SPECIAL) | 0 })
+#define BLAZE_FALSE ((runtime_val_t) { .bits = RTVAL_TAGGED(RTVAL_TAG_SPECIAL) | 2 })
+#define BLAZE_TRUE ((runtime_val_t) { .bits = RTVAL_TAGGED(RTVAL_TAG_SPECIAL) | 3 })
+#define BLAZE_BOOL(b) ((b) ? BLAZE_TRUE : BLAZE_FALSE)
+#define BLAZE_INT(n) rtval_from_int(n)
+#define BLAZE_FLOAT(n) rtval_from_float(n)
+#define BLAZE_STRING(s) rtval_from_pointer(RTVAL_TAG_STRING, (s))
+#define BLAZE_OBJECT(o) rtval_from_pointer(RTVAL_TAG_OBJECT, (o))
+#define BLAZE_NATIVE_FN(f) rtval_from_pointer(RTVAL_TAG_NATIVE_FN, (void *) (f))
+#define BLAZE_USER_FN(f) rtval_from_pointer(RTVAL_TAG_USER_FN, (f))
+
+runtime_val_t rtval_box_int64(int64_t value);
+
+static inline rtval_tag_t rtval_tag(runtime_val_t val)
+{
+    return (val.bits >> 48) <= 0xFFF8 ? RTVAL_TAG_FLOAT : (val.bits >> 48) & 7;
+}
+
+static inline void *rtval_pointer(runtime_val_t val)
+{
+    return (void *) (uintptr_t) (val.bits & RTVAL_PAYLOAD_MASK);
+}
+
+static inline runtime_val_t rtval_from_pointer(rtval_tag_t tag, const void *pointer)
+{
+    return (runtime_val_t) { .bits = RTVAL_TAGGED(tag) | (uintptr_t) pointer };
+}
+
+static inline runtime_val_t rtval_from_int(int64_t value)
+{
+    if (value < RTVAL_INT_MIN || value > RTVAL_INT_MAX)
+        return rtval_box_int64(value);
+
+    return (runtime_val_t) { .bits = RTVAL_TAGGED(RTVAL_TAG_INT) | ((uint64_t) value & RTVAL_PAYLOAD_MASK) };
+}
+
+static inline runtime_val_t rtval_from_float(double value)
+{
+    union { double d; uint64_t bits; } u = { .d = value };
+
+    if (value != value)
+        u.bits = RTVAL_CANONICAL_NAN;
+
+    return (runtime_val_t) { .bits = u.bits };
+}
+
+static inline bool rtval_is_float(runtime_val_t val)
+{
+    return rtval_tag(val) == RTVAL_TAG_FLOAT;
+}
+
+static inline bool rtval_is_int(runtime_val_t val)
+{
+    rtval_tag_t tag = rtval_tag(val);
+    return tag == RTVAL_TAG_INT || tag == RTVAL_TAG_INT64;
+}
+
+static inline runtime_valtype_t rtval_type(runtime_val_t val)
+{
+    switch (rtval_tag(val))
+    {
+        case RTVAL_TAG_SPECIAL:
+            return val.bits == BLAZE_NULL.bits ? VAL_NULL : VAL_BOOLEAN;
+
+        case RTVAL_TAG_OBJECT:
+            return VAL_OBJECT;
+
+        case RTVAL_TAG_STRING:
+            return VAL_STRING;
+
+        case RTVAL_TAG_NATIVE_FN:
+            return VAL_NATIVE_FN;
+
+        case RTVAL_TAG_USER_FN:
+            return VAL_USER_FN;
+
+        default:
+            return VAL_NUMBER;
+    }
+}
+
+/* Only valid for integers. */
+static inline int64_t rtval_int(runtime_val_t val)
+{
+    if (rtval_tag(val) == RTVAL_TAG_INT64)
+        return *(int64_t *) rtval_pointer(val);
+
+    return (int64_t) (val.bits << 16) >> 16;
+}
+
+static inline double rtval_float(runtime_val_t val)
+{
+    union { uint64_t bits; double d; } u = { .bits = val.bits };
+    return u.d;
+}
+
+static inline bool rtval_bool(runtime_val_t val)
+{
+    return val.bits == BLAZE_TRUE.bits;
+}
+
+static inline rtstring_t *rtval_string(runtime_val_t val)
+{
+    return rtval_pointer(val);
+}
+
+static inline struct object *rtval_object(runtime_val_t val)
+{
+    return rtval_pointer(val);
+}
+
+static inline native_fn_t rtval_native_fn(runtime_val_t val)
+{
+    return (native_fn_t) rtval_pointer(val);
+}
+
+static inline user_fn_t *rtval_user_fn(runtime_val_t val)
+{
+    return rtval_pointer(val);
+}
+
+/* Zero, null and false are falsy; strings, objects and functions are
+   always truthy. */
+static inline bool rtval_truthy(runtime_val_t val)
+{
+    switch (rtval_tag(val))
+    {
+        case RTVAL_TAG_FLOAT:
+            return rtval_float(val) != 0;
+
+        case RTVAL_TAG_INT:
+        case RTVAL_TAG_INT64:
+            return rtval_int(val) != 0;
+
+        case RTVAL_TAG_SPECIAL:
+            return val.bits == BLAZE_TRUE.bits;
+
+        default:
+            return true;
+    }
+}
+
+/* Strings are the only reference counted values. */
+static inline void rtval_retain(runtime_val_t val)
+{
+    if (rtval_tag(val) == RTVAL_TAG_STRING)
+        rtstring_retain(rtval_string(val));
+}
+
+static inline void rtval_release(runtime_val_t val)
+{
+    if (rtval_tag(val) == RTVAL_TAG_STRING)
+        rtstring_release(rtval_string(val));
+}
+
+/* Frees a value that was computed and then consumed without being
+   stored: a statement's result, a condition, an operand or an argument
+   of a native function. */
+static inline void rtval_free_temporary(runtime_val_t val)
+{
+    if (rtval_tag(val) == RTVAL_TAG_STRING)
+        rtstring_free_temporary(rtval_string(val));
+}
+
 #endif
@@ -9,29 +9,98 @@
 #include "scope.h"
 #include "eval.h"
 #include "xmalloc.h"
+#include "gc.h"
 
-#define SCOPE_STACK_SIZE 4096
+#define SCOPE_POOL_MAX_SLOTS 16
 
-scope_t scope_init(scope_t *parent_scope)
+/* Freed slot arrays of up to SCOPE_POOL_MAX_SLOTS slots, one free list
+   per size. A free array stores the next one in its first slot. */
+static identifier_t *slot_pool[SCOPE_POOL_MAX_SLOTS + 1];
+
+static identifier_t *scope_slots_alloc(size_t slot_count)
+{
+    if (slot_count == 0)
+        return NULL;
+
+    if (slot_count > SCOPE_POOL_MAX_SLOTS || slot_pool[slot_count] == NULL)
+        return xcalloc(sizeof (identifier_t), slot_count);
+
+    identifier_t *slots = slot_pool[slot_count];
+
+    slot_pool[slot_count] = *(identifier_t **) slots;
+    memset(slots, 0, sizeof (identifier_t) * slot_count);
+
+    return slots;
+}
+
+static void scope_slots_release(identifier_t *slots, size_t slot_count)
+{
+    if (slots == NULL)
+        return;
+
+    if (slot_count > SCOPE_POOL_MAX_SLOTS)
+    {
+        free(slots);
+        return;
+    }
+
+    *(identifier_t **) slots = slot_pool[slot_count];
+    slot_pool[slot_count] = slots;
+}
+
+/* Scopes are cheap to enter: the slot array usually comes straight off a
+   free list, and the name-keyed map stays empty, allocating nothing,
+   until scope_declare_identifier() is called. The scope is a GC root
+   until scope_free(). */
+void scope_init(scope_t *scope, scope_t *parent_scope, size_t slot_count)
 {
-    scope_t scope = { .parent = parent_scope, .is_broken = false, .is_continued = false };
-    scope.identifiers = MAP_INIT(identifier_t *, SCOPE_STACK_SIZE);
-    scope.name = strdup("Something: %d  ");
-    sprintf(scope.name, "Something: %d", rand() % 9);
-    return scope;
+    *scope = (scope_t) { .parent = parent_scope, .is_broken = false, .is_continued = false };
+    scope->slots = scope_slots_alloc(slot_count);
+    scope->slot_count = slot_count;
+    gc_push_scope(scope);
 }
 
-identifier_t *scope_declare_identifier(scope_t *scope, char *name, runtime_val_t *value, bool is_const)
+/* A function can outlive the scope it was declared in, so it sees a copy
+   of that scope (and of the scopes around it) on the GC heap instead. The
+   copy shares the slots, and takes them over when the scope is left. The
+   global scope outlives everything and is never copied. */
+scope_t *scope_capture(scope_t *scope)
+{
+    if (scope->on_heap || scope->parent == NULL)
+        return scope;
+
+    if (scope->captured == NULL)
+    {
+        scope_t *parent = scope_capture(scope->parent);
+        scope_t *copy = gc_alloc(GC_SCOPE, sizeof (scope_t));
+
+        *copy = (scope_t) {
+            .parent = parent,
+            .slots = scope->slots,
+            .slot_count = scope->slot_count,
+            .on_heap = true
+        };
+
+        scope->captured = copy;
+    }
+
+    return scope->captured;
+}
+
+identifier_t *scope_declare_identifier(scope_t *scope, atom_t *name, runtime_val_t value, bool is_const)
 {
     if (map_has(&scope->identifiers, name)) 
-        eval_error(true, "Cannot redeclare identifier '%s' in this scope", name);
+        eval_error(true, "Cannot redeclare identifier '%s' in this scope", name->name);
 
     identifier_t identifier = {
         .is_const = is_const,
+        .declared = true,
         .name = name,
         .value = value
     };
 
+    rtval_retain(value);
+
     identifier_t *identifier_heap = xmalloc(sizeof (identifier_t));
     memcpy(identifier_heap, &identifier, sizeof identifier);
     map_set(&scope->identifiers, name, identifier_heap);
@@ -39,85 +108,144 @@ identifier_t *scope_declare_identifier(scope_t *scope, char *name, runtime_val_t
     return identifier_heap;
 }
 
-scope_t *scope_resolve_identifier_scope(scope_t *scope, char *name)
+/* Assigning updates the variable where it is, without reinserting it. */
+runtime_val_t scope_assign_identifier(scope_t *scope, atom_t *name, runtime_val_t value)
+{
+    return scope_assign_slot(scope_resolve_identifier(scope, name), value);
+}
+
+identifier_t *scope_resolve_identifier(scope_t *scope, atom_t *name)
+{
+    for (; scope != NULL; scope = scope->parent)
+    {
+        identifier_t *identifier = map_get(&scope->identifiers, name);
+
+        if (identifier != NULL)
+            return identifier;
+    }
+
+    eval_error(true, "Undefined identifier '%s' in the current scope", name->name);
+    return NULL;
+}
+
+void scope_reserve_slots(scope_t *scope, size_t slot_count)
+{
+    if (slot_count <= scope->slot_count)
+        return;
+
+    scope->slots = xrealloc(scope->slots, sizeof (identifier_t) * slot_count);
+    memset(&scope->slots[scope->slot_count], 0, sizeof (identifier_t) * (slot_count - scope->slot_count));
+    scope->slot_count = slot_count;
+}
+
+identifier_t *scope_declare_slot(scope_t *scope, size_t slot, atom_t *name, runtime_val_t value, bool is_const)
 {
-    identifier_t *i = map_get(&scope->identifiers, name);
+    assert(slot < scope->slot_count);
 
-    if (scope->parent == NULL && i == NULL) 
-        eval_error(true, "Undefined identifier '%s' in the current scope", name);
-    else if (scope->parent != NULL && i == NULL)
-        return scope_resolve_identifier_scope(scope->parent, name);
+    identifier_t *identifier = &scope->slots[slot];
 
-    return scope;
+    if (identifier->declared)
+        eval_error(true, "Cannot redeclare identifier '%s' in this scope", name->name);
+
+    identifier->is_const = is_const;
+    identifier->declared = true;
+    identifier->name = name;
+    identifier->value = value;
+    rtval_retain(value);
+
+    return identifier;
 }
 
-runtime_val_t *scope_assign_identifier(scope_t *scope, char *name, runtime_val_t *value)
+identifier_t *scope_resolve_slot(scope_t *scope, size_t depth, size_t slot)
 {
-    scope_t *foundscope = scope_resolve_identifier_scope(scope, name);
-    identifier_t *identifier = scope_resolve_identifier(scope, name);
+    while (depth-- > 0)
+        scope = scope->parent;
 
-    if (scope->parent == NULL && identifier == NULL) 
-        eval_error(true, "Undefined identifier '%s' in the current scope", name);
+    assert(slot < scope->slot_count);
+    return &scope->slots[slot];
+}
 
+runtime_val_t scope_assign_slot(identifier_t *identifier, runtime_val_t value)
+{
     if (identifier->is_const) 
-        eval_error(true, "Cannot modify constant identifier '%s' in the current scope", name);
+        eval_error(true, "Cannot modify constant identifier '%s' in the current scope", identifier->name->name);
 
-    identifier_t copy = *identifier;
-    runtime_val_t *val_heap = xmalloc(sizeof (runtime_val_t));
-    memcpy(val_heap, value, sizeof (runtime_val_t));
+    rtval_retain(value);
+    rtval_release(identifier->value);
+    identifier->value = value;
 
-    map_delete(&foundscope->identifiers, name, true);
-    
-    return scope_declare_identifier(foundscope, name, val_heap, copy.is_const)->value;
+    return value;
 }
 
-identifier_t *scope_resolve_identifier(scope_t *scope, char *name)
+/* Drops the reference a variable holds. Objects are left to the GC. */
+void scope_runtime_val_free(runtime_val_t *val)
 {
-    scope_t *found_scope = scope_resolve_identifier_scope(scope, name);
-    return map_get(&found_scope->identifiers, name);
+    if (val != NULL)
+        rtval_release(*val);
 }
 
-void scope_runtime_val_free(runtime_val_t *val)
+void scope_free_slots(scope_t *scope)
 {
-    if (!val || val->literal != true)
-        return;
+    for (size_t i = 0; i < scope->slot_count; i++)
+    {
+        if (scope->slots[i].declared)
+            scope_runtime_val_free(&scope->slots[i].value);
+    }
+
+    scope_slots_release(scope->slots, scope->slot_count);
+}
 
-    if (val->type == VAL_STRING)
+/* Empties a loop body's scope for the next iteration. Once closures
+   have captured it, it is replaced instead, so that every iteration they
+   saw keeps its own variables. */
+void scope_reset(scope_t *scope)
+{
+    if (scope->captured != NULL)
     {
-        zfree(val->strval, "String");
-        val->strval = NULL;
+        scope_t *parent = scope->parent;
+        size_t slot_count = scope->slot_count;
+
+        scope_free(scope);
+        scope_init(scope, parent, slot_count);
+        return;
     }
-    else if (val->type == VAL_OBJECT)
+
+    for (size_t i = 0; i < scope->slot_count; i++)
     {
-        for (size_t i = 0; i < val->properties.size; i++)
+        if (scope->slots[i].declared)
         {
-            if (val->properties.array[i] != NULL)
-            {
-                if (val->properties.array[i]->value != NULL && val->properties.array[i]->value->value != NULL)
-                {
-                    scope_runtime_val_free(val->properties.array[i]->value->value);
-                    val->properties.array[i]->value->value = NULL;
-                }
-
-                if (val->properties.array[i]->key != NULL && strlen(val->properties.array[i]->key) != 0)
-                {
-                    zfree(val->properties.array[i]->key, "Freeing key: %s", val->properties.array[i]->key);
-                    val->properties.array[i]->key = NULL;
-                }
-
-                xfree(val->properties.array[i]);
-                val->properties.array[i] = NULL;
-            }
+            scope_runtime_val_free(&scope->slots[i].value);
+            scope->slots[i].declared = false;
         }
+    }
 
-        if (val->properties.array != NULL)
-            zfree(val->properties.array, "Properties Array");
-        
-        val->properties.array = NULL;
+    scope->is_broken = false;
+    scope->is_continued = false;
+}
+
+/* Turns a function's frame into the frame of the function it tail
+   calls. The frame keeps its slots when the sizes match and no closure
+   captured it. */
+void scope_reuse(scope_t *scope, scope_t *parent_scope, size_t slot_count)
+{
+    if (scope->captured != NULL || scope->slot_count != slot_count)
+    {
+        scope_free(scope);
+        scope_init(scope, parent_scope, slot_count);
+        return;
     }
+
+    scope_reset(scope);
+    map_free(&scope->identifiers, true);
+    scope->parent = parent_scope;
 }
 
 void scope_free(scope_t *scope)
 {
+    gc_pop_scope(scope);
     map_free(&scope->identifiers, true);
+
+    /* Otherwise the slots now belong to the captured copy. */
+    if (scope->captured == NULL)
+        scope_free_slots(scope);
 }
@@ -9,17 +9,28 @@
 
 typedef struct scope {
     struct scope *parent;
-    map_t identifiers;
-    char *name;
+    map_t identifiers;                  /* Identifiers declared by name (blazevm). */
+    identifier_t *slots;                /* Identifiers at the slots assigned by the resolver. */
+    size_t slot_count;
+    struct scope *captured;             /* Copy on the GC heap that closures see, or NULL. */
+    bool on_heap;                       /* This is such a copy. */
     bool is_broken;
     bool is_continued;
 } scope_t;
 
-scope_t scope_init(scope_t *parent_scope);
-identifier_t *scope_declare_identifier(scope_t *scope, char *name, runtime_val_t *value, bool is_const);
+void scope_init(scope_t *scope, scope_t *parent_scope, size_t slot_count);
+scope_t *scope_capture(scope_t *scope);
+identifier_t *scope_declare_identifier(scope_t *scope, atom_t *name, runtime_val_t value, bool is_const);
 void scope_free(scope_t *scope);
-runtime_val_t *scope_assign_identifier(scope_t *scope, char *name, runtime_val_t *value);
-identifier_t *scope_resolve_identifier(scope_t *scope, char *name);
+void scope_reset(scope_t *scope);
+void scope_reuse(scope_t *scope, scope_t *parent_scope, size_t slot_count);
+void scope_free_slots(scope_t *scope);
+runtime_val_t scope_assign_identifier(scope_t *scope, atom_t *name, runtime_val_t value);
+identifier_t *scope_resolve_identifier(scope_t *scope, atom_t *name);
 void scope_runtime_val_free(runtime_val_t *val);
+void scope_reserve_slots(scope_t *scope, size_t slot_count);
+identifier_t *scope_declare_slot(scope_t *scope, size_t slot, atom_t *name, runtime_val_t value, bool is_const);
+identifier_t *scope_resolve_slot(scope_t *scope, size_t depth, size_t slot);
+runtime_val_t scope_assign_slot(identifier_t *identifier, runtime_val_t value);
 
 #endif
@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "shape.h"
+#include "atom.h"
+#include "xmalloc.h"
+#include "gc.h"
+
+/* Up to this many properties a lookup just walks the parent chain. */
+#define SHAPE_LINEAR_MAX 8
+
+static shape_t root = { 0 };
+
+shape_t *shape_root()
+{
+    return &root;
+}
+
+/* Follows the transition that adds `key', creating it if needed. */
+shape_t *shape_add(shape_t *shape, atom_t *key)
+{
+    for (shape_t *child = shape->children; child != NULL; child = child->next_sibling)
+    {
+        if (child->key == key)
+            return child;
+    }
+
+    shape_t *child = xcalloc(sizeof (shape_t), 1);
+
+    child->parent = shape;
+    child->key = key;
+    child->count = shape->count + 1;
+    child->next_sibling = shape->children;
+    shape->children = child;
+
+    return child;
+}
+
+atom_t **shape_keys(shape_t *shape)
+{
+    if (shape->keys == NULL && shape->count != 0)
+    {
+        shape->keys = xmalloc(sizeof (atom_t *) * shape->count);
+
+        for (shape_t *s = shape; s->parent != NULL; s = s->parent)
+            shape->keys[s->count - 1] = s->key;
+    }
+
+    return shape->keys;
+}
+
+static void shape_build_table(shape_t *shape)
+{
+    atom_t **keys = shape_keys(shape);
+    uint32_t size = 16;
+
+    while (size < shape->count * 2)
+        size *= 2;
+
+    shape->table = xcalloc(sizeof (uint32_t), size);
+    shape->table_size = size;
+
+    for (uint32_t slot = 0; slot < shape->count; slot++)
+    {
+        uint32_t index = keys[slot]->hash & (size - 1);
+
+        while (shape->table[index] != 0)
+            index = (index + 1) & (size - 1);
+
+        shape->table[index] = slot + 1;
+    }
+}
+
+uint32_t shape_lookup(shape_t *shape, atom_t *key)
+{
+    if (shape->count <= SHAPE_LINEAR_MAX)
+    {
+        for (shape_t *s = shape; s->parent != NULL; s = s->parent)
+        {
+            if (s->key == key)
+                return s->count - 1;
+        }
+
+        return SHAPE_NOT_FOUND;
+    }
+
+    if (shape->table == NULL)
+        shape_build_table(shape);
+
+    uint32_t mask = shape->table_size - 1;
+
+    for (uint32_t index = key->hash & mask; shape->table[index] != 0; index = (index + 1) & mask)
+    {
+        if (shape->keys[shape->table[index] - 1] == key)
+            return shape->table[index] - 1;
+    }
+
+    return SHAPE_NOT_FOUND;
+}
+
+static void shape_free(shape_t *shape)
+{
+    shape_t *child = shape->children;
+
+    while (child != NULL)
+    {
+        shape_t *next = child->next_sibling;
+
+        shape_free(child);
+        free(child);
+        child = next;
+    }
+
+    free(shape->keys);
+    free(shape->table);
+}
+
+void shape_tree_free()
+{
+    shape_free(&root);
+    memset(&root, 0, sizeof root);
+}
+
+object_t *object_new(shape_t *shape)
+{
+    object_t *object = gc_alloc(GC_OBJECT, sizeof (object_t) + sizeof (runtime_val_t) * shape->count);
+
+    object->shape = shape;
+
+    for (uint32_t i = 0; i < shape->count; i++)
+        object->slots[i] = BLAZE_NULL;
+
+    return object;
+}
@@ -0,0 +1,41 @@
+#ifndef __SHAPE_H__
+#define __SHAPE_H__
+
+#include <stdint.h>
+
+#include "atom.h"
+#include "runtimevalues.h"
+
+#define SHAPE_NOT_FOUND UINT32_MAX
+
+/* A shape (hidden class) describes the layout of an object: which
+   property lives in which slot. Shapes form a transition tree rooted at
+   the empty shape, where each child adds one property on top of its
+   parent, so objects that get the same keys in the same order share a
+   shape. Shapes are immutable and live until shape_tree_free(). */
+typedef struct shape {
+    struct shape *parent;
+    atom_t *key;                        /* Property this shape adds; NULL for the root. */
+    uint32_t count;                     /* Properties, i.e. slots, in the layout. */
+    struct shape *children;             /* Transitions, linked through next_sibling. */
+    struct shape *next_sibling;
+    atom_t **keys;                      /* Key of each slot, built on demand. */
+    uint32_t *table;                    /* Slot plus one by key hash, for large shapes. */
+    uint32_t table_size;
+} shape_t;
+
+/* An object is its shape followed by one value per slot. */
+typedef struct object {
+    shape_t *shape;
+    runtime_val_t slots[];
+} object_t;
+
+shape_t *shape_root();
+shape_t *shape_add(shape_t *shape, atom_t *key);
+uint32_t shape_lookup(shape_t *shape, atom_t *key);
+atom_t **shape_keys(shape_t *shape);
+void shape_tree_free();
+
+object_t *object_new(shape_t *shape);
+
+#endif
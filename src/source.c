@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if !defined(__WIN32__)
+#include <sys/mman.h>
+#endif
+
+#include "source.h"
+#include "xmalloc.h"
+
+#define SOURCE_READ_CHUNK 65536
+
+static const char source_empty[1];
+
+static bool source_read_fd(source_t *source, int fd)
+{
+    size_t capacity = SOURCE_READ_CHUNK, length = 0;
+    char *data = xmalloc(capacity);
+
+    while (true)
+    {
+        if (length == capacity)
+        {
+            capacity *= 2;
+            data = xrealloc(data, capacity);
+        }
+
+        ssize_t bytes = read(fd, data + length, capacity - length);
+
+        if (bytes == 0)
+            break;
+
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            free(data);
+            return false;
+        }
+
+        length += bytes;
+    }
+
+    source->data = data;
+    source->length = length;
+    source->mapped = false;
+
+    return true;
+}
+
+/* Loads the file at `path`, or standard input if `path` is NULL or "-".
+   On failure false is returned and errno describes the error. */
+bool source_load(source_t *source, const char *path)
+{
+    bool is_stdin = path == NULL || (path[0] == '-' && path[1] == '\0');
+    int fd = is_stdin ? STDIN_FILENO : open(path, O_RDONLY);
+    bool result;
+
+    if (fd == -1)
+        return false;
+
+#if !defined(__WIN32__)
+    struct stat st;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        if (st.st_size == 0)
+        {
+            source->data = source_empty;
+            source->length = 0;
+            source->mapped = false;
+
+            if (!is_stdin)
+                close(fd);
+
+            return true;
+        }
+
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data != MAP_FAILED)
+        {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+            source->data = data;
+            source->length = st.st_size;
+            source->mapped = true;
+
+            if (!is_stdin)
+                close(fd);
+
+            return true;
+        }
+    }
+#endif
+
+    result = source_read_fd(source, fd);
+
+    if (!is_stdin)
+    {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+    }
+
+    return result;
+}
+
+void source_free(source_t *source)
+{
+    if (source->data == NULL)
+        return;
+
+#if !defined(__WIN32__)
+    if (source->mapped)
+        munmap((void *) source->data, source->length);
+    else 
+#endif
+    if (source->data != source_empty)
+        free((void *) source->data);
+
+    source->data = NULL;
+    source->length = 0;
+}
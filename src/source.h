@@ -0,0 +1,19 @@
+#ifndef __SOURCE_H__
+#define __SOURCE_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* A read-only view of an input file. Regular files are memory-mapped;
+   anything that cannot be mapped (pipes, terminals, stdin) is read into
+   a heap buffer instead. The data is NOT NUL-terminated. */
+typedef struct {
+    const char *data;
+    size_t length;
+    bool mapped;
+} source_t;
+
+bool source_load(source_t *source, const char *path);
+void source_free(source_t *source);
+
+#endif
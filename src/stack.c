@@ -6,11 +6,17 @@
 
 bstack_t stack_create(size_t size) 
 {
-    return (bstack_t) {
+    bstack_t stack = {
         .size = size,
         .si = 0,
-        .array = xcalloc(sizeof (runtime_val_t), size)
+        .array = xmalloc(sizeof (runtime_val_t) * size)
     };
+
+    /* Unused entries show up as zero in stack dumps. */
+    for (size_t i = 0; i < size; i++)
+        stack.array[i] = BLAZE_INT(0);
+
+    return stack;
 }
 
 void stack_free(bstack_t *stack)
@@ -31,17 +37,19 @@ void stack_print(bstack_t *stack)
     {
         printf("%04lx: ", i);
 
-        if (stack->array[i].type == VAL_NUMBER)
+        runtime_val_t value = stack->array[i];
+
+        if (rtval_type(value) == VAL_NUMBER)
         {
-            if (stack->array[i].is_float)
-                printf("%Lf", stack->array[i].floatval);
+            if (rtval_is_float(value))
+                printf("%f", rtval_float(value));
             else
-                printf("%lld", stack->array[i].intval);
+                printf("%lld", (long long int) rtval_int(value));
         }
-        else if (stack->array[i].type == VAL_STRING)
-            printf("\"%s\"", stack->array[i].strval);
+        else if (rtval_type(value) == VAL_STRING)
+            printf("\"%s\"", rtstring_data(rtval_string(value)));
         else 
-            printf("[Unknown %d]", stack->array[i].type);
+            printf("[Unknown %d]", rtval_type(value));
 
         if ((stack->si - 1) == i)
             printf("  <==");
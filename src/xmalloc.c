@@ -10,10 +10,14 @@
 #include "xmalloc.h"
 #include "blaze.h"
 
+size_t xmalloc_count = 0;
+
 void *xmalloc(size_t size) 
 {
     void *ptr = malloc(size);
 
+    xmalloc_count++;
+
     if (!ptr) 
     {
         fprintf(stderr, "xmalloc: failed to allocate memory\n");
@@ -27,6 +31,8 @@ void *xcalloc(size_t size, size_t blocks)
 {
     void *ptr = calloc(size, blocks);
 
+    xmalloc_count++;
+
     if (!ptr) 
     {
         fprintf(stderr, "xcalloc: failed to allocate memory\n");
@@ -40,6 +46,8 @@ void *xrealloc(void *oldptr, size_t size)
 {
     void *newptr = realloc(oldptr, size);
 
+    xmalloc_count++;
+
     if (!newptr) 
     {
         fprintf(stderr, "xrealloc: failed to reallocate memory: %s\n", strerror(errno));
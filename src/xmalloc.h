@@ -8,6 +8,9 @@
 #define znfree(ptr, ...) do { if (ptr) zfree(ptr, __VA_ARGS__); ptr = NULL; } while (0)  
 #define xmemcpy(ptr, type) (type *) copy_heap(ptr, sizeof (type)) 
 
+/* Calls to xmalloc(), xcalloc() and xrealloc(), for benchmarks. */
+extern size_t xmalloc_count;
+
 void *xcalloc(size_t size, size_t blocks);
 void *xmalloc(size_t size);
 void *xrealloc(void *oldptr, size_t size);
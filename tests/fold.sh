@@ -0,0 +1,88 @@
+#!/bin/sh
+
+. $(dirname "$0")/setup.sh
+
+blaze_file << EOF
+const day = 60 * 60 * 24;
+println(day, day * 7, 0 - 70000, 10 / 4);
+
+if (false) {
+    println("dead");
+}
+else {
+    println("live");
+}
+
+while (false) {
+    println("never");
+}
+EOF
+
+folded=$(blaze_run)
+
+blaze_file << EOF
+var sixty = 60;
+var day = sixty * sixty * 24;
+var zero = 0;
+var ten = 10;
+var no = false;
+println(day, day * 7, zero - 70000, ten / 4);
+
+if (no) {
+    println("dead");
+}
+else {
+    println("live");
+}
+
+while (no) {
+    println("never");
+}
+EOF
+
+blaze_test_name "Folded code prints the same as unfolded code"
+test "$folded" = "$(blaze_run)" && test -n "$folded"
+blaze_assert "$?"
+
+blaze_test_name "Folded code prints the same as unfolded code (closures)"
+test "$folded" = "$(blaze_run --closures)"
+blaze_assert "$?"
+
+blaze_file << EOF
+const day = 60 * 60 * 24;
+println(day, 0 - 70000);
+
+if (false) {
+    println("dead");
+}
+
+while (false) {
+    println("never");
+}
+EOF
+
+blaze_test_name "blazec pushes folded constants and drops dead code"
+listing=$("$(dirname "$BLAZE")/blazec" "$FILE")
+test "$?" = "0" && echo "$listing" | grep -q "push_int64 86400" && ! echo "$listing" | grep -q "dead\|never"
+blaze_assert "$?"
+rm -f "$(basename "$FILE" .bl)"
+
+blaze_test_name "Folded code prints the same as unfolded code (blazevm)"
+test "$(blaze_vm_run)" = "86400 -70000"
+blaze_assert "$?"
+
+blaze_file << EOF
+function f() {
+    if (true) return 5;
+    return 6;
+}
+
+println(f());
+EOF
+
+for flags in "" "--closures"; do
+    blaze_test_name "A folded if keeps its return nested $flags"
+    error=$($BLAZE $flags "$FILE" 2>&1 >/dev/null)
+    test "$?" = "1" && echo "$error" | grep -q "Unexpected return statement"
+    blaze_assert "$?"
+done
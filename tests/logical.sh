@@ -0,0 +1,43 @@
+#!/bin/sh
+
+. $(dirname "$0")/setup.sh
+
+blaze_test_name "Logical operators short-circuit"
+
+blaze_file << EOF
+var no = 0;
+var yes = 1;
+
+println(no && (1 / 0));
+println(yes || (1 / 0));
+println(no && println("skipped"));
+println(yes || println("skipped"));
+println(yes && println("ran"));
+EOF
+
+blaze_test "false true false true ran false\n" 1
+
+blaze_test_name "Logical operators short-circuit (closures)"
+test "$(blaze_run --closures)" = "false true false true ran false"
+blaze_assert "$?"
+
+blaze_file << EOF
+println(println(7) && (1 / 0));
+println(println(7) || println(8));
+println(typeof(7) || (1 / 0));
+println(typeof(7) && println(8));
+EOF
+
+expected="7 false 7 8 false true 8 false"
+
+blaze_test_name "Logical operators on call results"
+test "$(blaze_run)" = "$expected"
+blaze_assert "$?"
+
+blaze_test_name "Logical operators on call results (closures)"
+test "$(blaze_run --closures)" = "$expected"
+blaze_assert "$?"
+
+blaze_test_name "Logical operators on call results (blazevm)"
+test "$(blaze_vm_run)" = "$expected"
+blaze_assert "$?"
@@ -0,0 +1,20 @@
+#!/bin/sh
+
+. $(dirname "$0")/setup.sh
+
+blaze_test_name "Temporary strings are collected"
+
+blaze_file << EOF
+var i = 0;
+
+while (i < 2000000) {
+    typeof("abc" + i);
+    i++;
+}
+
+println(i);
+EOF
+
+rss=$(BLAZE_STATS=1 $BLAZE "$FILE" 2>&1 >/dev/null | sed -n "s/^memory: \([0-9]*\) KiB peak RSS$/\1/p")
+test -n "$rss" && test "$rss" -lt 65536
+blaze_assert "$?"
@@ -42,4 +42,4 @@ println({
 });
 EOF
 
-blaze_test '[Object] { some_property: 123, null_value: null, boolval: true, a_string: "Blaze" }\n' 2
+blaze_test '[Object] { some_property: 123, a_string: "Blaze", null_value: null, boolval: true }\n' 2
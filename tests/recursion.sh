@@ -0,0 +1,59 @@
+#!/bin/sh
+
+. $(dirname "$0")/setup.sh
+
+blaze_test_name "Deep tail recursion"
+
+blaze_file << EOF
+function done(n, total) {
+    return total;
+}
+
+function count(n, total) {
+    var next = done;
+
+    if (n > 0) {
+        next = count;
+    }
+
+    return next(n - 1, total + n);
+}
+
+println(count(1000000, 0));
+EOF
+
+blaze_test "500000500000\n" 1
+
+blaze_test_name "Deep tail recursion (closures)"
+test "$(blaze_run --closures)" = "500000500000"
+blaze_assert "$?"
+
+blaze_file << EOF
+function deeper(n) {
+    return deeper(n + 1) + 1;
+}
+
+println(deeper(0));
+EOF
+
+for flags in "" "--closures"; do
+    blaze_test_name "Unbounded recursion fails cleanly $flags"
+    error=$($BLAZE $flags "$FILE" 2>&1 >/dev/null)
+    test "$?" = "1" && echo "$error" | grep -q "Maximum call depth exceeded"
+    blaze_assert "$?"
+done
+
+awk 'BEGIN {
+    printf "println(";
+    for (i = 0; i < 200000; i++) printf "(";
+    printf "1";
+    for (i = 0; i < 200000; i++) printf ")";
+    print ");";
+}' > "$FILE"
+
+for flags in "" "--closures"; do
+    blaze_test_name "Deeply nested code fails cleanly $flags"
+    error=$($BLAZE $flags "$FILE" 2>&1 >/dev/null)
+    test "$?" = "1" && echo "$error" | grep -q "Maximum call depth exceeded"
+    blaze_assert "$?"
+done
@@ -3,7 +3,16 @@
 TEST_NAME="Unnamed"
 
 blaze_run() {
-    echo $($BLAZE "$FILE" | sed -r "s/\x1B\[([0-9]{1,3}(;[0-9]{1,2};?)?)?[mGK]//g")
+    echo $($BLAZE "$@" "$FILE" | sed -r "s/\x1B\[([0-9]{1,3}(;[0-9]{1,2};?)?)?[mGK]//g")
+}
+
+blaze_vm_run() {
+    bin=$(dirname "$BLAZE")
+    output=$(basename "$FILE" .bl)
+
+    "$bin/blazec" "$FILE" > /dev/null &&
+        echo $("$bin/blazevm" "$output" | sed -r "s/\x1B\[([0-9]{1,3}(;[0-9]{1,2};?)?)?[mGK]//g")
+    rm -f "$output"
 }
 
 blaze_file() {
@@ -19,8 +28,11 @@ blaze_test() {
     expected=$(printf "$1")
 
     test "$output" = "$expected"
+    blaze_assert "$?"
+}
 
-    if test "$?" != "0"; then
+blaze_assert() {
+    if test "$1" != "0"; then
         printf "\033[1;31mFAIL\033[0m \033[2m%s\033[0m\n" "$TEST_NAME"
         exit 127
     else